@@ -461,6 +461,16 @@ cdef class Parameters:
         def __get__(self): return self.thisptr.Elitism
         def __set__(self, double Elitism): self.thisptr.Elitism = Elitism
 
+    property NumThreads:
+        '''Number of threads to use (0 means one per hardware thread)'''
+        def __get__(self): return self.thisptr.NumThreads
+        def __set__(self, NumThreads): self.thisptr.NumThreads = NumThreads
+
+    property ParallelReproduction:
+        '''Produce the offspring of an epoch in parallel'''
+        def __get__(self): return self.thisptr.ParallelReproduction
+        def __set__(self, ParallelReproduction): self.thisptr.ParallelReproduction = ParallelReproduction
+
     ##############
     # ES HyperNEAT params
     ##############
@@ -645,6 +655,9 @@ cdef class NeuralNetwork:
     def InitRTRLMatrix(self):
         self.thisptr.InitRTRLMatrix()
     
+    def Compile(self):
+        self.thisptr.Compile()
+    
     def ActivateFast(self):
         self.thisptr.ActivateFast()
     
@@ -657,6 +670,15 @@ cdef class NeuralNetwork:
     def ActivateLeaky(self, step):
         self.thisptr.ActivateLeaky(step)
     
+    def ActivateFeedForward(self):
+        self.thisptr.ActivateFeedForward()
+    
+    def IsFeedForward(self):
+        return self.thisptr.IsFeedForward()
+    
+    def ActivateBatch(self, a_inputs, int depth=1):
+        return self.thisptr.ActivateBatch(a_inputs, depth)
+    
     def RTRL_update_gradients(self):
         self.thisptr.RTRL_update_gradients()
     
@@ -722,12 +744,12 @@ cdef class NeuralNetwork:
             def __set__(self, m_num_outputs): self.thisptr.m_num_outputs = m_num_outputs
             
     property neurons:
-        def __get__(self): return neuronsVectorToList(self.thisptr.m_neurons)
-        def __set__(self, list m_neurons): self.thisptr.m_neurons = neuronsListToVector(m_neurons)
+        def __get__(self): return neuronsVectorToList(self.thisptr.EditNeurons())
+        def __set__(self, list m_neurons): self.thisptr.SetNeurons(neuronsListToVector(m_neurons))
             
     property connections:
-           def __get__(self): return connectionsVectorToList(self.thisptr.m_connections)
-           def __set__(self, list m_connections): self.thisptr.m_connections = connectionsListToVector(m_connections)
+           def __get__(self): return connectionsVectorToList(self.thisptr.EditConnections())
+           def __set__(self, list m_connections): self.thisptr.SetConnections(connectionsListToVector(m_connections))
 """
 #############################################
 
@@ -909,7 +931,7 @@ cdef class Genome:
         def __set__(self, val): self.thisptr.SetID(val)
     
     def CalculateDepth(self):
-        self.thisptr.CalculateDepth()
+        return self.thisptr.CalculateDepth()
     
     def GetDepth(self):
         return self.thisptr.GetDepth()
@@ -1064,6 +1086,36 @@ cdef class Population:
             cdef list newspecies = speciesVectorToList(self.thisptr.m_Species)
             return newspecies
 
+cdef class PopulationEvaluator:
+    cdef cmn.PopulationEvaluator *thisptr      # hold a C++ instance which we're wrapping
+
+    def __cinit__(self, unsigned int num_threads=0):
+        self.thisptr = new cmn.PopulationEvaluator(num_threads)
+
+    def __dealloc__(self):
+        del self.thisptr
+
+    def Build(self, Population pop):
+        self.thisptr.Build(deref(pop.thisptr))
+
+    def Flush(self):
+        self.thisptr.Flush()
+
+    def Step(self, observations, int depth=1):
+        return self.thisptr.Step(observations, depth)
+
+    def SetFitnesses(self, fitnesses):
+        self.thisptr.SetFitnesses(fitnesses)
+
+    def NumNetworks(self):
+        return self.thisptr.NumNetworks()
+
+    def NumInputs(self):
+        return self.thisptr.NumInputs()
+
+    def NumOutputs(self):
+        return self.thisptr.NumOutputs()
+
 class NeuronType:
     NONE = cmn.NONE
     INPUT  = cmn.INPUT
@@ -173,6 +173,9 @@ cdef extern from "src/Parameters.h" namespace "NEAT":
         # Fraction of individuals to be copied unchanged
         double Elitism 'EliteFraction'
 
+        unsigned int NumThreads
+        bool ParallelReproduction
+
         Parameters() except +
 
         int Load(const char* filename)
@@ -265,10 +268,14 @@ cdef extern from "src/NeuralNetwork.h" namespace "NEAT":
         NeuralNetwork(bool x) except +
 
         void InitRTRLMatrix()
+        void Compile()
         void ActivateFast()
         void Activate()
         void ActivateUseInternalBias()
         void ActivateLeaky(double step)
+        void ActivateFeedForward()
+        bool IsFeedForward()
+        vector[vector[double]] ActivateBatch(vector[vector[double]]& a_inputs, int a_depth)
 
         void RTRL_update_gradients()
         void RTRL_update_error(double a_target)
@@ -289,6 +296,10 @@ cdef extern from "src/NeuralNetwork.h" namespace "NEAT":
 
         void AddNeuron(const Neuron& a_n)
         void AddConnection(const Connection& a_c)
+        void SetNeurons(const vector[Neuron]& a_neurons)
+        void SetConnections(const vector[Connection]& a_connections)
+        vector[Neuron]& EditNeurons()
+        vector[Connection]& EditConnections()
         Connection GetConnectionByIndex(unsigned int a_idx) const
         Neuron GetNeuronByIndex(unsigned int a_idx) const
         void SetInputOutputDimentions(const unsigned short a_i, const unsigned short a_o)
@@ -363,7 +374,7 @@ cdef extern from "src/Genome.h" namespace "NEAT":
         void SetFitness(double a_f)
         unsigned int GetID()
         void SetID(int a_id)
-        void CalculateDepth()
+        bool CalculateDepth()
         unsigned int GetDepth()
 
         void BuildPhenotype(NeuralNetwork& net)
@@ -461,3 +472,24 @@ cdef extern from "src/Population.h" namespace "NEAT":
 
         void Save(const char* a_FileName)
         Genome* Tick(Genome& a_deleted_genome)
+
+
+"""
+#############################################
+
+PopulationEvaluator class
+
+#############################################
+"""
+
+cdef extern from "src/PopulationEvaluator.h" namespace "NEAT":
+    cdef cppclass PopulationEvaluator:
+        PopulationEvaluator(unsigned int a_num_threads) except +
+
+        void Build(Population& a_Pop) except +
+        void Flush()
+        vector[vector[double]] Step(vector[vector[double]]& a_observations, int a_depth)
+        void SetFitnesses(vector[double]& a_fitnesses)
+        unsigned int NumNetworks()
+        unsigned int NumInputs()
+        unsigned int NumOutputs()
@@ -31,9 +31,12 @@ def getExtensions():
                'src/Parameters.cpp',
                'src/PhenotypeBehavior.cpp',
                'src/Population.cpp',
+               'src/PopulationEvaluator.cpp',
                'src/Random.cpp',
                'src/Species.cpp',
                'src/Substrate.cpp',
+               'src/ThreadPool.cpp',
+               'src/Traits.cpp',
                'src/Utils.cpp']
 
     extra = ['-march=native',
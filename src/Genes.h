@@ -90,6 +90,46 @@ namespace NEAT
 
     };
 
+    // Distances between the traits of genes, summed per trait and ordered by trait name
+    class TraitDistances
+    {
+    public:
+        class Entry
+        {
+        public:
+            int key;
+            const std::string* name;
+            double distance;
+        };
+
+        std::vector<Entry> m_Entries;
+
+        void Add(int a_Key, const std::string* a_Name, double a_Distance)
+        {
+            for(unsigned int i=0; i<m_Entries.size(); i++)
+            {
+                if (m_Entries[i].key == a_Key)
+                {
+                    m_Entries[i].distance += a_Distance;
+                    return;
+                }
+            }
+
+            Entry e;
+            e.key = a_Key;
+            e.name = a_Name;
+            e.distance = a_Distance;
+
+            // keep the name order
+            std::vector<Entry>::iterator pos = m_Entries.end();
+            while ((pos != m_Entries.begin()) && (*a_Name < *(pos - 1)->name))
+            {
+                pos--;
+            }
+            m_Entries.insert(pos, e);
+        }
+    };
+
     //////////////////////////////////
     // Base Gene class
     //////////////////////////////////
@@ -97,7 +137,7 @@ namespace NEAT
     {
     public:
         // Arbitrary traits
-        std::map<std::string, Trait> m_Traits;
+        TraitMap m_Traits;
 
         Gene &operator=(const Gene &a_g)
         {
@@ -109,10 +149,33 @@ namespace NEAT
             return *this;
         }
 
+        // The trait a_Params describe, inserted if missing.
+        // Interned parameters (TraitParameters::Intern()) skip the name registry.
+        Trait &GetTrait(const std::string &a_Name, const TraitParameters &a_Params, unsigned int a_Slot)
+        {
+            if (a_Params.key >= 0)
+            {
+                return m_Traits.Get(a_Params.key, a_Params.name, a_Slot);
+            }
+            return m_Traits.Get(a_Name, a_Slot);
+        }
+
+        // Like TraitMap::at() for the trait a_Dependency refers to
+        static const Trait &OtherDependency(const TraitMap &a_Other, const TraitDependency &a_Dependency)
+        {
+            const Trait *t = a_Other.FindDependency(a_Dependency);
+            if (t == NULL)
+            {
+                throw std::out_of_range("No such trait: " + a_Dependency.dep_key);
+            }
+            return *t;
+        }
+
         // Randomize based on parameters
         void InitTraits(const std::map<std::string, TraitParameters> &tp, RNG &a_RNG)
         {
-            for(auto it = tp.begin(); it != tp.end(); it++)
+            unsigned int slot = 0;
+            for(auto it = tp.begin(); it != tp.end(); it++, slot++)
             {
                 // Check what kind of type is this and create such trait
                 TraitType t;
@@ -174,22 +237,38 @@ namespace NEAT
                     t = itp(); // details is a function that returns a random instance of the trait
                 }
 
-                Trait tr;
+                Trait &tr = GetTrait(it->first, it->second, slot);
                 tr.value = t;
-                tr.dep_key = it->second.dep_key;
-                tr.dep_values = it->second.dep_values;
-                // todo check for invalid dep_values types here
-                m_Traits[it->first] = tr;
+                tr.dependency.reset();
+                if (it->second.key >= 0)
+                {
+                    // shared by all genes
+                    tr.dependency = it->second.dependency;
+                }
+                else if (it->second.dep_key != "")
+                {
+                    TraitDependency *dep = new TraitDependency();
+                    dep->dep_key = it->second.dep_key;
+                    dep->dep_values = it->second.dep_values;
+                    // todo check for invalid dep_values types here
+                    tr.dependency.reset(dep);
+                }
             }
         }
 
         // Traits are merged with this other parent
-        void MateTraits(const std::map<std::string, Trait> &t, RNG &a_RNG)
+        void MateTraits(const TraitMap &t, RNG &a_RNG)
         {
-            for(auto it = t.begin(); it != t.end(); it++)
+            unsigned int slot = 0;
+            for(auto it = t.begin(); it != t.end(); it++, slot++)
             {
-                TraitType mine = m_Traits[it->first].value;
-                TraitType yours = it->second.value;
+                Trait *my_trait = m_Traits.Find(it->key, slot);
+                if (my_trait == NULL)
+                {
+                    my_trait = &m_Traits.Get(it->key, it->name);
+                }
+                TraitType &mine = my_trait->value;
+                const TraitType &yours = it->trait.value;
 
                 if (!(mine.type() == yours.type()))
                 {
@@ -200,14 +279,14 @@ namespace NEAT
                 if (mine.type() == typeid(py::object))
                 {
                     // call mating function
-                    m_Traits[it->first].value = bs::get<py::object>(mine).attr("mate")(bs::get<py::object>(yours));
+                    mine = bs::get<py::object>(mine).attr("mate")(bs::get<py::object>(yours));
                 }
                 else
                 {
 
                     if (a_RNG.RandFloat() < 0.5) // pick either one
                     {
-                        m_Traits[it->first].value = (a_RNG.RandFloat() < 0.5) ? mine : yours;
+                        mine = (a_RNG.RandFloat() < 0.5) ? mine : yours;
                     }
                     else
                     {
@@ -216,32 +295,32 @@ namespace NEAT
                         {
                             int m1 = bs::get<int>(mine);
                             int m2 = bs::get<int>(yours);
-                            m_Traits[it->first].value = (m1 + m2) / 2;
+                            mine = (m1 + m2) / 2;
                         }
 
                         if (mine.type() == typeid(double))
                         {
                             double m1 = bs::get<double>(mine);
                             double m2 = bs::get<double>(yours);
-                            m_Traits[it->first].value = (m1 + m2) / 2.0;
+                            mine = (m1 + m2) / 2.0;
                         }
 
                         if (mine.type() == typeid(std::string))
                         {
                             // strings are always either-or
-                            m_Traits[it->first].value = (a_RNG.RandFloat() < 0.5) ? mine : yours;
+                            mine = (a_RNG.RandFloat() < 0.5) ? mine : yours;
                         }
 
                         if (mine.type() == typeid(intsetelement))
                         {
                             // int sets are always either-or
-                            m_Traits[it->first].value = (a_RNG.RandFloat() < 0.5) ? mine : yours;
+                            mine = (a_RNG.RandFloat() < 0.5) ? mine : yours;
                         }
 
                         if (mine.type() == typeid(floatsetelement))
                         {
                             // float sets are always either-or
-                            m_Traits[it->first].value = (a_RNG.RandFloat() < 0.5) ? mine : yours;
+                            mine = (a_RNG.RandFloat() < 0.5) ? mine : yours;
                         }
                     }
                 }
@@ -253,7 +332,8 @@ namespace NEAT
         bool MutateTraits(const std::map<std::string, TraitParameters> &tp, RNG &a_RNG)
         {
             bool did_mutate = false;
-            for(auto it = tp.begin(); it != tp.end(); it++)
+            unsigned int slot = 0;
+            for(auto it = tp.begin(); it != tp.end(); it++, slot++)
             {
                 // Check what kind of type is this and modify it
                 TraitType t;
@@ -263,12 +343,14 @@ namespace NEAT
                 if (it->second.dep_key != "")
                 {
                     // there is such trait..
-                    if (m_Traits.count(it->second.dep_key) != 0)
+                    const Trait *dep = it->second.dependency ? m_Traits.FindDependency(*it->second.dependency)
+                                                             : m_Traits.Find(it->second.dep_key);
+                    if (dep != NULL)
                     {
                         // and it matches any of the right values?
                         for(int ix=0; ix<it->second.dep_values.size();ix++)
                         {
-                            if (m_Traits[it->second.dep_key].value == it->second.dep_values[ix])
+                            if (dep->value == it->second.dep_values[ix])
                             {
                                 doit = true;
                                 break;
@@ -283,6 +365,9 @@ namespace NEAT
 
                 if (doit)
                 {
+                    // like std::map::operator[], a missing trait is added when it is accessed
+                    auto value = [&]() -> TraitType& { return GetTrait(it->first, it->second, slot).value; };
+
                     if (it->second.type == "int")
                     {
                         IntTraitParameters itp = bs::get<IntTraitParameters>(it->second.m_Details);
@@ -295,20 +380,20 @@ namespace NEAT
                             {
                                 // replace
                                 int val = 0;
-                                int cur = bs::get<int>(m_Traits[it->first].value);
+                                int cur = bs::get<int>(value());
                                 val = a_RNG.RandInt(itp.min, itp.max);
-                                m_Traits[it->first].value = val;
+                                value() = val;
                                 if (cur != val)
                                     did_mutate = true;
                             }
                             else
                             {
                                 // modify
-                                int val = bs::get<int>(m_Traits[it->first].value);
+                                int val = bs::get<int>(value());
                                 int cur = val;
                                 val += a_RNG.RandInt(-itp.mut_power, itp.mut_power);
                                 Clamp(val, itp.min, itp.max);
-                                m_Traits[it->first].value = val;
+                                value() = val;
                                 if (cur != val)
                                     did_mutate = true;
                             }
@@ -326,21 +411,21 @@ namespace NEAT
                             {
                                 // replace
                                 double val = 0;
-                                double cur = bs::get<double>(m_Traits[it->first].value);
+                                double cur = bs::get<double>(value());
                                 val = a_RNG.RandFloat();
                                 Scale(val, 0, 1, itp.min, itp.max);
-                                m_Traits[it->first].value = val;
+                                value() = val;
                                 if (cur != val)
                                     did_mutate = true;
                             }
                             else
                             {
                                 // modify
-                                double val = bs::get<double>(m_Traits[it->first].value);
+                                double val = bs::get<double>(value());
                                 double cur = val;
                                 val += a_RNG.RandFloatSigned() * itp.mut_power;
                                 Clamp(val, itp.min, itp.max);
-                                m_Traits[it->first].value = val;
+                                value() = val;
                                 if (cur != val)
                                     did_mutate = true;
                             }
@@ -353,10 +438,10 @@ namespace NEAT
                         probs.resize(itp.set.size());
 
                         int idx = a_RNG.Roulette(probs);
-                        std::string cur = bs::get<std::string>(m_Traits[it->first].value);
+                        std::string cur = bs::get<std::string>(value());
 
                         // now choose the new idx from the set
-                        m_Traits[it->first].value = itp.set[idx];
+                        value() = itp.set[idx];
                         if (cur != itp.set[idx])
                             did_mutate = true;
                     }
@@ -367,10 +452,10 @@ namespace NEAT
                         probs.resize(itp.set.size());
 
                         int idx = a_RNG.Roulette(probs);
-                        intsetelement cur = bs::get<intsetelement>(m_Traits[it->first].value);
+                        intsetelement cur = bs::get<intsetelement>(value());
 
                         // now choose the new idx from the set
-                        m_Traits[it->first].value = itp.set[idx];
+                        value() = itp.set[idx];
                         if(cur.value != itp.set[idx].value)
                             did_mutate = true;
                     }
@@ -381,16 +466,16 @@ namespace NEAT
                         probs.resize(itp.set.size());
 
                         int idx = a_RNG.Roulette(probs);
-                        floatsetelement cur = bs::get<floatsetelement>(m_Traits[it->first].value);
+                        floatsetelement cur = bs::get<floatsetelement>(value());
 
                         // now choose the new idx from the set
-                        m_Traits[it->first].value = itp.set[idx];
+                        value() = itp.set[idx];
                         if(cur.value != itp.set[idx].value)
                             did_mutate = true;
                     }
                     if (it->second.type == "pyobject")
                     {
-                        m_Traits[it->first].value = bs::get<py::object>(m_Traits[it->first].value).attr("mutate")();
+                        value() = bs::get<py::object>(value()).attr("mutate")();
                         did_mutate = true;
                     }
                 }
@@ -399,14 +484,17 @@ namespace NEAT
             return did_mutate;
         }
 
-        // Compute and return distances between each matching pair of traits
-        std::map<std::string, double> GetTraitDistances(const std::map<std::string, Trait> &other)
+        // Compute the distances between each matching pair of traits and add them to a_Dist
+        void GetTraitDistances(const TraitMap &other, TraitDistances &a_Dist) const
         {
-            std::map<std::string, double> dist;
-            for(auto it = other.begin(); it!=other.end(); it++)
+            unsigned int slot = 0;
+            for(auto it = other.begin(); it!=other.end(); it++, slot++)
             {
-                TraitType mine = m_Traits[it->first].value;
-                TraitType yours = it->second.value;
+                // a missing trait counts as a default one
+                const Trait *my_trait = m_Traits.Find(it->key, slot);
+                TraitType missing;
+                const TraitType &mine = (my_trait != NULL) ? my_trait->value : missing;
+                const TraitType &yours = it->trait.value;
 
                 if (!(mine.type() == yours.type()))
                 {
@@ -416,17 +504,19 @@ namespace NEAT
                 // only do it if the trait if it's enabled
                 // todo: not sure about the distance, think more about it
                 bool doit = false;
-                if (it->second.dep_key != "")
+                if (it->trait.dependency)
                 {
+                    const TraitDependency &dependency = *it->trait.dependency;
                     // there is such trait..
-                    if (m_Traits.count(it->second.dep_key) != 0)
+                    const Trait *dep = m_Traits.FindDependency(dependency);
+                    if (dep != NULL)
                     {
                         // and it has the right value?
                         // also the other genome has to have the trait turned on
-                        for(int ix=0; ix<it->second.dep_values.size(); ix++)
+                        for(int ix=0; ix<dependency.dep_values.size(); ix++)
                         {
-                            if ((m_Traits[it->second.dep_key].value == it->second.dep_values[ix]) &&
-                                (other.at(it->second.dep_key).value == it->second.dep_values[ix]))
+                            if ((dep->value == dependency.dep_values[ix]) &&
+                                (OtherDependency(other, dependency).value == dependency.dep_values[ix]))
                             {
                                 doit = true;
                                 break;
@@ -441,47 +531,47 @@ namespace NEAT
 
                 if (doit)
                 {
+                    double dist = 0.0;
                     if (mine.type() == typeid(int))
                     {
                         // distance between ints - calculate directly
-                        dist[it->first] = abs(bs::get<int>(mine) - bs::get<int>(yours));
+                        dist = abs(bs::get<int>(mine) - bs::get<int>(yours));
                     }
                     if (mine.type() == typeid(double))
                     {
                         // distance between floats - calculate directly
-                        dist[it->first] = abs(bs::get<double>(mine) - bs::get<double>(yours));
+                        dist = abs(bs::get<double>(mine) - bs::get<double>(yours));
                     }
                     if (mine.type() == typeid(std::string))
                     {
                         // distance between strings - matching is 0, non-matching is 1
                         if (bs::get<std::string>(mine) == bs::get<std::string>(yours))
                         {
-                            dist[it->first] = 0.0;
+                            dist = 0.0;
                         }
                         else
                         {
-                            dist[it->first] = 1.0;
+                            dist = 1.0;
                         }
                     }
                     if (mine.type() == typeid(intsetelement))
                     {
                         // distance between ints - calculate directly
-                        dist[it->first] = abs((bs::get<intsetelement>(mine)).value - (bs::get<intsetelement>(yours)).value);
+                        dist = abs((bs::get<intsetelement>(mine)).value - (bs::get<intsetelement>(yours)).value);
                     }
                     if (mine.type() == typeid(floatsetelement))
                     {
                         // distance between floats - calculate directly
-                        dist[it->first] = abs((bs::get<floatsetelement>(mine)).value - (bs::get<floatsetelement>(yours)).value);
+                        dist = abs((bs::get<floatsetelement>(mine)).value - (bs::get<floatsetelement>(yours)).value);
                     }
                     if (mine.type() == typeid(py::object))
                     {
                         // distance between objects - calculate via method
-                        dist[it->first] = py::extract<double>(bs::get<py::object>(mine).attr("distance_to")(bs::get<py::object>(yours)));
+                        dist = py::extract<double>(bs::get<py::object>(mine).attr("distance_to")(bs::get<py::object>(yours)));
                     }
+                    a_Dist.Add(it->key, it->name, dist);
                 }
             }
-
-            return dist;
         }
     };
 
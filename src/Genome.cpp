@@ -30,11 +30,13 @@
 
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <limits>
 #include <queue>
 #include <math.h>
 #include <utility>
-#include <boost/unordered_map.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
@@ -45,6 +47,7 @@
 #include "Utils.h"
 #include "Parameters.h"
 #include "Assert.h"
+#include "ThreadPool.h"
 
 namespace NEAT
 {
@@ -58,6 +61,87 @@ namespace NEAT
         return x * x;
     }
 
+    // Activates a CPPN so its outputs reflect the current inputs.
+    // A feed-forward CPPN needs only a single pass in topological order,
+    // one with loops is activated a_depth times to let it relax.
+    inline void ActivateCPPN(NeuralNetwork &a_cppn, int a_depth)
+    {
+        if (a_cppn.IsFeedForward())
+        {
+            a_cppn.ActivateFeedForward();
+        }
+        else
+        {
+            for (int d = 0; d < a_depth; d++)
+            {
+                a_cppn.Activate();
+            }
+        }
+    }
+
+
+    // Runs a feed-forward or looped CPPN on a_count queries, with the same results as
+    // Flush(), Input() and ActivateCPPN() for each one, but a block of queries at a time.
+    // a_fill(q, row) writes the inputs of query q into row, a_take(q, outputs) receives its outputs.
+    // The blocks are spread over the threads of a_pool, each with its own copy of the CPPN,
+    // so a_take() must only write to the place of its query.
+    static void QueryCPPN(NeuralNetwork &a_cppn, unsigned int a_count, int a_depth, ThreadPool &a_pool,
+                   const std::function<void(unsigned int, double*)> &a_fill,
+                   const std::function<void(unsigned int, const double*)> &a_take)
+    {
+        const unsigned int t_block_size = 128;
+        unsigned int t_num_blocks = (a_count + t_block_size - 1) / t_block_size;
+        if (t_num_blocks == 0)
+        {
+            return;
+        }
+
+        // compiling now keeps the copies from compiling on their own
+        a_cppn.IsFeedForward();
+
+        unsigned int t_num_tasks = 1;
+        std::vector<NeuralNetwork> t_copies; // for the tasks after the first
+        auto t_task = [&](unsigned int a_task)
+        {
+            NeuralNetwork &t_cppn = (a_task > 0) ? t_copies[a_task - 1] : a_cppn;
+
+            unsigned int t_num_inputs = t_cppn.NumInputs();
+            unsigned int t_num_outputs = t_cppn.NumOutputs();
+            std::vector<double> t_inputs, t_outputs;
+
+            // every task takes every t_num_tasks-th block
+            for (unsigned int b = a_task; b < t_num_blocks; b += t_num_tasks)
+            {
+                unsigned int t_first = b * t_block_size;
+                unsigned int t_size = std::min(t_block_size, a_count - t_first);
+
+                t_inputs.assign(t_size * t_num_inputs, 0.0);
+                for (unsigned int q = 0; q < t_size; q++)
+                {
+                    a_fill(t_first + q, &t_inputs[q * t_num_inputs]);
+                }
+
+                t_cppn.ActivateBatch(t_inputs, t_size, t_outputs, a_depth);
+
+                for (unsigned int q = 0; q < t_size; q++)
+                {
+                    a_take(t_first + q, &t_outputs[q * t_num_outputs]);
+                }
+            }
+        };
+
+        if ((a_pool.NumThreads() == 1) || (t_num_blocks == 1))
+        {
+            t_task(0);
+        }
+        else
+        {
+            t_num_tasks = std::min(a_pool.NumThreads(), t_num_blocks);
+            t_copies.assign(t_num_tasks - 1, a_cppn);
+            a_pool.ParallelFor(t_num_tasks, t_task);
+        }
+    }
+
 
     // Create an empty genome
     Genome::Genome()
@@ -100,6 +184,34 @@ namespace NEAT
 #endif
     }
 
+    // Move constructor
+    Genome::Genome(Genome &&a_G) noexcept
+    {
+        m_ID = a_G.m_ID;
+        m_Depth = a_G.m_Depth;
+        m_NeuronGenes.swap(a_G.m_NeuronGenes);
+        m_LinkGenes.swap(a_G.m_LinkGenes);
+        m_Index.store(a_G.m_Index.exchange(NULL, std::memory_order_acq_rel), std::memory_order_release);
+        m_GenomeGene.m_Traits.swap(a_G.m_GenomeGene.m_Traits);
+        m_Fitness = a_G.m_Fitness;
+        m_NumInputs = a_G.m_NumInputs;
+        m_NumOutputs = a_G.m_NumOutputs;
+        m_AdjustedFitness = a_G.m_AdjustedFitness;
+        m_OffspringAmount = a_G.m_OffspringAmount;
+        m_Evaluated = a_G.m_Evaluated;
+        m_PhenotypeBehavior = a_G.m_PhenotypeBehavior;
+        m_initial_num_neurons = a_G.m_initial_num_neurons;
+        m_initial_num_links = a_G.m_initial_num_links;
+#ifdef USE_BOOST_PYTHON
+        m_behavior = a_G.m_behavior;
+#endif
+    }
+
+    Genome::~Genome()
+    {
+        delete m_Index.load(std::memory_order_relaxed);
+    }
+
     // assignment operator
     Genome &Genome::operator=(const Genome &a_G)
     {
@@ -110,6 +222,7 @@ namespace NEAT
             m_Depth = a_G.m_Depth;
             m_NeuronGenes = a_G.m_NeuronGenes;
             m_LinkGenes = a_G.m_LinkGenes;
+            InvalidateIndex();
             m_GenomeGene = a_G.m_GenomeGene;
             m_Fitness = a_G.m_Fitness;
             m_AdjustedFitness = a_G.m_AdjustedFitness;
@@ -127,6 +240,36 @@ namespace NEAT
 
         return *this;
     }
+
+    // move assignment operator
+    Genome &Genome::operator=(Genome &&a_G) noexcept
+    {
+        if (this != &a_G)
+        {
+            m_ID = a_G.m_ID;
+            m_Depth = a_G.m_Depth;
+            m_NeuronGenes.swap(a_G.m_NeuronGenes);
+            m_LinkGenes.swap(a_G.m_LinkGenes);
+            // the genes were exchanged, so are the indexes
+            GeneIndex *t_index = m_Index.exchange(a_G.m_Index.load(std::memory_order_acquire), std::memory_order_acq_rel);
+            a_G.m_Index.store(t_index, std::memory_order_release);
+            m_GenomeGene.m_Traits.swap(a_G.m_GenomeGene.m_Traits);
+            m_Fitness = a_G.m_Fitness;
+            m_AdjustedFitness = a_G.m_AdjustedFitness;
+            m_NumInputs = a_G.m_NumInputs;
+            m_NumOutputs = a_G.m_NumOutputs;
+            m_OffspringAmount = a_G.m_OffspringAmount;
+            m_Evaluated = a_G.m_Evaluated;
+            m_PhenotypeBehavior = a_G.m_PhenotypeBehavior;
+            m_initial_num_neurons = a_G.m_initial_num_neurons;
+            m_initial_num_links = a_G.m_initial_num_links;
+#ifdef USE_BOOST_PYTHON
+            m_behavior = a_G.m_behavior;
+#endif
+        }
+
+        return *this;
+    }
     
     // New constructor that creates a fully-connected CTRNN
     Genome::Genome(unsigned int a_ID,
@@ -562,9 +705,9 @@ namespace NEAT
     LinkGene Genome::GetLinkByInnovID(int a_ID) const
     {
         ASSERT(HasLinkByInnovID(a_ID));
-        for (unsigned int i = 0; i < m_LinkGenes.size(); i++)
-            if (m_LinkGenes[i].InnovationID() == a_ID)
-                return m_LinkGenes[i];
+        int t_idx = GetLinkIndex(a_ID);
+        if (t_idx != -1)
+            return m_LinkGenes[t_idx];
 
         // should never reach this code
         throw std::exception();
@@ -615,6 +758,12 @@ namespace NEAT
     {
         ASSERT(a_ID > 0);
 
+        if (UseIndex())
+        {
+            std::unordered_map<int, int>::const_iterator t_it = Index().m_Neurons.find(a_ID);
+            return (t_it != Index().m_Neurons.end()) ? t_it->second : -1;
+        }
+
         for (unsigned int i = 0; i < NumNeurons(); i++)
         {
             if (m_NeuronGenes[i].ID() == a_ID)
@@ -633,6 +782,12 @@ namespace NEAT
         ASSERT(a_InnovID > 0);
         ASSERT(NumLinks() > 0);
 
+        if (UseIndex())
+        {
+            std::unordered_map<int, int>::const_iterator t_it = Index().m_Links.find(a_InnovID);
+            return (t_it != Index().m_Links.end()) ? t_it->second : -1;
+        }
+
         for (unsigned int i = 0; i < NumLinks(); i++)
         {
             if (m_LinkGenes[i].InnovationID() == a_InnovID)
@@ -645,6 +800,97 @@ namespace NEAT
     }
 
 
+    // The key of a link in GeneIndex::m_Ends
+    static unsigned long long LinkEndsKey(int a_From, int a_To)
+    {
+        return (static_cast<unsigned long long>(static_cast<unsigned int>(a_From)) << 32) |
+               static_cast<unsigned long long>(static_cast<unsigned int>(a_To));
+    }
+
+    const Genome::GeneIndex &Genome::Index() const
+    {
+        GeneIndex *t_index = m_Index.load(std::memory_order_acquire);
+        if (t_index == NULL)
+        {
+            // another thread may be creating it at the same time, keep the first one
+            GeneIndex *t_new = new GeneIndex();
+            if (m_Index.compare_exchange_strong(t_index, t_new, std::memory_order_acq_rel))
+            {
+                t_index = t_new;
+            }
+            else
+            {
+                delete t_new;
+            }
+        }
+
+        // the counts are written last, so if they match nothing is being indexed
+        if ((t_index->m_NumNeurons.load(std::memory_order_acquire) != m_NeuronGenes.size()) ||
+            (t_index->m_NumLinks.load(std::memory_order_acquire) != m_LinkGenes.size()))
+        {
+            UpdateIndex(*t_index);
+        }
+        return *t_index;
+    }
+
+    void Genome::UpdateIndex(GeneIndex &a_Index) const
+    {
+        std::lock_guard<std::mutex> t_lock(a_Index.m_Mutex);
+
+        unsigned int t_num_neurons = a_Index.m_NumNeurons.load(std::memory_order_relaxed);
+        unsigned int t_num_links = a_Index.m_NumLinks.load(std::memory_order_relaxed);
+
+        // genes were removed without invalidating, start over
+        if ((t_num_neurons > m_NeuronGenes.size()) || (t_num_links > m_LinkGenes.size()))
+        {
+            a_Index.m_Neurons.clear();
+            a_Index.m_Links.clear();
+            a_Index.m_Ends.clear();
+            a_Index.m_Out.clear();
+            a_Index.m_In.clear();
+            t_num_neurons = t_num_links = 0;
+        }
+
+        // index the appended genes, the first gene with a given ID wins like in a linear search
+        for (unsigned int i = t_num_neurons; i < m_NeuronGenes.size(); i++)
+        {
+            a_Index.m_Neurons.insert(std::make_pair(m_NeuronGenes[i].ID(), static_cast<int>(i)));
+        }
+        for (unsigned int i = t_num_links; i < m_LinkGenes.size(); i++)
+        {
+            const LinkGene &t_link = m_LinkGenes[i];
+            a_Index.m_Links.insert(std::make_pair(t_link.InnovationID(), static_cast<int>(i)));
+            a_Index.m_Ends.insert(std::make_pair(LinkEndsKey(t_link.FromNeuronID(), t_link.ToNeuronID()), static_cast<int>(i)));
+            a_Index.m_Out[t_link.FromNeuronID()].push_back(i);
+            a_Index.m_In[t_link.ToNeuronID()].push_back(i);
+        }
+
+        a_Index.m_HasDepth = false;
+
+        a_Index.m_NumNeurons.store(m_NeuronGenes.size(), std::memory_order_release);
+        a_Index.m_NumLinks.store(m_LinkGenes.size(), std::memory_order_release);
+    }
+
+    void Genome::InvalidateIndex()
+    {
+        delete m_Index.exchange(NULL, std::memory_order_acq_rel);
+    }
+
+    static const std::vector<int> s_no_links;
+
+    const std::vector<int> &Genome::GetInLinkIndexes(int a_ID) const
+    {
+        std::unordered_map<int, std::vector<int> >::const_iterator t_it = Index().m_In.find(a_ID);
+        return (t_it != Index().m_In.end()) ? t_it->second : s_no_links;
+    }
+
+    const std::vector<int> &Genome::GetOutLinkIndexes(int a_ID) const
+    {
+        std::unordered_map<int, std::vector<int> >::const_iterator t_it = Index().m_Out.find(a_ID);
+        return (t_it != Index().m_Out.end()) ? t_it->second : s_no_links;
+    }
+
+
     // returns the max neuron ID
     int Genome::GetLastNeuronID() const
     {
@@ -683,15 +929,7 @@ namespace NEAT
         ASSERT(a_ID > 0);
         ASSERT(NumNeurons() > 0);
 
-        for (unsigned int i = 0; i < NumNeurons(); i++)
-        {
-            if (m_NeuronGenes[i].ID() == a_ID)
-            {
-                return true;
-            }
-        }
-
-        return false;
+        return GetNeuronIndex(a_ID) != -1;
     }
 
 
@@ -700,6 +938,11 @@ namespace NEAT
     {
         ASSERT((a_n1id > 0) && (a_n2id > 0));
 
+        if (UseIndex())
+        {
+            return Index().m_Ends.count(LinkEndsKey(a_n1id, a_n2id)) != 0;
+        }
+
         for (unsigned int i = 0; i < NumLinks(); i++)
         {
             if ((m_LinkGenes[i].FromNeuronID() == a_n1id) && (m_LinkGenes[i].ToNeuronID() == a_n2id))
@@ -711,49 +954,136 @@ namespace NEAT
         return false;
     }
 
-    bool Genome::HasLoops()
+    // Scratch buffers of the loop checks, kept so the checks don't allocate once they are big enough.
+    // There is one set per thread, since the checks run on shared genomes from several threads.
+    struct LoopCheckScratch
+    {
+        std::vector<int> m_counts; // per neuron index
+        std::vector<int> m_ids;    // queue or stack of neuron IDs
+    };
+
+    static LoopCheckScratch &GetLoopCheckScratch()
+    {
+        static thread_local LoopCheckScratch t_scratch;
+        return t_scratch;
+    }
+
+    bool Genome::HasLoops() const
     {
-        NeuralNetwork net;
-        BuildPhenotype(net);
-        bool has_cycles = false;
+        LoopCheckScratch &t_scratch = GetLoopCheckScratch();
 
-        // convert the net to a Boost::Graph object
-        Graph g;
-        for (int i = 0; i < net.m_connections.size(); i++)
+        // Kahn's algorithm - whatever can't be ordered is in a loop or fed by one
+        std::vector<int> &t_num_incoming = t_scratch.m_counts;
+        t_num_incoming.assign(NumNeurons(), 0);
+        for (unsigned int i = 0; i < NumLinks(); i++)
         {
-            bs::add_edge(net.m_connections[i].m_source_neuron_idx, net.m_connections[i].m_target_neuron_idx, g);
+            int t_to = GetNeuronIndex(m_LinkGenes[i].ToNeuronID());
+            if ((t_to != -1) && HasNeuronID(m_LinkGenes[i].FromNeuronID()))
+            {
+                t_num_incoming[t_to]++;
+            }
         }
 
-        typedef std::vector<Vertex> container;
-        container c;
-        try
+        std::vector<int> &t_queue = t_scratch.m_ids;
+        t_queue.clear();
+        for (unsigned int i = 0; i < NumNeurons(); i++)
         {
-            bs::topological_sort(g, std::back_inserter(c));
+            if (t_num_incoming[i] == 0)
+            {
+                t_queue.push_back(m_NeuronGenes[i].ID());
+            }
         }
-        catch (bs::not_a_dag)
+
+        // small genomes scan all links instead of building the index
+        const bool t_use_index = UseIndex();
+        for (unsigned int q = 0; q < t_queue.size(); q++)
         {
-            has_cycles = true;
+            int t_id = t_queue[q];
+            const std::vector<int> *t_out = t_use_index ? &GetOutLinkIndexes(t_id) : NULL;
+            unsigned int t_count = t_use_index ? t_out->size() : NumLinks();
+            for (unsigned int i = 0; i < t_count; i++)
+            {
+                const LinkGene &t_link = m_LinkGenes[t_use_index ? (*t_out)[i] : i];
+                if (t_link.FromNeuronID() != t_id)
+                {
+                    continue;
+                }
+
+                int t_to = GetNeuronIndex(t_link.ToNeuronID());
+                if ((t_to != -1) && (--t_num_incoming[t_to] == 0))
+                {
+                    t_queue.push_back(t_link.ToNeuronID());
+                }
+            }
         }
 
-        return has_cycles;
+        return t_queue.size() < NumNeurons();
     }
 
-    // Returns true if the specified link is present in the genome
-    bool Genome::HasLinkByInnovID(int id) const
+    bool Genome::WouldCreateLoop(int a_FromID, int a_ToID) const
     {
-        ASSERT(id > 0);
+        if (a_FromID == a_ToID)
+        {
+            return true;
+        }
 
-        for (unsigned int i = 0; i < NumLinks(); i++)
+        int t_start = GetNeuronIndex(a_ToID);
+        if (t_start == -1)
+        {
+            return false;
+        }
+
+        // the link closes a loop if a_FromID can already be reached from a_ToID
+        LoopCheckScratch &t_scratch = GetLoopCheckScratch();
+        std::vector<int> &t_visited = t_scratch.m_counts;
+        std::vector<int> &t_stack = t_scratch.m_ids;
+        t_visited.assign(NumNeurons(), 0);
+        t_stack.clear();
+        t_visited[t_start] = 1;
+        t_stack.push_back(a_ToID);
+
+        // small genomes scan all links instead of building the index
+        const bool t_use_index = UseIndex();
+        while (!t_stack.empty())
         {
-            if (m_LinkGenes[i].InnovationID() == id)
+            int t_id = t_stack.back();
+            t_stack.pop_back();
+
+            const std::vector<int> *t_out = t_use_index ? &GetOutLinkIndexes(t_id) : NULL;
+            unsigned int t_count = t_use_index ? t_out->size() : NumLinks();
+            for (unsigned int i = 0; i < t_count; i++)
             {
-                return true;
+                const LinkGene &t_link = m_LinkGenes[t_use_index ? (*t_out)[i] : i];
+                if (t_link.FromNeuronID() != t_id)
+                {
+                    continue;
+                }
+
+                if (t_link.ToNeuronID() == a_FromID)
+                {
+                    return true;
+                }
+
+                int t_to = GetNeuronIndex(t_link.ToNeuronID());
+                if ((t_to != -1) && (!t_visited[t_to]))
+                {
+                    t_visited[t_to] = 1;
+                    t_stack.push_back(t_link.ToNeuronID());
+                }
             }
         }
 
         return false;
     }
 
+    // Returns true if the specified link is present in the genome
+    bool Genome::HasLinkByInnovID(int id) const
+    {
+        ASSERT(id > 0);
+
+        return (NumLinks() > 0) && (GetLinkIndex(id) != -1);
+    }
+
 
     // This builds a fastnetwork structure out from the genome
     void Genome::BuildPhenotype(NeuralNetwork &a_Net)
@@ -794,11 +1124,13 @@ namespace NEAT
             t_c.m_hebb_pre_rate = 0.1;
 
             // if a float trait "hebb_rate" exists
-            if (m_LinkGenes[i].m_Traits.count("hebb_rate") == 1)
+            static const int t_hebb_rate_key = TraitKey("hebb_rate");
+            const Trait *t_hebb_rate = m_LinkGenes[i].m_Traits.Find(t_hebb_rate_key);
+            if (t_hebb_rate != NULL)
             {
                 try
                 {
-                    t_c.m_hebb_rate = boost::get<double>(m_LinkGenes[i].m_Traits["hebb_rate"].value);
+                    t_c.m_hebb_rate = boost::get<double>(t_hebb_rate->value);
                 }
                 catch(std::exception e)
                 {
@@ -806,11 +1138,13 @@ namespace NEAT
                 }
             }
             // if a float trait "hebb_pre_rate" exists
-            if (m_LinkGenes[i].m_Traits.count("hebb_pre_rate") == 1)
+            static const int t_hebb_pre_rate_key = TraitKey("hebb_pre_rate");
+            const Trait *t_hebb_pre_rate = m_LinkGenes[i].m_Traits.Find(t_hebb_pre_rate_key);
+            if (t_hebb_pre_rate != NULL)
             {
                 try
                 {
-                    t_c.m_hebb_pre_rate = boost::get<double>(m_LinkGenes[i].m_Traits["hebb_pre_rate"].value);
+                    t_c.m_hebb_pre_rate = boost::get<double>(t_hebb_pre_rate->value);
                 }
                 catch(std::exception e)
                 {
@@ -840,6 +1174,19 @@ namespace NEAT
     // The procedure uses the [0] CPPN output for creating nodes, and if the substrate is leaky, [1] and [2] for time constants and biases
     // Also assumes the CPPN uses signed activation outputs
     void Genome::BuildHyperNEATPhenotype(NeuralNetwork &net, Substrate &subst)
+    {
+        BuildHyperNEATPhenotype(net, subst, 1);
+    }
+
+    // The same, with the CPPN queries spread over a_NumThreads threads
+    void Genome::BuildHyperNEATPhenotype(NeuralNetwork &net, Substrate &subst, unsigned int a_NumThreads)
+    {
+        ThreadPool t_pool(a_NumThreads);
+        BuildHyperNEATPhenotype(net, subst, t_pool);
+    }
+
+    // The same, on the threads of a_Pool
+    void Genome::BuildHyperNEATPhenotype(NeuralNetwork &net, Substrate &subst, ThreadPool &a_Pool)
     {
         // We need a substrate with at least one input and output
         ASSERT(subst.m_input_coords.size() > 0);
@@ -911,33 +1258,25 @@ namespace NEAT
         BuildPhenotype(t_temp_phenotype);
         t_temp_phenotype.Flush();
 
-        // To ensure network relaxation
+        // To ensure network relaxation in case the CPPN has loops
+        // (a feed-forward CPPN is activated in a single topological pass)
         int dp = 8;
-        if (!HasLoops())
-        {
-            CalculateDepth();
-            dp = GetDepth();
-        }
 
         // now loop over every potential connection in the substrate and take its weight
 
         // For leaky substrates, first loop over the neurons and set their properties
         if (subst.m_leaky)
         {
-            for (unsigned int i = net.NumInputs(); i < net.m_neurons.size(); i++)
+            unsigned int t_first_neuron = net.NumInputs();
+            auto t_fill = [&](unsigned int q, double* t_inputs)
             {
-                // neuron specific stuff
-                t_temp_phenotype.Flush();
-
                 // Inputs for the generation of time consts and biases across
                 // the nodes in the substrate
                 // We input only the position of the first node and ignore the other one
-                std::vector<double> t_inputs;
-                t_inputs.resize(NumInputs());
-
-                for (unsigned int n = 0; n < net.m_neurons[i].m_substrate_coords.size(); n++)
+                const Neuron &t_n = net.m_neurons[t_first_neuron + q];
+                for (unsigned int n = 0; n < t_n.m_substrate_coords.size(); n++)
                 {
-                    t_inputs[n] = net.m_neurons[i].m_substrate_coords[n];
+                    t_inputs[n] = t_n.m_substrate_coords[n];
                 }
 
                 if (subst.m_with_distance)
@@ -952,17 +1291,11 @@ namespace NEAT
                     t_inputs[NumInputs() - 2] = sum;
                 }
                 t_inputs[NumInputs() - 1] = 1.0; // the CPPN's bias
-
-                t_temp_phenotype.Input(t_inputs);
-
-                // activate as many times as deep
-                for (int d = 0; d < dp; d++)
-                {
-                    t_temp_phenotype.Activate();
-                }
-
-                double t_tc = t_temp_phenotype.Output()[NumOutputs() - 2];
-                double t_bias = t_temp_phenotype.Output()[NumOutputs() - 1];
+            };
+            auto t_take = [&](unsigned int q, const double* t_outputs)
+            {
+                double t_tc = t_outputs[NumOutputs() - 2];
+                double t_bias = t_outputs[NumOutputs() - 1];
 
                 Clamp(t_tc, -1, 1);
                 Clamp(t_bias, -1, 1);
@@ -971,13 +1304,14 @@ namespace NEAT
                 Scale(t_tc, -1, 1, subst.m_min_time_const, subst.m_max_time_const);
                 Scale(t_bias, -1, 1, -subst.m_max_weight_and_bias, subst.m_max_weight_and_bias);
 
-                net.m_neurons[i].m_timeconst = t_tc;
-                net.m_neurons[i].m_bias = t_bias;
-            }
+                net.m_neurons[t_first_neuron + q].m_timeconst = t_tc;
+                net.m_neurons[t_first_neuron + q].m_bias = t_bias;
+            };
+            QueryCPPN(t_temp_phenotype, net.m_neurons.size() - t_first_neuron, dp, a_Pool, t_fill, t_take);
         }
 
         // list of src_idx, dst_idx pairs of all connections to query
-        std::vector<std::vector<int> > t_to_query;
+        std::vector<std::pair<int, int> > t_to_query;
 
         // There isn't custom connectiviy scheme?
         if (subst.m_custom_connectivity.size() == 0)
@@ -1026,10 +1360,7 @@ namespace NEAT
                     }
 
                     // Save potential link to query
-                    std::vector<int> t_link;
-                    t_link.push_back(j);
-                    t_link.push_back(i);
-                    t_to_query.push_back(t_link);
+                    t_to_query.push_back(std::make_pair(j, i));
                 }
             }
         }
@@ -1106,24 +1437,17 @@ namespace NEAT
                 }
 
                 // Save potential link to query
-                std::vector<int> t_link;
-                t_link.push_back(j);
-                t_link.push_back(i);
-                t_to_query.push_back(t_link);
+                t_to_query.push_back(std::make_pair(j, i));
             }
         }
 
 
-        // Query and create all links
-        for (unsigned int conn = 0; conn < t_to_query.size(); conn++)
+        // Query all links, keeping the CPPN's link and weight outputs of each
+        std::vector<std::pair<double, double> > t_answers(t_to_query.size());
+        auto t_fill = [&](unsigned int conn, double* t_inputs)
         {
-            int j = t_to_query[conn][0];
-            int i = t_to_query[conn][1];
-
-            // Take the weight of this connection by querying the CPPN
-            // as many times as deep (recurrent or looped CPPNs may be very slow!!!*)
-            std::vector<double> t_inputs;
-            t_inputs.resize(NumInputs());
+            int j = t_to_query[conn].first;
+            int i = t_to_query[conn].second;
 
             int from_dims = net.m_neurons[j].m_substrate_coords.size();
             int to_dims = net.m_neurons[i].m_substrate_coords.size();
@@ -1161,31 +1485,26 @@ namespace NEAT
             }
 
             t_inputs[NumInputs() - 1] = 1.0;
-
-
-            // flush between each query
-            t_temp_phenotype.Flush();
-            t_temp_phenotype.Input(t_inputs);
-
-            // activate as many times as deep
-            for (int d = 0; d < dp; d++)
-            {
-                t_temp_phenotype.Activate();
-            }
-
-            // the output is a weight
-            double t_link = 0;
-            double t_weight = 0;
-
+        };
+        auto t_take = [&](unsigned int conn, const double* t_outputs)
+        {
             if (subst.m_query_weights_only)
             {
-                t_weight = t_temp_phenotype.Output()[0];
+                t_answers[conn] = std::make_pair(0.0, t_outputs[0]);
             }
             else
             {
-                t_link = t_temp_phenotype.Output()[0];
-                t_weight = t_temp_phenotype.Output()[1];
+                t_answers[conn] = std::make_pair(t_outputs[0], t_outputs[1]);
             }
+        };
+        QueryCPPN(t_temp_phenotype, t_to_query.size(), dp, a_Pool, t_fill, t_take);
+
+        // Create the links in the order they were queried
+        for (unsigned int conn = 0; conn < t_to_query.size(); conn++)
+        {
+            // the output is a weight
+            double t_link = t_answers[conn].first;
+            double t_weight = t_answers[conn].second;
 
             if (((t_link > 0) && (!subst.m_query_weights_only)) || (subst.m_query_weights_only))
             {
@@ -1195,8 +1514,8 @@ namespace NEAT
                 // build the connection
                 Connection t_c;
 
-                t_c.m_source_neuron_idx = j;
-                t_c.m_target_neuron_idx = i;
+                t_c.m_source_neuron_idx = t_to_query[conn].first;
+                t_c.m_target_neuron_idx = t_to_query[conn].second;
                 t_c.m_weight = t_weight;
                 t_c.m_recur_flag = false;
 
@@ -1228,15 +1547,33 @@ namespace NEAT
     }
 
 
+    // Returns true if no trait distance can lower the compatibility distance
+    static bool TraitCoeffsNonNegative(const Parameters &a_Parameters)
+    {
+        const std::map<std::string, TraitParameters> *t_traits[] =
+                { &a_Parameters.NeuronTraits, &a_Parameters.LinkTraits, &a_Parameters.GenomeTraits };
+        for (unsigned int i = 0; i < 3; i++)
+        {
+            for (auto it = t_traits[i]->begin(); it != t_traits[i]->end(); it++)
+            {
+                if (it->second.m_ImportanceCoeff < 0)
+                    return false;
+            }
+        }
+        return true;
+    }
+
     // Returns the absolute distance between this genome and a_G
-    double Genome::CompatibilityDistance(Genome &a_G, Parameters &a_Parameters)
+    double Genome::CompatibilityDistance(const Genome &a_G, Parameters &a_Parameters) const
     {
-        // iterators for moving through the genomes' genes
-        std::vector<LinkGene>::iterator t_g1;
-        std::vector<LinkGene>::iterator t_g2;
+        return CompatibilityDistance(a_G, a_Parameters, std::numeric_limits<double>::max());
+    }
 
+    // Same as above, but gives up as soon as the distance is known to be above a_Threshold.
+    // In that case the returned value is only a lower bound, still greater than a_Threshold.
+    double Genome::CompatibilityDistance(const Genome &a_G, Parameters &a_Parameters, double a_Threshold) const
+    {
         // this variable is the total distance between the genomes
-        // if it passes beyond the compatibility treshold, the function returns false
         double t_total_distance = 0.0;
 
         double t_total_weight_difference = 0.0;
@@ -1245,9 +1582,9 @@ namespace NEAT
         double t_total_A_difference = 0.0;
         double t_total_B_difference = 0.0;
         double t_total_num_activation_difference = 0.0;
-        std::map<std::string, double> t_total_neuron_trait_difference;
-        std::map<std::string, double> t_total_link_trait_difference;
-        std::map<std::string, double> t_genome_link_trait_difference;
+        TraitDistances t_total_neuron_trait_difference;
+        TraitDistances t_total_link_trait_difference;
+        TraitDistances t_genome_link_trait_difference;
 
         // count of matching genes
         double t_num_excess = 0;
@@ -1256,138 +1593,148 @@ namespace NEAT
         double t_num_matching_neurons = 0;
     
         // calculate genome trait difference here
-        t_genome_link_trait_difference = m_GenomeGene.GetTraitDistances(a_G.m_GenomeGene.m_Traits);
+        m_GenomeGene.GetTraitDistances(a_G.m_GenomeGene.m_Traits, t_genome_link_trait_difference);
 
         // used for percentage of excess/disjoint genes calculation
         int t_max_genome_size = static_cast<int> (NumLinks()   < a_G.NumLinks())   ? (a_G.NumLinks())   : (NumLinks());
         int t_max_neurons     = static_cast<int> (NumNeurons() < a_G.NumNeurons()) ? (a_G.NumNeurons()) : (NumNeurons());
 
-        t_g1 = m_LinkGenes.begin();
-        t_g2 = a_G.m_LinkGenes.begin();
+        // choose between normalizing for genome size or not
+        double t_normalizer = 1.0;
+        if (a_Parameters.NormalizeGenomeSize)
+        {
+            t_normalizer = static_cast<double>(t_max_genome_size);
+        }
+        if (t_normalizer <= 0.0)
+            t_normalizer = 1.0;
 
-        // Step through the genes until both genomes end
-        while (!((t_g1 == m_LinkGenes.end()) && ((t_g2 == a_G.m_LinkGenes.end()))))
+        // The excess, disjoint and weight terms only grow while stepping through the links,
+        // and there can't be more matching links than genes in the smaller genome.
+        // So they give a lower bound of the distance at any point, as long as no coefficient
+        // (including the traits' importance) is negative.
+        bool t_can_stop = (a_Threshold < std::numeric_limits<double>::max()) &&
+                          (a_Parameters.ExcessCoeff >= 0) && (a_Parameters.DisjointCoeff >= 0) &&
+                          (a_Parameters.WeightDiffCoeff >= 0) &&
+                          (a_Parameters.ActivationADiffCoeff >= 0) && (a_Parameters.ActivationBDiffCoeff >= 0) &&
+                          (a_Parameters.TimeConstantDiffCoeff >= 0) && (a_Parameters.BiasDiffCoeff >= 0) &&
+                          (a_Parameters.ActivationFunctionDiffCoeff >= 0) &&
+                          TraitCoeffsNonNegative(a_Parameters);
+        double t_max_matching_links = static_cast<double>(std::min(NumLinks(), a_G.NumLinks()));
+        if (t_max_matching_links <= 0)
+            t_max_matching_links = 1;
+
+        auto t_lower_bound = [&]() -> double
         {
-            // end of first genome?
-            if (t_g1 == m_LinkGenes.end())
-            {
-                // add to the total distance
-                t_num_excess++;
-                t_g2++;
-            }
-            else if (t_g2 == a_G.m_LinkGenes.end())
-            // end of second genome?
+            return (a_Parameters.ExcessCoeff * (t_num_excess / t_normalizer)) +
+                   (a_Parameters.DisjointCoeff * (t_num_disjoint / t_normalizer)) +
+                   (a_Parameters.WeightDiffCoeff * (t_total_weight_difference / t_max_matching_links));
+        };
+
+        // Merge the two link gene arrays, both are sorted by innovation ID
+        const LinkGene *t_g1 = m_LinkGenes.data();
+        const LinkGene *t_g2 = a_G.m_LinkGenes.data();
+        const LinkGene *t_end1 = t_g1 + m_LinkGenes.size();
+        const LinkGene *t_end2 = t_g2 + a_G.m_LinkGenes.size();
+
+        while ((t_g1 != t_end1) && (t_g2 != t_end2))
+        {
+            // extract the innovation numbers
+            int t_g1innov = t_g1->InnovationID();
+            int t_g2innov = t_g2->InnovationID();
+
+            // matching genes?
+            if (t_g1innov == t_g2innov)
             {
-                // add to the total distance
-                t_num_excess++;
+                t_num_matching_links++;
+
+                double t_wdiff = (t_g1->GetWeight() - t_g2->GetWeight());
+                if (t_wdiff < 0) t_wdiff = -t_wdiff; // make sure it is positive
+                t_total_weight_difference += t_wdiff;
+
+                // calculate link trait difference here and add it to the totals
+                if (!t_g1->m_Traits.empty())
+                {
+                    t_g1->GetTraitDistances(t_g2->m_Traits, t_total_link_trait_difference);
+                }
+
                 t_g1++;
+                t_g2++;
             }
             else
             {
-                // extract the innovation numbers
-                int t_g1innov = t_g1->InnovationID();
-                int t_g2innov = t_g2->InnovationID();
-
-                // matching genes?
-                if (t_g1innov == t_g2innov)
-                {
-                    t_num_matching_links++;
-
-                    double t_wdiff = (t_g1->GetWeight() - t_g2->GetWeight());
-                    if (t_wdiff < 0) t_wdiff = -t_wdiff; // make sure it is positive
-                    t_total_weight_difference += t_wdiff;
-
-                    // calculate link trait difference here
-                    std::map<std::string, double> link_trait_difference = t_g1->GetTraitDistances(t_g2->m_Traits);
-                    // add to the totals
-                    for(auto it = link_trait_difference.begin(); it != link_trait_difference.end(); it++)
-                    {
-                        if (t_total_link_trait_difference.count(it->first) == 0)
-                        {
-                            t_total_link_trait_difference[it->first] = it->second;
-                        }
-                        else
-                        {
-                            t_total_link_trait_difference[it->first] += it->second;
-                        }
-                    }
-
+                // disjoint
+                t_num_disjoint++;
+                if (t_g1innov < t_g2innov)
                     t_g1++;
+                else
                     t_g2++;
-                }
-                else if (t_g1innov < t_g2innov) // disjoint
-                {
-                    t_num_disjoint++;
-                    t_g1++;
-                }
-                else if (t_g1innov > t_g2innov) // disjoint
+
+                if (t_can_stop)
                 {
-                    t_num_disjoint++;
-                    t_g2++;
+                    double t_bound = t_lower_bound();
+                    if (t_bound > a_Threshold)
+                        return t_bound;
                 }
             }
         }
 
+        // whatever is left in either genome is excess
+        t_num_excess += static_cast<double>((t_end1 - t_g1) + (t_end2 - t_g2));
+
+        if (t_can_stop)
+        {
+            double t_bound = t_lower_bound();
+            if (t_bound > a_Threshold)
+                return t_bound;
+        }
+
         // find matching neuron IDs
         for (unsigned int i = 0; i < NumNeurons(); i++)
         {
+            const NeuronGene &t_n1 = m_NeuronGenes[i];
+
             // no inputs considered for comparison
-            if ((m_NeuronGenes[i].Type() != INPUT) && (m_NeuronGenes[i].Type() != BIAS))
+            if ((t_n1.Type() != INPUT) && (t_n1.Type() != BIAS))
             {
                 // a match
-                if (a_G.HasNeuronID(m_NeuronGenes[i].ID()))
+                int t_idx = a_G.GetNeuronIndex(t_n1.ID());
+                if (t_idx != -1)
                 {
+                    const NeuronGene &t_n2 = a_G.m_NeuronGenes[t_idx];
+
                     t_num_matching_neurons++;
 
-                    double t_A_difference = m_NeuronGenes[i].m_A - a_G.GetNeuronByID(m_NeuronGenes[i].ID()).m_A;
+                    double t_A_difference = t_n1.m_A - t_n2.m_A;
                     if (t_A_difference < 0.0f) t_A_difference = -t_A_difference;
                     t_total_A_difference += t_A_difference;
 
-                    double t_B_difference = m_NeuronGenes[i].m_B - a_G.GetNeuronByID(m_NeuronGenes[i].ID()).m_B;
+                    double t_B_difference = t_n1.m_B - t_n2.m_B;
                     if (t_B_difference < 0.0f) t_B_difference = -t_B_difference;
                     t_total_B_difference += t_B_difference;
 
-                    double t_time_constant_difference =
-                            m_NeuronGenes[i].m_TimeConstant - a_G.GetNeuronByID(m_NeuronGenes[i].ID()).m_TimeConstant;
+                    double t_time_constant_difference = t_n1.m_TimeConstant - t_n2.m_TimeConstant;
                     if (t_time_constant_difference < 0.0f) t_time_constant_difference = -t_time_constant_difference;
                     t_total_timeconstant_difference += t_time_constant_difference;
 
-                    double t_bias_difference =
-                            m_NeuronGenes[i].m_Bias - a_G.GetNeuronByID(m_NeuronGenes[i].ID()).m_Bias;
+                    double t_bias_difference = t_n1.m_Bias - t_n2.m_Bias;
                     if (t_bias_difference < 0.0f) t_bias_difference = -t_bias_difference;
                     t_total_bias_difference += t_bias_difference;
 
                     // Activation function type difference is found
-                    if (m_NeuronGenes[i].m_ActFunction != a_G.GetNeuronByID(m_NeuronGenes[i].ID()).m_ActFunction)
+                    if (t_n1.m_ActFunction != t_n2.m_ActFunction)
                     {
                         t_total_num_activation_difference++;
                     }
 
                     // calculate and add node trait difference here
-                    std::map<std::string, double> neuron_trait_difference = m_NeuronGenes[i].GetTraitDistances( a_G.GetNeuronByID(m_NeuronGenes[i].ID()).m_Traits );
-                    // add to the totals
-                    for(auto it = neuron_trait_difference.begin(); it != neuron_trait_difference.end(); it++)
+                    if (!t_n1.m_Traits.empty())
                     {
-                        if (t_total_neuron_trait_difference.count(it->first) == 0)
-                        {
-                            t_total_neuron_trait_difference[it->first] = it->second;
-                        }
-                        else
-                        {
-                            t_total_neuron_trait_difference[it->first] += it->second;
-                        }
+                        t_n1.GetTraitDistances(t_n2.m_Traits, t_total_neuron_trait_difference);
                     }
                 }
             }
         }
 
-        // choose between normalizing for genome size or not
-        double t_normalizer = 1.0;
-        if (a_Parameters.NormalizeGenomeSize)
-        {
-            t_normalizer = static_cast<double>(t_max_genome_size);
-        }
-
         // if there are no matching links, make it 1.0 to avoid divide error
         if (t_num_matching_links <= 0)
             t_num_matching_links = 1;
@@ -1396,9 +1743,6 @@ namespace NEAT
         if (t_num_matching_neurons <= 0)
             t_num_matching_neurons = 1;
 
-        if (t_normalizer <= 0.0)
-            t_normalizer = 1.0;
-
         t_total_distance =
                 (a_Parameters.ExcessCoeff * (t_num_excess / t_normalizer)) +
                 (a_Parameters.DisjointCoeff * (t_num_disjoint / t_normalizer)) +
@@ -1409,42 +1753,149 @@ namespace NEAT
                 (a_Parameters.BiasDiffCoeff * (t_total_bias_difference / t_num_matching_neurons)) +
                 (a_Parameters.ActivationFunctionDiffCoeff * (t_total_num_activation_difference / t_num_matching_neurons));
 
-        // add trait differences according to each one's coeff
-        for(auto it = t_total_link_trait_difference.begin(); it != t_total_link_trait_difference.end(); it++)
+        // add trait differences according to each one's coeff
+        for(auto it = t_total_link_trait_difference.m_Entries.begin(); it != t_total_link_trait_difference.m_Entries.end(); it++)
+        {
+            t_total_distance += (a_Parameters.LinkTraits[*it->name].m_ImportanceCoeff * it->distance) / t_num_matching_links;
+        }
+        for(auto it = t_total_neuron_trait_difference.m_Entries.begin(); it != t_total_neuron_trait_difference.m_Entries.end(); it++)
+        {
+            t_total_distance += (a_Parameters.NeuronTraits[*it->name].m_ImportanceCoeff * it->distance) / t_num_matching_neurons;
+        }
+        for(auto it = t_genome_link_trait_difference.m_Entries.begin(); it != t_genome_link_trait_difference.m_Entries.end(); it++)
+        {
+            t_total_distance += (a_Parameters.GenomeTraits[*it->name].m_ImportanceCoeff * it->distance);
+        }
+
+        return t_total_distance;
+    }
+
+    // Returns true if this genome and a_G are compatible (belong in the same species)
+    bool Genome::IsCompatibleWith(const Genome &a_G, Parameters &a_Parameters) const
+    {
+        // full compatibility cases
+        if (this == &a_G)
+            return true;
+
+        if (GetID() == a_G.GetID())
+            return true;
+
+        if ((NumLinks() == 0) && (a_G.NumLinks() == 0))
+            return true;
+
+        double t_total_distance = CompatibilityDistance(a_G, a_Parameters, a_Parameters.CompatTreshold);
+
+        if (t_total_distance <= a_Parameters.CompatTreshold)
+            return true;  // compatible
+        else
+            return false; // incompatible
+    }
+
+
+    unsigned long long Genome::TopologyHash() const
+    {
+        // the genes are hashed one by one and summed, so their order doesn't matter
+        unsigned long long t_hash = m_LinkGenes.size();
+        for (unsigned int i = 0; i < m_LinkGenes.size(); i++)
+        {
+            unsigned long long x = static_cast<unsigned long long>(m_LinkGenes[i].InnovationID());
+            x += 0x9E3779B97F4A7C15ULL;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            t_hash += x ^ (x >> 31);
+        }
+        return t_hash;
+    }
+
+    double Genome::WeightSum() const
+    {
+        double t_sum = 0.0;
+        for (unsigned int i = 0; i < m_LinkGenes.size(); i++)
+        {
+            t_sum += m_LinkGenes[i].GetWeight();
+        }
+        return t_sum;
+    }
+
+
+    CloneIndex::CloneIndex()
+    {
+        m_Size = 0;
+        m_MaxLinks = 0;
+    }
+
+    void CloneIndex::Clear()
+    {
+        m_Groups.clear();
+        m_Size = 0;
+        m_MaxLinks = 0;
+    }
+
+    void CloneIndex::Add(const Genome &a_Genome, const Ref &a_Ref)
+    {
+        m_Groups[a_Genome.TopologyHash()].insert(std::make_pair(a_Genome.WeightSum(), a_Ref));
+        m_Size++;
+        if (a_Genome.NumLinks() > m_MaxLinks)
+        {
+            m_MaxLinks = a_Genome.NumLinks();
+        }
+    }
+
+    bool CloneIndex::Candidates(const Genome &a_Genome, double a_Delta, const Parameters &a_Parameters,
+                                std::vector<Ref> &a_Refs) const
+    {
+        a_Refs.clear();
+
+        // with a negative coefficient (or trait importance) a big difference may be hidden by another one
+        if ((a_Parameters.ExcessCoeff < 0) || (a_Parameters.DisjointCoeff < 0) ||
+            (a_Parameters.WeightDiffCoeff < 0) ||
+            (a_Parameters.ActivationADiffCoeff < 0) || (a_Parameters.ActivationBDiffCoeff < 0) ||
+            (a_Parameters.TimeConstantDiffCoeff < 0) || (a_Parameters.BiasDiffCoeff < 0) ||
+            (a_Parameters.ActivationFunctionDiffCoeff < 0) ||
+            !TraitCoeffsNonNegative(a_Parameters))
         {
-            t_total_distance += (a_Parameters.LinkTraits[it->first].m_ImportanceCoeff * it->second) / t_num_matching_links;
+            return false;
         }
-        for(auto it = t_total_neuron_trait_difference.begin(); it != t_total_neuron_trait_difference.end(); it++)
+
+        // a single excess or disjoint gene must be enough to tell the genomes apart
+        double t_normalizer = 1.0;
+        if (a_Parameters.NormalizeGenomeSize)
         {
-            t_total_distance += (a_Parameters.NeuronTraits[it->first].m_ImportanceCoeff * it->second) / t_num_matching_neurons;
+            t_normalizer = static_cast<double>(std::max(a_Genome.NumLinks(), m_MaxLinks));
+            if (t_normalizer <= 0.0)
+                t_normalizer = 1.0;
         }
-        for(auto it = t_genome_link_trait_difference.begin(); it != t_genome_link_trait_difference.end(); it++)
+        if (std::min(a_Parameters.ExcessCoeff, a_Parameters.DisjointCoeff) < 2 * a_Delta * t_normalizer)
         {
-            t_total_distance += (a_Parameters.GenomeTraits[it->first].m_ImportanceCoeff * it->second);
+            return false;
         }
 
-        return t_total_distance;
-    }
-
-    // Returns true if this genome and a_G are compatible (belong in the same species)
-    bool Genome::IsCompatibleWith(Genome &a_G, Parameters &a_Parameters)
-    {
-        // full compatibility cases
-        if (this == &a_G)
-            return true;
-
-        if (GetID() == a_G.GetID())
+        std::unordered_map<unsigned long long, std::multimap<double, Ref> >::const_iterator t_group =
+                m_Groups.find(a_Genome.TopologyHash());
+        if (t_group == m_Groups.end())
+        {
             return true;
+        }
 
-        if ((NumLinks() == 0) && (a_G.NumLinks() == 0))
-            return true;
+        std::multimap<double, Ref>::const_iterator t_first = t_group->second.begin();
+        std::multimap<double, Ref>::const_iterator t_last = t_group->second.end();
+        if (a_Parameters.WeightDiffCoeff > 0)
+        {
+            // the same links on both sides, so all of them match
+            double t_links = (a_Genome.NumLinks() > 0) ? static_cast<double>(a_Genome.NumLinks()) : 1.0;
+            double t_sum = a_Genome.WeightSum();
+            // twice the exact radius plus some room for rounding errors
+            double t_radius = 2 * a_Delta * t_links / a_Parameters.WeightDiffCoeff + 1e-9 * (1.0 + fabs(t_sum));
+            t_first = t_group->second.lower_bound(t_sum - t_radius);
+            t_last = t_group->second.upper_bound(t_sum + t_radius);
+        }
 
-        double t_total_distance = CompatibilityDistance(a_G, a_Parameters);
+        for (; t_first != t_last; t_first++)
+        {
+            a_Refs.push_back(t_first->second);
+        }
 
-        if (t_total_distance <= a_Parameters.CompatTreshold)
-            return true;  // compatible
-        else
-            return false; // incompatible
+        return true;
     }
 
 
@@ -1573,6 +2024,7 @@ namespace NEAT
             {
                 // found it! now erase..
                 m_LinkGenes.erase(t_iter);
+                InvalidateIndex();
                 break;
             }
         }
@@ -1881,6 +2333,9 @@ namespace NEAT
                         (m_NeuronGenes[t_n1idx].Type() == OUTPUT) // consider connections out of outputs recurrent
                         ||
                         (t_n1idx == t_n2idx) // make sure they differ
+                        ||
+                        ((!a_Parameters.AllowLoops) &&
+                         WouldCreateLoop(m_NeuronGenes[t_n1idx].ID(), m_NeuronGenes[t_n2idx].ID())) // closes a loop?
                         );
 
                 // it found a good pair of neurons
@@ -1997,6 +2452,7 @@ namespace NEAT
             {
                 // found it - erase & quit
                 t_curlink = m_LinkGenes.erase(t_curlink);
+                InvalidateIndex();
                 break;
             }
 
@@ -2038,6 +2494,7 @@ namespace NEAT
             {
                 // found it, erase and quit
                 m_NeuronGenes.erase(t_curneuron);
+                InvalidateIndex();
                 break;
             }
 
@@ -2053,24 +2510,53 @@ namespace NEAT
         bool t_no_outgoing = true;
 
         // search the links and prove both are wrong
-        for (unsigned int i = 0; i < NumLinks(); i++)
+        if (!UseIndex())
         {
-            // there is a link going to this neuron, so there are incoming
-            // don't count the link if it is recurrent or coming from a bias
-            if ((m_LinkGenes[i].ToNeuronID() == a_ID)
-                && (!m_LinkGenes[i].IsLoopedRecurrent())
-                && (GetNeuronByID(m_LinkGenes[i].FromNeuronID()).Type() != BIAS))
+            for (unsigned int i = 0; i < NumLinks(); i++)
+            {
+                // there is a link going to this neuron, so there are incoming
+                // don't count the link if it is recurrent or coming from a bias
+                if ((m_LinkGenes[i].ToNeuronID() == a_ID)
+                    && (!m_LinkGenes[i].IsLoopedRecurrent())
+                    && (GetNeuronByID(m_LinkGenes[i].FromNeuronID()).Type() != BIAS))
+                {
+                    t_no_incoming = false;
+                }
+
+                // there is a link going from this neuron, so there are outgoing
+                // don't count the link if it is recurrent or coming from a bias
+                if ((m_LinkGenes[i].FromNeuronID() == a_ID)
+                    && (!m_LinkGenes[i].IsLoopedRecurrent())
+                    && (GetNeuronByID(m_LinkGenes[i].FromNeuronID()).Type() != BIAS))
+                {
+                    t_no_outgoing = false;
+                }
+            }
+
+            return t_no_incoming || t_no_outgoing;
+        }
+
+        const std::vector<int> &t_in = GetInLinkIndexes(a_ID);
+        for (unsigned int i = 0; i < t_in.size(); i++)
+        {
+            const LinkGene &t_link = m_LinkGenes[t_in[i]];
+            if ((!t_link.IsLoopedRecurrent())
+                && (GetNeuronByID(t_link.FromNeuronID()).Type() != BIAS))
             {
                 t_no_incoming = false;
+                break;
             }
+        }
 
-            // there is a link going from this neuron, so there are outgoing
-            // don't count the link if it is recurrent or coming from a bias
-            if ((m_LinkGenes[i].FromNeuronID() == a_ID)
-                && (!m_LinkGenes[i].IsLoopedRecurrent())
-                && (GetNeuronByID(m_LinkGenes[i].FromNeuronID()).Type() != BIAS))
+        const std::vector<int> &t_out = GetOutLinkIndexes(a_ID);
+        for (unsigned int i = 0; i < t_out.size(); i++)
+        {
+            const LinkGene &t_link = m_LinkGenes[t_out[i]];
+            if ((!t_link.IsLoopedRecurrent())
+                && (GetNeuronByID(t_link.FromNeuronID()).Type() != BIAS))
             {
                 t_no_outgoing = false;
+                break;
             }
         }
 
@@ -2209,6 +2695,11 @@ namespace NEAT
     // Returns the count of links inputting from the specified neuron ID
     int Genome::LinksInputtingFrom(int a_ID) const
     {
+        if (UseIndex())
+        {
+            return static_cast<int>(GetOutLinkIndexes(a_ID).size());
+        }
+
         int t_counter = 0;
         for (unsigned int i = 0; i < NumLinks(); i++)
         {
@@ -2223,6 +2714,11 @@ namespace NEAT
     // Returns the count of links outputting to the specified neuron ID
     int Genome::LinksOutputtingTo(int a_ID) const
     {
+        if (UseIndex())
+        {
+            return static_cast<int>(GetInLinkIndexes(a_ID).size());
+        }
+
         int t_counter = 0;
         for (unsigned int i = 0; i < NumLinks(); i++)
         {
@@ -2572,7 +3068,7 @@ namespace NEAT
     // This is multipoint mating - genes inherited randomly
     // Disjoint and excess genes are inherited from the fittest parent
     // If fitness is equal, the smaller genome is assumed to be the better one
-    Genome Genome::Mate(Genome &a_Dad, bool a_MateAverage, bool a_InterSpecies, RNG &a_RNG, Parameters &a_Parameters)
+    Genome Genome::Mate(const Genome &a_Dad, bool a_MateAverage, bool a_InterSpecies, RNG &a_RNG, Parameters &a_Parameters) const
     {
         // Cannot mate with itself
         if (GetID() == a_Dad.GetID())
@@ -2592,8 +3088,8 @@ namespace NEAT
 
         // create iterators so we can step through each parents genes and set
         // them to the first gene of each parent
-        std::vector<LinkGene>::iterator t_curMom = m_LinkGenes.begin();
-        std::vector<LinkGene>::iterator t_curDad = a_Dad.m_LinkGenes.begin();
+        std::vector<LinkGene>::const_iterator t_curMom = m_LinkGenes.begin();
+        std::vector<LinkGene>::const_iterator t_curDad = a_Dad.m_LinkGenes.begin();
 
         // this will hold a copy of the gene we wish to add at each step
         LinkGene t_selectedgene(0, 0, -1, 0, false);
@@ -3018,82 +3514,100 @@ namespace NEAT
     {
         std::sort(m_NeuronGenes.begin(), m_NeuronGenes.end(), neuron_compare);
         std::sort(m_LinkGenes.begin(), m_LinkGenes.end(), link_compare);
+        InvalidateIndex();
     }
 
-    unsigned int Genome::NeuronDepth(int a_NeuronID, unsigned int a_Depth)
+    bool Genome::CalculateDepth()
     {
-        unsigned int t_current_depth;
-        unsigned int t_max_depth = a_Depth;
-
-        if (a_Depth > 16384)
+        // The quick case - if no hidden neurons,
+        // the depth is 1
+        if (NumNeurons() == (m_NumInputs + m_NumOutputs))
         {
-            // oops! a possible loop in the network!
-            std::cout << std::endl << " ERROR! Trying to get the depth of a looped network!" << std::endl;
-            return 16384;
+            m_Depth = 1;
+            return true;
         }
 
-        // Base case
-        if ((GetNeuronByID(a_NeuronID).Type() == INPUT) || (GetNeuronByID(a_NeuronID).Type() == BIAS))
+        // the cached result is cleared when the index picks up new genes
+        Index();
+        GeneIndex &t_index = *m_Index.load(std::memory_order_acquire);
+        if (t_index.m_HasDepth)
         {
-            return a_Depth;
+            m_Depth = t_index.m_Depth;
+            return t_index.m_DepthAcyclic;
         }
 
-        // Find all links outputting to this neuron ID
-        std::vector<int> t_inputting_links_idx;
+        // Longest paths by Kahn's algorithm. Links into inputs and biases are ignored,
+        // so a neuron's depth is 0 if nothing feeds it.
+        std::vector<unsigned int> t_depth(NumNeurons(), 0);
+        std::vector<int> t_num_incoming(NumNeurons(), 0);
         for (unsigned int i = 0; i < NumLinks(); i++)
         {
-            if (m_LinkGenes[i].ToNeuronID() == a_NeuronID)
-                t_inputting_links_idx.push_back(i);
+            int t_to = GetNeuronIndex(m_LinkGenes[i].ToNeuronID());
+            if ((t_to != -1) && (m_NeuronGenes[t_to].Type() != INPUT) && (m_NeuronGenes[t_to].Type() != BIAS)
+                && HasNeuronID(m_LinkGenes[i].FromNeuronID()))
+            {
+                t_num_incoming[t_to]++;
+            }
         }
 
-        // For all incoming links..
-        for (unsigned int i = 0; i < t_inputting_links_idx.size(); i++)
+        std::vector<int> t_queue;
+        t_queue.reserve(NumNeurons());
+        for (unsigned int i = 0; i < NumNeurons(); i++)
         {
-            LinkGene t_link = GetLinkByIndex(t_inputting_links_idx[i]);
-
-            // RECURSION
-            t_current_depth = NeuronDepth(t_link.FromNeuronID(), a_Depth + 1);
-            if (t_current_depth > t_max_depth)
-                t_max_depth = t_current_depth;
+            if (t_num_incoming[i] == 0)
+            {
+                t_queue.push_back(i);
+            }
         }
 
-        return t_max_depth;
-    }
-
-
-    void Genome::CalculateDepth()
-    {
-        unsigned int t_max_depth = 0;
-        unsigned int t_cur_depth = 0;
-
-        // The quick case - if no hidden neurons,
-        // the depth is 1
-        if (NumNeurons() == (m_NumInputs + m_NumOutputs))
+        for (unsigned int q = 0; q < t_queue.size(); q++)
         {
-            m_Depth = 1;
-            return;
+            int t_from = t_queue[q];
+            const std::vector<int> &t_out = GetOutLinkIndexes(m_NeuronGenes[t_from].ID());
+            for (unsigned int i = 0; i < t_out.size(); i++)
+            {
+                int t_to = GetNeuronIndex(m_LinkGenes[t_out[i]].ToNeuronID());
+                if ((t_to == -1) || (m_NeuronGenes[t_to].Type() == INPUT) || (m_NeuronGenes[t_to].Type() == BIAS))
+                {
+                    continue;
+                }
+
+                t_depth[t_to] = std::max(t_depth[t_to], t_depth[t_from] + 1);
+                if (--t_num_incoming[t_to] == 0)
+                {
+                    t_queue.push_back(t_to);
+                }
+            }
         }
 
-        // make a list of all output IDs
-        std::vector<int> t_output_ids;
+        // neurons that were never queued are in a loop or fed by one
+        unsigned int t_max_depth = 0;
+        bool t_acyclic = true;
         for (unsigned int i = 0; i < NumNeurons(); i++)
         {
             if (m_NeuronGenes[i].Type() == OUTPUT)
             {
-                t_output_ids.push_back(m_NeuronGenes[i].ID());
+                if (t_num_incoming[i] > 0)
+                {
+                    t_acyclic = false;
+                }
+                t_max_depth = std::max(t_max_depth, t_depth[i]);
             }
         }
 
-        // For each output
-        for (unsigned int i = 0; i < t_output_ids.size(); i++)
+        if (!t_acyclic)
         {
-            t_cur_depth = NeuronDepth(t_output_ids[i], 0);
-
-            if (t_cur_depth > t_max_depth)
-                t_max_depth = t_cur_depth;
+            // no path through the network is longer than this
+            t_max_depth = NumNeurons();
         }
 
         m_Depth = t_max_depth;
+
+        t_index.m_Depth = t_max_depth;
+        t_index.m_DepthAcyclic = t_acyclic;
+        t_index.m_HasDepth = true;
+
+        return t_acyclic;
     }
 
 
@@ -3243,72 +3757,33 @@ namespace NEAT
         fprintf(a_file, "GenomeEnd\n\n");
     }
     
-    void Genome::PrintTraits(std::map< std::string, Trait>& traits)
+    void Genome::PrintTraits(TraitMap& traits)
     {
         for(auto t = traits.begin(); t != traits.end(); t++)
         {
-            bool doit = false;
-            std::string s = t->second.dep_key;
-            //std::string sv = bs::get<std::string>(t->second.dep_values);
-            if (s != "")
-            {
-                // there is such trait..
-                if (traits.count(s) != 0)
-                {
-                    /*int a; double b; std::string c;
-                    if ((*it).m_Traits[s].value.type() == typeid(int))
-                        a = bs::get<int>((*it).m_Traits[s].value);
-                    if ((*it).m_Traits[s].value.type() == typeid(double))
-                        b = bs::get<double>((*it).m_Traits[s].value);
-                    if ((*it).m_Traits[s].value.type() == typeid(std::string))
-                        c = bs::get<std::string>((*it).m_Traits[s].value);
-
-                    int a1; double b1; std::string c1;
-                    if ((t->second.dep_values).type() == typeid(int))
-                        a1 = bs::get<int>((t->second.dep_values));
-                    if ((t->second.dep_values).type() == typeid(double))
-                        b1 = bs::get<double>((t->second.dep_values));
-                    if ((t->second.dep_values).type() == typeid(std::string))
-                        c1 = bs::get<std::string>((t->second.dep_values));*/
-                
-                    // and it has the right value?
-                    for(int ix=0; ix<t->second.dep_values.size(); ix++)
-                    {
-                        if (traits[s].value == (t->second.dep_values[ix]))
-                        {
-                            doit = true;
-                            break;
-                        }
-                    }
-                }
-            }
-            else
-            {
-                doit = true;
-            }
-        
-            if (doit)
+            // skip the trait if the trait it depends on hasn't the right value
+            if (traits.IsEnabled(t->trait))
             {
-                std::cout << t->first << " - ";
-                if (t->second.value.type() == typeid(int))
+                std::cout << *t->name << " - ";
+                if (t->trait.value.type() == typeid(int))
                 {
-                    std::cout << bs::get<int>(t->second.value);
+                    std::cout << bs::get<int>(t->trait.value);
                 }
-                if (t->second.value.type() == typeid(double))
+                if (t->trait.value.type() == typeid(double))
                 {
-                    std::cout << bs::get<double>(t->second.value);
+                    std::cout << bs::get<double>(t->trait.value);
                 }
-                if (t->second.value.type() == typeid(std::string))
+                if (t->trait.value.type() == typeid(std::string))
                 {
-                    std::cout << "\"" << bs::get<std::string>(t->second.value) << "\"";
+                    std::cout << "\"" << bs::get<std::string>(t->trait.value) << "\"";
                 }
-                if (t->second.value.type() == typeid(intsetelement))
+                if (t->trait.value.type() == typeid(intsetelement))
                 {
-                    std::cout << (bs::get<intsetelement>(t->second.value)).value;
+                    std::cout << (bs::get<intsetelement>(t->trait.value)).value;
                 }
-                if (t->second.value.type() == typeid(floatsetelement))
+                if (t->trait.value.type() == typeid(floatsetelement))
                 {
-                    std::cout << (bs::get<floatsetelement>(t->second.value)).value;
+                    std::cout << (bs::get<floatsetelement>(t->trait.value)).value;
                 }
             
                 std::cout << ", ";
@@ -3355,12 +3830,151 @@ namespace NEAT
     // For more info on the algorithm check: http://eplex.cs.ucf.edu/ESHyperNEAT/
     ///////////////////////////////////////////
 
+    // The hidden nodes found by ES-HyperNEAT, numbered in the order they were found.
+    // The points of the quadtree have 3 coordinates, so they are looked up by a fixed size key
+    // made of the bits of the coordinates (with -0 taken as 0, as in comparing the doubles).
+    class SubstrateNodeRegistry
+    {
+        struct Key
+        {
+            unsigned long long m_Bits[3];
+
+            bool operator==(const Key &a_Other) const
+            {
+                return (m_Bits[0] == a_Other.m_Bits[0]) &&
+                       (m_Bits[1] == a_Other.m_Bits[1]) &&
+                       (m_Bits[2] == a_Other.m_Bits[2]);
+            }
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key &a_Key) const
+            {
+                unsigned long long h = a_Key.m_Bits[0];
+                h = (h ^ (h >> 31)) * 0x9E3779B97F4A7C15ULL + a_Key.m_Bits[1];
+                h = (h ^ (h >> 31)) * 0x9E3779B97F4A7C15ULL + a_Key.m_Bits[2];
+                return (size_t) (h ^ (h >> 29));
+            }
+        };
+
+        std::unordered_map<Key, int, KeyHash> m_Index;
+        std::vector<std::vector<double> > m_Coords;
+
+        static Key MakeKey(const std::vector<double> &a_Coords)
+        {
+            ASSERT(a_Coords.size() == 3);
+            Key t_key;
+            for (unsigned int i = 0; i < 3; i++)
+            {
+                double t_c = (a_Coords[i] == 0) ? 0.0 : a_Coords[i];
+                memcpy(&t_key.m_Bits[i], &t_c, sizeof(double));
+            }
+            return t_key;
+        }
+
+    public:
+        // Returns the node's number, or -1 if it wasn't found yet
+        int Find(const std::vector<double> &a_Coords) const
+        {
+            std::unordered_map<Key, int, KeyHash>::const_iterator t_it = m_Index.find(MakeKey(a_Coords));
+            return (t_it == m_Index.end()) ? -1 : t_it->second;
+        }
+
+        // Returns the node's number, adding it if it wasn't found yet
+        int Insert(const std::vector<double> &a_Coords)
+        {
+            std::pair<std::unordered_map<Key, int, KeyHash>::iterator, bool> t_res =
+                    m_Index.insert(std::make_pair(MakeKey(a_Coords), (int) m_Coords.size()));
+            if (t_res.second)
+            {
+                m_Coords.push_back(a_Coords);
+            }
+            return t_res.first->second;
+        }
+
+        unsigned int Size() const
+        {
+            return m_Coords.size();
+        }
+
+        const std::vector<double> &Coords(int a_Node) const
+        {
+            return m_Coords[a_Node];
+        }
+    };
+
+    // Runs the quadtree searches of ES-HyperNEAT (DivideInitialize and PruneExpress) for many nodes,
+    // on the threads of a pool. Each thread has its own quadtree and copy of the CPPN and takes
+    // the next node when it is done with one. The results go to the node's place, so they don't
+    // depend on the number of threads.
+    class ESHyperNEATSearch
+    {
+        Genome &m_Genome;
+        Parameters &m_Parameters;
+        ThreadPool &m_Pool;
+        std::vector<NeuralNetwork> m_CPPNs;
+        std::vector<Genome::QuadTree> m_Trees;
+
+    public:
+        ESHyperNEATSearch(Genome &a_Genome, NeuralNetwork &a_CPPN, Parameters &a_Parameters, ThreadPool &a_Pool)
+                : m_Genome(a_Genome), m_Parameters(a_Parameters), m_Pool(a_Pool)
+        {
+            unsigned int t_num_threads = a_Pool.NumThreads();
+
+            // compile before copying, so the copies don't have to
+            a_CPPN.IsFeedForward();
+            m_CPPNs.assign(t_num_threads, a_CPPN);
+            m_Trees.resize(t_num_threads);
+        }
+
+        // Finds the connections of every node in a_Nodes, a_Connections[i] gets those of a_Nodes[i]
+        void Run(const std::vector<std::vector<double> > &a_Nodes, bool a_Outgoing,
+                 std::vector<std::vector<Genome::TempConnection> > &a_Connections)
+        {
+            a_Connections.clear();
+            a_Connections.resize(a_Nodes.size());
+
+            Genome::QuadPoint t_root(m_Parameters.Qtree_X, m_Parameters.Qtree_Y,
+                                     m_Parameters.Width, m_Parameters.Height, 1);
+            std::atomic<unsigned int> t_next(0);
+            auto t_task = [&](unsigned int a_thread)
+            {
+                for (unsigned int n = t_next++; n < a_Nodes.size(); n = t_next++)
+                {
+                    m_Trees[a_thread].Reset(t_root);
+                    m_Genome.DivideInitialize(a_Nodes[n], m_Trees[a_thread], m_CPPNs[a_thread], m_Parameters,
+                                              a_Outgoing, 0.0);
+                    m_Genome.PruneExpress(a_Nodes[n], m_Trees[a_thread], m_CPPNs[a_thread], m_Parameters,
+                                          a_Connections[n], a_Outgoing);
+                }
+            };
+
+            unsigned int t_num_tasks = std::min((unsigned int) m_CPPNs.size(), (unsigned int) a_Nodes.size());
+            if (t_num_tasks <= 1)
+            {
+                t_task(0);
+            }
+            else
+            {
+                m_Pool.ParallelFor(t_num_tasks, t_task);
+            }
+        }
+    };
+
     /* Given an empty net, a substrate and parameters constructs a phenotype.
     You can use any subsstrate, but the hidden nodes in it will not be used for the generation.
     Relies on the Divide Initialize, PruneExpress and CleanNet methods.
     */
 
     void Genome::BuildESHyperNEATPhenotype(NeuralNetwork &net, Substrate &subst, Parameters &params)
+    {
+        ThreadPool t_pool(params.NumThreads);
+        BuildESHyperNEATPhenotype(net, subst, params, t_pool);
+    }
+
+    // The same, on the threads of a_Pool instead of params.NumThreads threads
+    void Genome::BuildESHyperNEATPhenotype(NeuralNetwork &net, Substrate &subst, Parameters &params, ThreadPool &a_Pool)
     {
         ASSERT(subst.m_input_coords.size() > 0);
         ASSERT(subst.m_output_coords.size() > 0);
@@ -3370,44 +3984,26 @@ namespace NEAT
         unsigned int hidden_index = input_count + output_count;
         unsigned int source_index = 0;
         unsigned int target_index = 0;
-        unsigned int hidden_counter = 0;
-        unsigned int maxNodes = std::pow(4, params.MaxDepth);
-
-        std::vector<TempConnection> TempConnections;
-        TempConnections.reserve(maxNodes + 1);
-
-        std::vector<double> point;
-        point.reserve(3);
+        // The connections found from/to each node of a phase. The nodes of a phase are searched
+        // in parallel, then their connections are added in order, as if searched one by one.
+        std::vector<std::vector<TempConnection> > t_found;
+        std::vector<std::vector<double> > t_nodes;
 
-        boost::shared_ptr<QuadPoint> root;
+        SubstrateNodeRegistry hidden_nodes;
 
-        boost::unordered_map<std::vector<double>, int> hidden_nodes;
-        hidden_nodes.reserve(maxNodes);
-
-        boost::unordered_map<std::vector<double>, int> temp;
-        temp.reserve(maxNodes);
-
-        boost::unordered_map<std::vector<double>, int> unexplored_nodes;
-        unexplored_nodes.reserve(maxNodes);
-
-        net.m_neurons.reserve(maxNodes);
-        net.m_connections.reserve((maxNodes * (maxNodes - 1)) / 2);
         net.SetInputOutputDimentions(static_cast<unsigned short>(input_count),
                                      static_cast<unsigned short>(output_count));
 
 
         NeuralNetwork t_temp_phenotype(true);
         BuildPhenotype(t_temp_phenotype);
+        ESHyperNEATSearch t_search(*this, t_temp_phenotype, params, a_Pool);
 
         // Find Inputs to Hidden connections.
+        t_search.Run(subst.m_input_coords, true, t_found);
         for (unsigned int i = 0; i < input_count; i++)
         {
-            // Get the Quadtree and express the connections in it for this input
-            root = boost::shared_ptr<QuadPoint>(
-                    new QuadPoint(params.Qtree_X, params.Qtree_Y, params.Width, params.Height, 1));
-            DivideInitialize(subst.m_input_coords[i], root, t_temp_phenotype, params, true, 0.0);
-            TempConnections.clear();
-            PruneExpress(subst.m_input_coords[i], root, t_temp_phenotype, params, TempConnections, true);
+            std::vector<TempConnection> &TempConnections = t_found[i];
 
             for (unsigned int j = 0; j < TempConnections.size(); j++)
             {
@@ -3416,16 +4012,7 @@ namespace NEAT
                     continue;
 
                 // Find the hidden node in the hidden nodes. If it is not there add it.
-                if (hidden_nodes.find(TempConnections[j].target) == hidden_nodes.end())
-                {
-                    target_index = hidden_counter++;
-                    hidden_nodes.insert(std::make_pair(TempConnections[j].target, target_index));
-                }
-                    // Add connection
-                else
-                {
-                    target_index = hidden_nodes.find(TempConnections[j].target)->second;
-                }
+                target_index = hidden_nodes.Insert(TempConnections[j].target);
 
                 Connection tc;
                 tc.m_source_neuron_idx = i;
@@ -3439,18 +4026,28 @@ namespace NEAT
         }
         // Hidden to hidden.
         // Basically the same procedure as above repeated IterationLevel times (see the params)
-        unexplored_nodes = hidden_nodes;
+        // The nodes to explore, in the order they were found
+        std::vector<int> unexplored_nodes;
+        for (unsigned int n = 0; n < hidden_nodes.Size(); n++)
+        {
+            unexplored_nodes.push_back(n);
+        }
+        std::vector<bool> t_in_temp; // the nodes to explore next time
         for (unsigned int i = 0; i < params.IterationLevel; i++)
         {
-            boost::unordered_map<std::vector<double>, int>::iterator itr_hid;
-            for (itr_hid = unexplored_nodes.begin(); itr_hid != unexplored_nodes.end(); itr_hid++)
+            std::vector<bool> t_unexplored(hidden_nodes.Size(), false);
+            t_nodes.clear();
+            for (unsigned int u = 0; u < unexplored_nodes.size(); u++)
+            {
+                t_unexplored[unexplored_nodes[u]] = true;
+                t_nodes.push_back(hidden_nodes.Coords(unexplored_nodes[u]));
+            }
+            t_search.Run(t_nodes, true, t_found);
+
+            for (unsigned int u = 0; u < unexplored_nodes.size(); u++)
             {
-                root = boost::shared_ptr<QuadPoint>(
-                        new QuadPoint(params.Qtree_X, params.Qtree_Y, params.Width, params.Height, 1));
-                DivideInitialize(itr_hid->first, root, t_temp_phenotype, params, true, 0.0);
-                TempConnections.clear();
-                PruneExpress(itr_hid->first, root, t_temp_phenotype, params, TempConnections, true);
-                //root.reset();
+                int t_node = unexplored_nodes[u];
+                std::vector<TempConnection> &TempConnections = t_found[u];
 
                 for (unsigned int k = 0; k < TempConnections.size(); k++)
                 {
@@ -3458,18 +4055,11 @@ namespace NEAT
                         0.2/*subst.m_link_threshold*/) // TODO: fix this
                         continue;
 
-                    if (hidden_nodes.find(TempConnections[k].target) == hidden_nodes.end())
-                    {
-                        target_index = hidden_counter++;
-                        hidden_nodes.insert(std::make_pair(TempConnections[k].target, target_index));
-                    }
-                    else // TODO: This can be skipped if building a feed forwad network.
-                    {
-                        target_index = hidden_nodes.find(TempConnections[k].target)->second;
-                    }
+                    // TODO: The lookup can be skipped if building a feed forwad network.
+                    target_index = hidden_nodes.Insert(TempConnections[k].target);
 
                     Connection tc;
-                    tc.m_source_neuron_idx = itr_hid->second + hidden_index;  // NO!!!
+                    tc.m_source_neuron_idx = t_node + hidden_index;
                     tc.m_target_neuron_idx = target_index + hidden_index;
                     tc.m_weight = TempConnections[k].weight * subst.m_max_weight_and_bias;
                     tc.m_recur_flag = false;
@@ -3479,26 +4069,29 @@ namespace NEAT
                 }
             }
             // Now get the newly discovered hidden nodes
-            boost::unordered_map<std::vector<double>, int>::iterator itr1;
-            for (itr1 = hidden_nodes.begin(); itr1 != hidden_nodes.end(); itr1++)
+            // (the ones explored before the last round stay in, as they always did)
+            t_in_temp.resize(hidden_nodes.Size(), false);
+            t_unexplored.resize(hidden_nodes.Size(), false);
+            unexplored_nodes.clear();
+            for (unsigned int n = 0; n < hidden_nodes.Size(); n++)
             {
-                if (unexplored_nodes.find(itr1->first) == unexplored_nodes.end())
+                if (!t_unexplored[n])
+                {
+                    t_in_temp[n] = true;
+                }
+                if (t_in_temp[n])
                 {
-                    temp.insert(std::make_pair(itr1->first, itr1->second));
+                    unexplored_nodes.push_back(n);
                 }
             }
-            unexplored_nodes = temp;
         }
 
         // Finally Output to Hidden. Note that unlike before, here we connect the outputs to
         // existing hidden nodes and no new nodes are added.
+        t_search.Run(subst.m_output_coords, false, t_found);
         for (unsigned int i = 0; i < output_count; i++)
         {
-            root = boost::shared_ptr<QuadPoint>(
-                    new QuadPoint(params.Qtree_X, params.Qtree_Y, params.Width, params.Height, 1));
-            DivideInitialize(subst.m_output_coords[i], root, t_temp_phenotype, params, false, 0.0);
-            TempConnections.clear();
-            PruneExpress(subst.m_output_coords[i], root, t_temp_phenotype, params, TempConnections, false);
+            std::vector<TempConnection> &TempConnections = t_found[i];
 
             for (unsigned int j = 0; j < TempConnections.size(); j++)
             {
@@ -3507,9 +4100,10 @@ namespace NEAT
                     0.2 /*subst.m_link_threshold*/) // TODO: fix this
                     continue;
 
-                if (hidden_nodes.find(TempConnections[j].source) != hidden_nodes.end())
+                int t_source = hidden_nodes.Find(TempConnections[j].source);
+                if (t_source != -1)
                 {
-                    source_index = hidden_nodes.find(TempConnections[j].source)->second;
+                    source_index = t_source;
 
                     Connection tc;
                     tc.m_source_neuron_idx = source_index + hidden_index;
@@ -3523,6 +4117,7 @@ namespace NEAT
             }
         }
         // Add the neurons.Input first, followed by bias, output and hidden. In this order.
+        net.m_neurons.reserve(input_count + output_count + hidden_nodes.Size());
 
         for (unsigned int i = 0; i < input_count - 1; i++)
         {
@@ -3554,13 +4149,13 @@ namespace NEAT
             net.m_neurons.push_back(t_n);
         }
 
-        boost::unordered_map<std::vector<double>, int>::iterator itr;
-        for (itr = hidden_nodes.begin(); itr != hidden_nodes.end(); itr++)
+        // The hidden nodes in the order they were numbered, so the connections lead to their coordinates
+        for (unsigned int h = 0; h < hidden_nodes.Size(); h++)
         {
             Neuron t_n;
             t_n.m_a = 1;
             t_n.m_b = 0;
-            t_n.m_substrate_coords = itr->first;
+            t_n.m_substrate_coords = hidden_nodes.Coords(h);
 
             ASSERT(t_n.m_substrate_coords.size() > 0); // prevent 0D points
             t_n.m_activation_function_type = subst.m_hidden_nodes_activation;
@@ -3569,67 +4164,83 @@ namespace NEAT
         }
 
         // Clean the generated network from dangling connections and we're good to go.
-        Clean_Net(net.m_connections, input_count, output_count, hidden_nodes.size());
+        Clean_Net(net.m_connections, input_count, output_count, hidden_nodes.Size());
+    }
+
+    // Appends a row of a_num_inputs CPPN inputs to a_rows, made of a_row cut or
+    // padded with 0s to fit, as NeuralNetwork::Input() would take it after a Flush()
+    static void AppendCPPNRow(std::vector<double> &a_rows, const std::vector<double> &a_row, unsigned int a_num_inputs)
+    {
+        unsigned int t_len = std::min((unsigned int) a_row.size(), a_num_inputs);
+        a_rows.insert(a_rows.end(), a_row.begin(), a_row.begin() + t_len);
+        a_rows.resize(a_rows.size() + (a_num_inputs - t_len), 0.0);
     }
 
     // Used to determine the placement of hidden neurons in the Evolvable Substrate.
     void Genome::DivideInitialize(const std::vector<double> &node,
-                                  boost::shared_ptr<QuadPoint> &root,
+                                  QuadTree &tree,
                                   NeuralNetwork &cppn,
                                   Parameters &params,
                                   const bool &outgoing,
                                   const double &z_coord)
     {   // Have to check if this actually does something useful here
         //CalculateDepth();
-        int cppn_depth = 8;//GetDepth();
+        int cppn_depth = 8; // relaxation passes, used only if the CPPN has loops
 
-        std::vector<double> t_inputs;
+        std::vector<double> &t_inputs = tree.row;
+        unsigned int t_num_inputs = cppn.NumInputs();
+        unsigned int t_num_outputs = cppn.NumOutputs();
 
         // Standard Tree stuff. Create children, check their output with the CPPN
         // and if they have higher variance add them to their parent. Repeat with the children
         // until maxDepth has been reached or if the variance isn't high enough.
-        boost::shared_ptr<QuadPoint> p;
-
-        std::queue<boost::shared_ptr<QuadPoint> > q;
-        q.push(root);
-        while (!q.empty())
+        // The points to divide are taken a level at a time, in the order of a breadth-first search.
+        tree.queue.clear();
+        tree.queue.push_back(0);
+        unsigned int t_level_start = 0;
+        while (t_level_start < tree.queue.size())
         {
-            p = q.front();
+            unsigned int t_level_end = tree.queue.size();
+            unsigned int t_first_child = tree.points.size();
+
             // Add children
-            p->children.push_back(boost::shared_ptr<QuadPoint>(
-                    new QuadPoint(p->x - p->width / 2, p->y - p->height / 2, p->width / 2, p->height / 2,
-                                  p->level + 1)));
-            p->children.push_back(boost::shared_ptr<QuadPoint>(
-                    new QuadPoint(p->x - p->width / 2, p->y + p->height / 2, p->width / 2, p->height / 2,
-                                  p->level + 1)));
-            p->children.push_back(boost::shared_ptr<QuadPoint>(
-                    new QuadPoint(p->x + p->width / 2, p->y + p->height / 2, p->width / 2, p->height / 2,
-                                  p->level + 1)));
-            p->children.push_back(boost::shared_ptr<QuadPoint>(
-                    new QuadPoint(p->x + p->width / 2, p->y - p->height / 2, p->width / 2, p->height / 2,
-                                  p->level + 1)));
-
-            for (unsigned int i = 0; i < p->children.size(); i++)
+            for (unsigned int k = t_level_start; k < t_level_end; k++)
             {
+                QuadPoint p = tree.points[tree.queue[k]];
+                tree.points[tree.queue[k]].children = tree.points.size();
+                tree.points.push_back(QuadPoint(p.x - p.width / 2, p.y - p.height / 2, p.width / 2, p.height / 2,
+                                                p.level + 1));
+                tree.points.push_back(QuadPoint(p.x - p.width / 2, p.y + p.height / 2, p.width / 2, p.height / 2,
+                                                p.level + 1));
+                tree.points.push_back(QuadPoint(p.x + p.width / 2, p.y + p.height / 2, p.width / 2, p.height / 2,
+                                                p.level + 1));
+                tree.points.push_back(QuadPoint(p.x + p.width / 2, p.y - p.height / 2, p.width / 2, p.height / 2,
+                                                p.level + 1));
+            }
+
+            // Query the CPPN for all of them at once
+            tree.inputs.clear();
+            for (unsigned int c = t_first_child; c < tree.points.size(); c++)
+            {
+                const QuadPoint &t_child = tree.points[c];
                 t_inputs.clear();
-                t_inputs.reserve(cppn.NumInputs());
 
                 if (outgoing)
                 {
                     // node goes here
                     t_inputs = node;
 
-                    t_inputs.push_back(p->children[i]->x);
-                    t_inputs.push_back(p->children[i]->y);
-                    t_inputs.push_back(p->children[i]->z);
+                    t_inputs.push_back(t_child.x);
+                    t_inputs.push_back(t_child.y);
+                    t_inputs.push_back(t_child.z);
                 }
 
                 else
                 {
                     // QuadPoint goes first
-                    t_inputs.push_back(p->children[i]->x);
-                    t_inputs.push_back(p->children[i]->y);
-                    t_inputs.push_back(p->children[i]->z);
+                    t_inputs.push_back(t_child.x);
+                    t_inputs.push_back(t_child.y);
+                    t_inputs.push_back(t_child.z);
 
                     t_inputs.push_back(node[0]);
                     t_inputs.push_back(node[1]);
@@ -3639,32 +4250,36 @@ namespace NEAT
                 // Bias
                 t_inputs[t_inputs.size() - 1] = (params.CPPN_Bias);
 
-                cppn.Flush();
-                cppn.Input(t_inputs);
+                AppendCPPNRow(tree.inputs, t_inputs, t_num_inputs);
+            }
+
+            unsigned int t_num_children = tree.points.size() - t_first_child;
+            cppn.ActivateBatch(tree.inputs, t_num_children, tree.outputs, cppn_depth);
 
-                for (int d = 0; d < cppn_depth; d++)
-                {
-                    cppn.Activate();
-                }
-                p->children[i]->weight = cppn.Output()[0];
+            for (unsigned int c = 0; c < t_num_children; c++)
+            {
+                QuadPoint &t_child = tree.points[t_first_child + c];
+                t_child.weight = tree.outputs[c * t_num_outputs];
                 if (params.Leo)
                 {
-                    p->children[i]->leo = cppn.Output()[cppn.Output().size() - 1];
+                    t_child.leo = tree.outputs[c * t_num_outputs + t_num_outputs - 1];
                 }
-                cppn.Flush();
-
             }
 
-            if ((p->level < params.InitialDepth) ||
-                ((p->level < params.MaxDepth) && Variance(p) > params.DivisionThreshold))
+            // The children of the points that vary enough are divided next
+            for (unsigned int k = t_level_start; k < t_level_end; k++)
             {
-                for (unsigned int i = 0; i < 4; i++)
+                int t_point = tree.queue[k];
+                if ((tree.points[t_point].level < params.InitialDepth) ||
+                    ((tree.points[t_point].level < params.MaxDepth) && Variance(tree, t_point) > params.DivisionThreshold))
                 {
-                    q.push(p->children[i]);
+                    for (unsigned int i = 0; i < 4; i++)
+                    {
+                        tree.queue.push_back(tree.points[t_point].children + i);
+                    }
                 }
             }
-            q.pop();
-
+            t_level_start = t_level_end;
         }
 
         return;
@@ -3673,178 +4288,175 @@ namespace NEAT
     // We take the tree generated above and see which connections can be expressed on the basis of Variance threshold,
     // Band threshold and LEO.
     void Genome::PruneExpress(const std::vector<double> &node,
-                              boost::shared_ptr<QuadPoint> &root,
+                              QuadTree &tree,
                               NeuralNetwork &cppn,
                               Parameters &params,
                               std::vector<Genome::TempConnection> &connections,
                               const bool &outgoing)
     {
-        if (root->children[0] == NULL)
+        //CalculateDepth();
+        int cppn_depth = 8; // relaxation passes, used only if the CPPN has loops
+
+        tree.band.clear();
+        FindBandPoints(tree, 0, params);
+        if (tree.band.empty())
         {
             return;
         }
 
-        else
+        // Query the CPPN at the left, right, top and bottom neighbours of all the points at once.
+        // The neighbours are a parent's width away.
+        std::vector<double> &inputs = tree.row;
+        unsigned int t_num_inputs = cppn.NumInputs();
+        unsigned int t_num_outputs = cppn.NumOutputs();
+        tree.inputs.clear();
+        for (unsigned int b = 0; b < tree.band.size(); b++)
         {
-            for (unsigned int i = 0; i < 4; i++)
-            {
-                if (Variance(root->children[i]) > params.VarianceThreshold)
-                {
-                    PruneExpress(node, root->children[i], cppn, params, connections, outgoing);
-                }
-
-                    // Band Pruning phase.
-                    // If LEO is turned off this should always happen.
-                    // If it is not it should only happen if the LEO output is greater than a specified threshold
-                else if (!params.Leo || (params.Leo && root->children[i]->leo > params.LeoThreshold))
-                {
-                    //CalculateDepth();
-                    int cppn_depth = 8;//GetDepth();
+            const QuadPoint &t_point = tree.points[tree.band[b].first];
+            double t_width = tree.points[tree.band[b].second].width;
 
-                    double d_left, d_right, d_top, d_bottom;
-                    std::vector<double> inputs;
+            int root_index = 0;
+            inputs.clear();
 
-                    int root_index = 0;
-
-                    if (outgoing)
-                    {
-                        inputs = node;
-                        inputs.push_back(root->children[i]->x);
-                        inputs.push_back(root->children[i]->y);
-                        inputs.push_back(root->children[i]->z);
-
-                        root_index = node.size();
-                    }
-
-                    else
-                    {
-                        inputs.push_back(root->children[i]->x);
-                        inputs.push_back(root->children[i]->y);
-                        inputs.push_back(root->children[i]->z);
-                        inputs.push_back(node[0]);
-                        inputs.push_back(node[1]);
-                        inputs.push_back(node[2]);
-                    }
+            if (outgoing)
+            {
+                inputs = node;
+                inputs.push_back(t_point.x);
+                inputs.push_back(t_point.y);
+                inputs.push_back(t_point.z);
 
-                    // Left
-                    inputs.push_back(params.CPPN_Bias);
-                    inputs[root_index] -= root->width;
+                root_index = node.size();
+            }
 
-                    cppn.Input(inputs);
+            else
+            {
+                inputs.push_back(t_point.x);
+                inputs.push_back(t_point.y);
+                inputs.push_back(t_point.z);
+                inputs.push_back(node[0]);
+                inputs.push_back(node[1]);
+                inputs.push_back(node[2]);
+            }
+            inputs.push_back(params.CPPN_Bias);
 
-                    for (int d = 0; d < cppn_depth; d++)
-                    {
-                        cppn.Activate();
-                    }
+            // Left
+            inputs[root_index] -= t_width;
+            AppendCPPNRow(tree.inputs, inputs, t_num_inputs);
 
-                    d_left = Abs(root->children[i]->weight - cppn.Output()[0]);
-                    cppn.Flush();
+            // Right
+            inputs[root_index] += 2 * t_width;
+            AppendCPPNRow(tree.inputs, inputs, t_num_inputs);
 
-                    // Right
-                    inputs[root_index] += 2 * (root->width);
-                    cppn.Input(inputs);
+            // Top
+            inputs[root_index] -= t_width;
+            inputs[root_index + 1] -= t_width;
+            AppendCPPNRow(tree.inputs, inputs, t_num_inputs);
 
-                    for (int d = 0; d < cppn_depth; d++)
-                    {
-                        cppn.Activate();
-                    }
+            // Bottom
+            inputs[root_index + 1] += 2 * t_width;
+            AppendCPPNRow(tree.inputs, inputs, t_num_inputs);
+        }
 
-                    d_right = Abs(root->children[i]->weight - cppn.Output()[0]);
-                    cppn.Flush();
+        cppn.ActivateBatch(tree.inputs, tree.band.size() * 4, tree.outputs, cppn_depth);
 
-                    // Top
-                    inputs[root_index] -= root->width;
-                    inputs[root_index + 1] -= root->width;
-                    cppn.Input(inputs);
+        for (unsigned int b = 0; b < tree.band.size(); b++)
+        {
+            const QuadPoint &t_point = tree.points[tree.band[b].first];
+            const double *t_out = &tree.outputs[b * 4 * t_num_outputs];
 
-                    for (int d = 0; d < cppn_depth; d++)
-                    {
-                        cppn.Activate();
-                    }
+            double d_left = Abs(t_point.weight - t_out[0]);
+            double d_right = Abs(t_point.weight - t_out[t_num_outputs]);
+            double d_top = Abs(t_point.weight - t_out[2 * t_num_outputs]);
+            double d_bottom = Abs(t_point.weight - t_out[3 * t_num_outputs]);
 
-                    d_top = Abs(root->children[i]->weight - cppn.Output()[0]);
-                    cppn.Flush();
-                    // Bottom
-                    inputs[root_index + 1] += 2 * root->width;
-                    cppn.Input(inputs);
+            if (std::max(std::min(d_top, d_bottom), std::min(d_left, d_right)) > params.BandThreshold)
+            {
+                Genome::TempConnection tc;
+                //Yeah its ugly
+                if (outgoing)
+                {
+                    tc.source = node;
 
-                    for (int d = 0; d < cppn_depth; d++)
-                    {
-                        cppn.Activate();
-                    }
+                    tc.target.push_back(t_point.x);
+                    tc.target.push_back(t_point.y);
+                    tc.target.push_back(t_point.z);
+                }
+                else
+                {
+                    tc.source.push_back(t_point.x);
+                    tc.source.push_back(t_point.y);
+                    tc.source.push_back(t_point.z);
 
-                    d_bottom = Abs(root->children[i]->weight - cppn.Output()[0]);
-                    cppn.Flush();
+                    tc.target = node;
+                }
+                // Normalize
+                // TODO: Put in Parameters
+                tc.weight = t_point.weight;
+                connections.push_back(tc);
+            }
+        }
+        return;
+    }
 
-                    if (std::max(std::min(d_top, d_bottom), std::min(d_left, d_right)) > params.BandThreshold)
-                    {
-                        Genome::TempConnection tc;
-                        //Yeah its ugly
-                        if (outgoing)
-                        {
-                            tc.source = node;
+    void Genome::FindBandPoints(QuadTree &tree, int point, Parameters &params)
+    {
+        int t_children = tree.points[point].children;
+        if (t_children == -1)
+        {
+            return;
+        }
 
-                            tc.target.push_back(root->children[i]->x);
-                            tc.target.push_back(root->children[i]->y);
-                            tc.target.push_back(root->children[i]->z);
-                        }
-                        else
-                        {
-                            tc.source.push_back(root->children[i]->x);
-                            tc.source.push_back(root->children[i]->y);
-                            tc.source.push_back(root->children[i]->z);
+        for (int c = t_children; c < t_children + 4; c++)
+        {
+            if (Variance(tree, c) > params.VarianceThreshold)
+            {
+                FindBandPoints(tree, c, params);
+            }
 
-                            tc.target = node;
-                        }
-                        // Normalize
-                        // TODO: Put in Parameters
-                        tc.weight = root->children[i]->weight;
-                        connections.push_back(tc);
-                    }
-                }
+                // Band Pruning phase.
+                // If LEO is turned off this should always happen.
+                // If it is not it should only happen if the LEO output is greater than a specified threshold
+            else if (!params.Leo || (params.Leo && tree.points[c].leo > params.LeoThreshold))
+            {
+                tree.band.push_back(std::make_pair(c, point));
             }
         }
-        return;
     }
 
     // Calculates the variance of a given Quadpoint.
     // Maybe an alternative solution would be to add this in the Quadpoint const.
-    double Genome::Variance(boost::shared_ptr<QuadPoint> &point)
+    double Genome::Variance(QuadTree &tree, int point)
     {
-        if (point->children.size() == 0)
+        int t_children = tree.points[point].children;
+        if (t_children == -1)
         {
             return 0.0;
         }
 
         boost::accumulators::accumulator_set<double, boost::accumulators::stats<boost::accumulators::tag::variance> > acc;
-        for (unsigned int i = 0; i < 4; i++)
+        for (int c = t_children; c < t_children + 4; c++)
         {
-            acc(point->children[i]->weight);
+            acc(tree.points[c].weight);
         }
 
         return boost::accumulators::variance(acc);
     }
 
     // Helper method for Variance
-    void Genome::CollectValues(std::vector<double> &vals, boost::shared_ptr<QuadPoint> &point)
+    void Genome::CollectValues(std::vector<double> &vals, QuadTree &tree, int point)
     {
-        //In theory we shouldn't get here at all.
-        if (point == NULL)
-        {
-            return;
-        }
-
-        if (point->children.size() > 0)
+        int t_children = tree.points[point].children;
+        if (t_children != -1)
         {
-            for (unsigned int i = 0; i < 4; i++)
+            for (int c = t_children; c < t_children + 4; c++)
             {
-                CollectValues(vals, point->children[i]);
+                CollectValues(vals, tree, c);
             }
         }
 
         else
-        {   // Here, Apparently it treats the point a if it is not initialized
-            vals.push_back(point->weight);
+        {
+            vals.push_back(tree.points[point].weight);
         }
     }
 
@@ -42,12 +42,13 @@
 
 #include <boost/shared_ptr.hpp>
 
-#include <boost/graph/graph_traits.hpp>
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/topological_sort.hpp>
 
 #include <vector>
+#include <map>
 #include <queue>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
 
 #include "NeuralNetwork.h"
 #include "Substrate.h"
@@ -67,6 +68,8 @@ namespace NEAT
     // forward
     class Innovation;
     
+    class ThreadPool;
+    
     class InnovationDatabase;
     
     class PhenotypeBehavior;
@@ -75,9 +78,6 @@ namespace NEAT
     
     namespace bs = boost;
     
-    typedef bs::adjacency_list <bs::vecS, bs::vecS, bs::directedS> Graph;
-    typedef bs::graph_traits<Graph>::vertex_descriptor Vertex;
-    
     class Genome
     {
         /////////////////////
@@ -104,6 +104,37 @@ namespace NEAT
         // how many individuals this genome should spawn
         double m_OffspringAmount;
         
+        // Lookup tables over the genes, allocated the first time they are needed.
+        // They are extended when genes are appended and dropped by InvalidateIndex();
+        // a copy of the genome starts without them.
+        struct GeneIndex
+        {
+            std::unordered_map<int, int> m_Neurons; // neuron ID -> index in m_NeuronGenes
+            std::unordered_map<int, int> m_Links;   // innovation ID -> index in m_LinkGenes
+            std::unordered_map<unsigned long long, int> m_Ends; // (from, to) -> index of the link
+            std::unordered_map<int, std::vector<int> > m_Out;   // neuron ID -> indexes of its outgoing links
+            std::unordered_map<int, std::vector<int> > m_In;    // neuron ID -> indexes of its incoming links
+            
+            // how many genes are indexed
+            std::atomic<unsigned int> m_NumNeurons, m_NumLinks;
+            // the index may be brought up to date from const methods of a shared genome
+            std::mutex m_Mutex;
+            
+            // the last result of CalculateDepth(), cleared when genes are indexed
+            bool m_HasDepth;
+            unsigned int m_Depth;
+            bool m_DepthAcyclic;
+            
+            GeneIndex() : m_NumNeurons(0), m_NumLinks(0), m_HasDepth(false), m_Depth(0), m_DepthAcyclic(true) {}
+        };
+        mutable std::atomic<GeneIndex*> m_Index{NULL};
+        
+        // returns the index after indexing any genes appended since it was last used
+        const GeneIndex& Index() const;
+        void UpdateIndex(GeneIndex &a_Index) const;
+        // small genomes are searched linearly, which is faster than building the index
+        bool UseIndex() const { return (m_NeuronGenes.size() + m_LinkGenes.size()) >= 64; }
+        
         ////////////////////
         // Private methods
         
@@ -129,9 +160,6 @@ namespace NEAT
         // Returns the count of links outputting to the specified neuron ID
         int LinksOutputtingTo(int a_id) const;
         
-        // A recursive function returning the max depth from the specified neuron to the inputs
-        unsigned int NeuronDepth(int a_NeuronID, unsigned int a_Depth);
-        
         // Returns true is the specified neuron ID is a dead end or isolated
         bool IsDeadEndNeuron(int a_id) const;
     
@@ -172,6 +200,12 @@ namespace NEAT
         // assignment operator
         Genome &operator=(const Genome &a_g);
         
+        // move constructor and assignment, take over the genes without copying them
+        Genome(Genome &&a_g) noexcept;
+        Genome &operator=(Genome &&a_g) noexcept;
+        
+        ~Genome();
+        
         // comparison operator (nessesary for boost::python)
         // todo: implement a better comparison technique
         bool operator==(Genome const &other) const
@@ -230,6 +264,21 @@ namespace NEAT
         // A little helper function to find the index of a link, given its innovation ID
         int GetLinkIndex(int a_innovid) const;
         
+        // The indexes in m_LinkGenes of the links coming into / going out of a neuron
+        const std::vector<int>& GetInLinkIndexes(int a_id) const;
+        const std::vector<int>& GetOutLinkIndexes(int a_id) const;
+        
+        // Must be called after genes in m_NeuronGenes or m_LinkGenes were removed, reordered
+        // or had their IDs changed from outside the Genome's methods (appending is fine)
+        void InvalidateIndex();
+        
+        // replace all neuron/link genes, dropping the index
+        void SetNeuronGenes(const std::vector<NeuronGene>& a_Genes)
+        { m_NeuronGenes = a_Genes; InvalidateIndex(); }
+        
+        void SetLinkGenes(const std::vector<LinkGene>& a_Genes)
+        { m_LinkGenes = a_Genes; InvalidateIndex(); }
+        
         unsigned int NumNeurons() const
         { return static_cast<unsigned int>(m_NeuronGenes.size()); }
         
@@ -268,7 +317,10 @@ namespace NEAT
         bool HasDeadEnds() const;
         
         // Returns true if there is any looping path in the network
-        bool HasLoops();
+        bool HasLoops() const;
+        
+        // Returns true if a link from a_FromID to a_ToID would close a looping path
+        bool WouldCreateLoop(int a_FromID, int a_ToID) const;
         
         bool FailsConstraints(const Parameters &a_Parameters)
         {
@@ -279,7 +331,7 @@ namespace NEAT
                 return true; // no reason to continue
             }
             
-            if ((HasLoops() && (a_Parameters.AllowLoops == false)))
+            if ((a_Parameters.AllowLoops == false) && HasLoops())
             {
                 return true;
             }
@@ -319,62 +371,47 @@ namespace NEAT
         // Like CPPN/HyperNEAT stuff
         ////////////
         void BuildHyperNEATPhenotype(NeuralNetwork &net, Substrate &subst);
+        // The CPPN queries are evaluated in blocks on a_NumThreads threads (0 means one per
+        // hardware thread), the resulting network is the same for any number of threads.
+        void BuildHyperNEATPhenotype(NeuralNetwork &net, Substrate &subst, unsigned int a_NumThreads);
+        // The same on the threads of a_Pool. Pass the same pool when building many phenotypes,
+        // so its threads are not started for each one.
+        void BuildHyperNEATPhenotype(NeuralNetwork &net, Substrate &subst, ThreadPool &a_Pool);
 
 #ifdef USE_BOOST_PYTHON
     
-        py::dict TraitMap2Dict(std::map< std::string, Trait>& tmap)
+        py::dict TraitMap2Dict(TraitMap& tmap)
         {
             py::dict traits;
             for(auto tit=tmap.begin(); tit!=tmap.end(); tit++)
             {
-                bool doit = false;
-                if (tit->second.dep_key != "")
+                // skip the trait if the trait it depends on hasn't the right value
+                if (tmap.IsEnabled(tit->trait))
                 {
-                    // there is such trait..
-                    if (tmap.count(tit->second.dep_key) != 0)
-                    {
-                        // and it has the right value?
-                        for(int ix=0; ix < tit->second.dep_values.size(); ix++)
-                        {
-                            if (tmap[tit->second.dep_key].value == tit->second.dep_values[ix])
-                            {
-                                doit = true;
-                                break;
-                            }
-                        }
-                    }
-                }
-                else
-                {
-                    doit = true;
-                }
-        
-                if (doit)
-                {
-                    TraitType t = tit->second.value;
+                    TraitType t = tit->trait.value;
                     if (t.type() == typeid(int))
                     {
-                        traits[tit->first] = bs::get<int>(t);
+                        traits[*tit->name] = bs::get<int>(t);
                     }
                     if (t.type() == typeid(double))
                     {
-                        traits[tit->first] = bs::get<double>(t);
+                        traits[*tit->name] = bs::get<double>(t);
                     }
                     if (t.type() == typeid(std::string))
                     {
-                        traits[tit->first] = bs::get<std::string>(t);
+                        traits[*tit->name] = bs::get<std::string>(t);
                     }
                     if (t.type() == typeid(intsetelement))
                     {
-                        traits[tit->first] = (bs::get<intsetelement>(t)).value;
+                        traits[*tit->name] = (bs::get<intsetelement>(t)).value;
                     }
                     if (t.type() == typeid(floatsetelement))
                     {
-                        traits[tit->first] = (bs::get<floatsetelement>(t)).value;
+                        traits[*tit->name] = (bs::get<floatsetelement>(t)).value;
                     }
                     if (t.type() == typeid(py::object))
                     {
-                        traits[tit->first] = bs::get<py::object>(t);
+                        traits[*tit->name] = bs::get<py::object>(t);
                     }
                 }
             }
@@ -446,7 +483,7 @@ namespace NEAT
         // Saves this genome to an already opened file for writing
         void Save(FILE *a_fstream);
         
-        void PrintTraits(std::map< std::string, Trait>& traits);
+        void PrintTraits(TraitMap& traits);
         void PrintAllTraits();
         
         // returns the max neuron ID
@@ -466,13 +503,27 @@ namespace NEAT
         }
         
         // Returns true if this genome and a_G are compatible (belong in the same species)
-        bool IsCompatibleWith(Genome &a_G, Parameters &a_Parameters);
+        // a_G is only read, so it may be shared between threads
+        bool IsCompatibleWith(const Genome &a_G, Parameters &a_Parameters) const;
         
         // returns the absolute compatibility distance between this genome and a_G
-        double CompatibilityDistance(Genome &a_G, Parameters &a_Parameters);
+        double CompatibilityDistance(const Genome &a_G, Parameters &a_Parameters) const;
+        
+        // same, but may stop early once the distance is known to be greater than a_Threshold
+        // and then returns a lower bound that is still greater than a_Threshold
+        double CompatibilityDistance(const Genome &a_G, Parameters &a_Parameters, double a_Threshold) const;
+        
+        // A hash of the set of link innovation IDs, it doesn't depend on the order of the genes.
+        // Genomes with different sets have excess or disjoint genes between them.
+        unsigned long long TopologyHash() const;
         
-        // Calculates the network depth
-        void CalculateDepth();
+        // The sum of all link weights
+        double WeightSum() const;
+        
+        // Calculates the network depth - the longest path from an input or bias to an output.
+        // Returns false if an output is fed through a loop, the depth is then the number of neurons.
+        // The result is reused until the genes change.
+        bool CalculateDepth();
         
         ////////////
         // Mutation
@@ -538,7 +589,7 @@ namespace NEAT
         // If the a_averagemating bool is true, then the genes are averaged
         // Disjoint and excess genes are inherited from the fittest parent
         // If fitness is equal, the smaller genome is assumed to be the better one
-        Genome Mate(Genome &a_dad, bool a_averagemating, bool a_interspecies, RNG &a_RNG, Parameters &a_Parameters);
+        Genome Mate(const Genome &a_dad, bool a_averagemating, bool a_interspecies, RNG &a_RNG, Parameters &a_Parameters) const;
         
         
         //////////
@@ -614,14 +665,14 @@ namespace NEAT
             // Do I use this?
             double leo;
             
-            
-            std::vector<boost::shared_ptr<QuadPoint> > children;
+            // Index of the first of its 4 children in the QuadTree, -1 if it has none
+            int children;
             
             QuadPoint()
             {
                 x = y = z = width = height = weight = variance = leo = 0;
                 level = 0;
-                children.reserve(4);
+                children = -1;
             }
             
             QuadPoint(double t_x, double t_y, double t_width, double t_height, int t_level)
@@ -635,8 +686,7 @@ namespace NEAT
                 weight = 0.0;
                 leo = 0.0;
                 variance = 0.0;
-                children.reserve(4);
-                children.clear();
+                children = -1;
             }
             
             // Mind the Z
@@ -652,30 +702,57 @@ namespace NEAT
                 weight = 0.0;
                 variance = 0.0;
                 leo = 0.0;
-                children.reserve(4);
-                children.clear();
+                children = -1;
             }
+        };
+        
+        // A quadtree kept in one array, level by level, with the root first.
+        // The 4 children of a point are next to each other.
+        // Reuse it for every tree, so it stops allocating once it has grown.
+        struct QuadTree
+        {
+            std::vector<QuadPoint> points;
+            
+            // Working space: the points to divide, the points to band prune
+            // with their parents, and the CPPN queries
+            std::vector<int> queue;
+            std::vector<std::pair<int, int> > band;
+            std::vector<double> row;
+            std::vector<double> inputs;
+            std::vector<double> outputs;
             
-            ~QuadPoint()
+            // Starts a new tree with only the root
+            void Reset(const QuadPoint &root)
             {
-            };
+                points.clear();
+                points.push_back(root);
+            }
         };
         
+        // The quadtree searches of each phase run on params.NumThreads threads,
+        // the resulting network is the same for any number of threads.
         void BuildESHyperNEATPhenotype(NeuralNetwork &a_net, Substrate &subst, Parameters &params);
+        // The same on the threads of a_Pool (params.NumThreads is ignored), see BuildHyperNEATPhenotype()
+        void BuildESHyperNEATPhenotype(NeuralNetwork &a_net, Substrate &subst, Parameters &params, ThreadPool &a_Pool);
         
+        // Divides the tree (which must hold only its root) where the CPPN output varies,
+        // querying the CPPN once for all the new points of a level.
         void DivideInitialize(const std::vector<double> &node,
-                              boost::shared_ptr<QuadPoint> &root,
+                              QuadTree &tree,
                               NeuralNetwork &cppn, Parameters &params,
                               const bool &outgoing, const double &z_coord);
         
         void PruneExpress(const std::vector<double> &node,
-                          boost::shared_ptr<QuadPoint> &root, NeuralNetwork &cppn,
+                          QuadTree &tree, NeuralNetwork &cppn,
                           Parameters &params, std::vector<Genome::TempConnection> &connections,
                           const bool &outgoing);
         
-        void CollectValues(std::vector<double> &vals, boost::shared_ptr<QuadPoint> &point);
+        // Adds to tree.band, in depth-first order, the points below a_point that are left to band pruning
+        void FindBandPoints(QuadTree &tree, int point, Parameters &params);
+        
+        void CollectValues(std::vector<double> &vals, QuadTree &tree, int point);
         
-        double Variance(boost::shared_ptr<QuadPoint> &point);
+        double Variance(QuadTree &tree, int point);
         
         void Clean_Net(std::vector<Connection> &connections, unsigned int input_count,
                        unsigned int output_count, unsigned int hidden_count);
@@ -690,6 +767,7 @@ namespace NEAT
             ar & m_ID;
             ar & m_NeuronGenes;
             ar & m_LinkGenes;
+            InvalidateIndex(); // in case the genes were loaded
             ar & m_NumInputs;
             ar & m_NumOutputs;
             ar & m_Fitness;
@@ -730,6 +808,37 @@ namespace NEAT
 
 #endif
 
+    // Finds the genomes that may be clones of a genome without comparing it to all of them.
+    // The genomes are grouped by topology and sorted by the sum of their weights.
+    // A genome can only be closer than a small delta to the ones with the same topology
+    // (any excess or disjoint gene adds at least ExcessCoeff or DisjointCoeff over the genome size)
+    // and a weight sum near its own (the weight term is at least WeightDiffCoeff * |sum1 - sum2| / links).
+    // Each genome is known by a pair of indexes, their meaning is up to the user.
+    class CloneIndex
+    {
+    public:
+        typedef std::pair<int, int> Ref;
+
+        CloneIndex();
+
+        void Clear();
+
+        void Add(const Genome &a_Genome, const Ref &a_Ref);
+
+        unsigned int Size() const { return m_Size; }
+
+        // Puts in a_Refs the genomes that may be closer than a_Delta to a_Genome.
+        // Returns false if nothing can be ruled out with these parameters,
+        // then all genomes have to be checked.
+        bool Candidates(const Genome &a_Genome, double a_Delta, const Parameters &a_Parameters,
+                        std::vector<Ref> &a_Refs) const;
+
+    private:
+        std::unordered_map<unsigned long long, std::multimap<double, Ref> > m_Groups;
+        unsigned int m_Size;
+        unsigned int m_MaxLinks;
+    };
+
 #define DBG(x) { std::cerr << x << "\n"; }
     
     
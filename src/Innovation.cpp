@@ -30,6 +30,7 @@
 
 #include <fstream>
 #include <string>
+#include <map>
 
 #include "Innovation.h"
 #include "Genes.h"
@@ -45,6 +46,7 @@ InnovationDatabase::InnovationDatabase()
 {
     m_NextInnovationNum = 1; // innovations start at 1
     m_NextNeuronID = 1;      // neuron IDs start at 1
+    m_Base = NULL;
     m_Innovations.clear();
 }
 
@@ -55,6 +57,7 @@ InnovationDatabase::InnovationDatabase(int a_LastInnovationNum, int a_LastNeuron
 
     m_NextInnovationNum = a_LastInnovationNum;
     m_NextNeuronID = a_LastNeuronID;
+    m_Base = NULL;
     m_Innovations.clear();
 }
 
@@ -67,17 +70,20 @@ void InnovationDatabase::Init(int a_LastInnovationNum, int a_LastNeuronID)
 
     m_NextNeuronID = a_LastNeuronID;
     m_NextInnovationNum = a_LastInnovationNum;
+    m_Base = NULL;
 }
 
 // Initializes a database from a given genome
 void InnovationDatabase::Init(const Genome& a_Genome)
 {
+    m_Base = NULL;
     m_Innovations.clear();
     for(unsigned int i=0; i<a_Genome.NumLinks(); i++)
     {
         Innovation t_innov( a_Genome.GetLinkByIndex(i).InnovationID(), NEW_LINK, a_Genome.GetLinkByIndex(i).FromNeuronID(), a_Genome.GetLinkByIndex(i).ToNeuronID(), NONE, -1);
         m_Innovations.push_back(t_innov);
     }
+    RebuildIndex();
 
     m_NextNeuronID = a_Genome.GetLastNeuronID();
     m_NextInnovationNum = a_Genome.GetLastInnovationID();
@@ -89,6 +95,7 @@ void InnovationDatabase::Init(std::ifstream& a_DataFile)
     m_Innovations.clear();
     m_NextInnovationNum = 0;
     m_NextNeuronID = 0;
+    m_Base = NULL;
 
     std::string t_str;
 
@@ -128,6 +135,8 @@ void InnovationDatabase::Init(std::ifstream& a_DataFile)
 
     }
     while( t_str != "InnovationDatabaseEnd");
+
+    RebuildIndex();
 }
 
 
@@ -157,16 +166,22 @@ int InnovationDatabase::CheckInnovation(int a_In, int a_Out, InnovationType a_Ty
     ASSERT((a_In > 0) && (a_Out > 0));
     ASSERT((a_Type == NEW_NEURON) || (a_Type == NEW_LINK));
 
-    // search the list for a match
-    for(unsigned int i=0; i < m_Innovations.size(); i++)
+    if (m_Base != NULL)
     {
-        if ((m_Innovations[i].FromNeuronID() == a_In) && (m_Innovations[i].ToNeuronID() == a_Out) && (m_Innovations[i].InnovType() == a_Type))
+        int t_ID = m_Base->CheckInnovation(a_In, a_Out, a_Type);
+        if (t_ID != -1)
         {
-            // match found?
-            return m_Innovations[i].ID();
+            return t_ID;
         }
     }
 
+    // the first match
+    const std::vector<int>* t_idxs = FindIndexed(a_In, a_Out, a_Type);
+    if (t_idxs != NULL)
+    {
+        return m_Innovations[t_idxs->front()].ID();
+    }
+
     // not found
     return -1;
 }
@@ -178,14 +193,16 @@ int InnovationDatabase::CheckLastInnovation(int a_In, int a_Out, InnovationType
     ASSERT((a_Type == NEW_NEURON) || (a_Type == NEW_LINK));
     int t_ID = -1;
 
-    // search the list for a match
-    for(unsigned int i=0; i < m_Innovations.size(); i++)
+    // the last match
+    const std::vector<int>* t_idxs = FindIndexed(a_In, a_Out, a_Type);
+    if (t_idxs != NULL)
     {
-        if ((m_Innovations[i].FromNeuronID() == a_In) && (m_Innovations[i].ToNeuronID() == a_Out) && (m_Innovations[i].InnovType() == a_Type))
-        {
-            // match found?
-            t_ID = m_Innovations[i].ID();
-        }
+        t_ID = m_Innovations[t_idxs->back()].ID();
+    }
+
+    if ((t_ID == -1) && (m_Base != NULL))
+    {
+        t_ID = m_Base->CheckLastInnovation(a_In, a_Out, a_Type);
     }
 
     return t_ID;
@@ -201,13 +218,20 @@ std::vector<int> InnovationDatabase::CheckAllInnovations(int a_In, int a_Out, In
     std::vector<int> t_idxs;
     t_idxs.clear();
 
-    // search the list for a match
-    for(unsigned int i=0; i < m_Innovations.size(); i++)
+    // the base's indexes come first
+    int t_offset = 0;
+    if (m_Base != NULL)
+    {
+        t_idxs = m_Base->CheckAllInnovations(a_In, a_Out, a_Type);
+        t_offset = static_cast<int>(m_Base->m_Innovations.size());
+    }
+
+    const std::vector<int>* t_matches = FindIndexed(a_In, a_Out, a_Type);
+    if (t_matches != NULL)
     {
-        if ((m_Innovations[i].FromNeuronID() == a_In) && (m_Innovations[i].ToNeuronID() == a_Out) && (m_Innovations[i].InnovType() == a_Type))
+        for(unsigned int i=0; i < t_matches->size(); i++)
         {
-            // match found?
-            t_idxs.push_back( i );
+            t_idxs.push_back( t_offset + (*t_matches)[i] );
         }
     }
 
@@ -222,16 +246,21 @@ int InnovationDatabase::FindNeuronID(int a_In, int a_Out) const
 {
     ASSERT((a_In > 0) && (a_Out > 0));
 
-    // search the list for a match
-    for(unsigned int i=0; i < m_Innovations.size(); i++)
+    if (m_Base != NULL)
     {
-        if ((m_Innovations[i].FromNeuronID() == a_In) && (m_Innovations[i].ToNeuronID() == a_Out) && (m_Innovations[i].InnovType() == NEW_NEURON))
+        int t_ID = m_Base->FindNeuronID(a_In, a_Out);
+        if (t_ID != -1)
         {
-            // match found?
-            return m_Innovations[i].NeuronID();
+            return t_ID;
         }
     }
 
+    const std::vector<int>* t_idxs = FindIndexed(a_In, a_Out, NEW_NEURON);
+    if (t_idxs != NULL)
+    {
+        return m_Innovations[t_idxs->front()].NeuronID();
+    }
+
     // Not found
     return -1;
 }
@@ -241,20 +270,58 @@ int InnovationDatabase::FindLastNeuronID(int a_In, int a_Out) const
     ASSERT((a_In > 0) && (a_Out > 0));
     int t_ID = -1;
 
-    // search the list for a match
-    for(unsigned int i=0; i < m_Innovations.size(); i++)
+    const std::vector<int>* t_idxs = FindIndexed(a_In, a_Out, NEW_NEURON);
+    if (t_idxs != NULL)
     {
-        if ((m_Innovations[i].FromNeuronID() == a_In) && (m_Innovations[i].ToNeuronID() == a_Out) && (m_Innovations[i].InnovType() == NEW_NEURON))
-        {
-            // match found?
-            t_ID = m_Innovations[i].NeuronID();
-        }
+        t_ID = m_Innovations[t_idxs->back()].NeuronID();
+    }
+
+    if ((t_ID == -1) && (m_Base != NULL))
+    {
+        t_ID = m_Base->FindLastNeuronID(a_In, a_Out);
     }
 
     return t_ID;
 }
 
 
+// The key of an innovation in m_Index
+static unsigned long long IndexKey(int a_In, int a_Out, InnovationType a_Type)
+{
+    return (static_cast<unsigned long long>(static_cast<unsigned int>(a_In)) << 33) |
+           (static_cast<unsigned long long>(static_cast<unsigned int>(a_Out)) << 1) |
+           static_cast<unsigned long long>(a_Type == NEW_NEURON);
+}
+
+// Returns the indexes of the matching innovations in m_Innovations, or NULL if there are none
+const std::vector<int>* InnovationDatabase::FindIndexed(int a_In, int a_Out, InnovationType a_Type) const
+{
+    std::unordered_map<unsigned long long, std::vector<int> >::const_iterator t_it = m_Index.find(IndexKey(a_In, a_Out, a_Type));
+    if (t_it == m_Index.end())
+    {
+        return NULL;
+    }
+    return &(t_it->second);
+}
+
+// Adds m_Innovations[a_Idx] to the index
+void InnovationDatabase::IndexInnovation(int a_Idx)
+{
+    const Innovation& t_innov = m_Innovations[a_Idx];
+    m_Index[IndexKey(t_innov.FromNeuronID(), t_innov.ToNeuronID(), t_innov.InnovType())].push_back(a_Idx);
+}
+
+// Rebuilds the whole index
+void InnovationDatabase::RebuildIndex()
+{
+    m_Index.clear();
+    for(unsigned int i=0; i < m_Innovations.size(); i++)
+    {
+        IndexInnovation(i);
+    }
+}
+
+
 // Adds a new link innovation and returns its ID
 // Increments the m_NextInnovationNum internally
 int InnovationDatabase::AddLinkInnovation(int a_In, int a_Out)
@@ -262,6 +329,7 @@ int InnovationDatabase::AddLinkInnovation(int a_In, int a_Out)
     ASSERT((a_In > 0) && (a_Out > 0));
 
     m_Innovations.push_back( Innovation(m_NextInnovationNum, NEW_LINK, a_In, a_Out, NONE, -1) );
+    IndexInnovation(m_Innovations.size() - 1);
     m_NextInnovationNum++;
 
     return (m_NextInnovationNum - 1);
@@ -280,6 +348,7 @@ int InnovationDatabase::AddNeuronInnovation(int a_In, int a_Out, NeuronType a_NT
     ASSERT(!((a_NType == INPUT) || (a_NType == BIAS) || (a_NType == OUTPUT)));
 
     m_Innovations.push_back( Innovation(m_NextInnovationNum, NEW_NEURON, a_In, a_Out, a_NType, m_NextNeuronID) );
+    IndexInnovation(m_Innovations.size() - 1);
     m_NextInnovationNum++;
     m_NextNeuronID++;
 
@@ -293,6 +362,115 @@ int InnovationDatabase::AddNeuronInnovation(int a_In, int a_Out, NeuronType a_NT
 void InnovationDatabase::Flush()
 {
     m_Innovations.clear();
+    m_Index.clear();
+}
+
+
+// Makes this an empty overlay over a_Base
+void InnovationDatabase::InitOverlay(const InnovationDatabase& a_Base)
+{
+    ASSERT(a_Base.m_Base == NULL);
+
+    m_Innovations.clear();
+    m_Index.clear();
+    m_Base = &a_Base;
+    m_NextInnovationNum = PROVISIONAL_ID;
+    m_NextNeuronID = PROVISIONAL_ID;
+}
+
+
+// maps a provisional ID to its final one, other IDs are unchanged
+static int FinalID(const std::map<int, int>& a_IDs, int a_ID)
+{
+    if (a_ID < PROVISIONAL_ID)
+    {
+        return a_ID;
+    }
+    std::map<int, int>::const_iterator t_it = a_IDs.find(a_ID);
+    ASSERT(t_it != a_IDs.end());
+    return t_it->second;
+}
+
+
+// Adds the innovations of an overlay as if they happened here
+// and renumbers the provisional IDs in the genome mutated with it
+void InnovationDatabase::MergeOverlay(const InnovationDatabase& a_Overlay, Genome& a_Genome)
+{
+    ASSERT(a_Overlay.m_Base == this);
+
+    std::map<int, int> t_neuron_ids; // provisional neuron ID -> final one
+    std::map<int, int> t_innov_ids;  // provisional innovation number -> final one
+
+    // The overlay's innovations are replayed in the order they happened, so
+    // the neurons they refer to are already mapped
+    for(unsigned int i=0; i < a_Overlay.m_Innovations.size(); i++)
+    {
+        const Innovation& t_innov = a_Overlay.m_Innovations[i];
+        int t_in = FinalID(t_neuron_ids, t_innov.FromNeuronID());
+        int t_out = FinalID(t_neuron_ids, t_innov.ToNeuronID());
+
+        if (t_innov.InnovType() == NEW_NEURON)
+        {
+            // Like in Genome::Mutate_AddNeuron(), inherit the first such neuron
+            // the genome doesn't already have, or add a new one
+            int t_nid = -1;
+            std::vector<int> t_idxs = CheckAllInnovations(t_in, t_out, NEW_NEURON);
+            for(unsigned int j=0; (j < t_idxs.size()) && (t_nid == -1); j++)
+            {
+                int t_candidate = m_Innovations[t_idxs[j]].NeuronID();
+                bool t_taken = false;
+                for(unsigned int k=0; k < a_Genome.m_NeuronGenes.size(); k++)
+                {
+                    if (a_Genome.m_NeuronGenes[k].ID() == t_candidate)
+                    {
+                        t_taken = true;
+                        break;
+                    }
+                }
+                for(std::map<int, int>::const_iterator t_it = t_neuron_ids.begin(); t_it != t_neuron_ids.end(); t_it++)
+                {
+                    if (t_it->second == t_candidate)
+                    {
+                        t_taken = true;
+                        break;
+                    }
+                }
+                if (!t_taken)
+                {
+                    t_nid = t_candidate;
+                }
+            }
+
+            if (t_nid == -1)
+            {
+                t_nid = AddNeuronInnovation(t_in, t_out, t_innov.GetNeuronType());
+            }
+            t_neuron_ids[t_innov.NeuronID()] = t_nid;
+        }
+        else
+        {
+            int t_id = CheckInnovation(t_in, t_out, NEW_LINK);
+            if (t_id == -1)
+            {
+                t_id = AddLinkInnovation(t_in, t_out);
+            }
+            t_innov_ids[t_innov.ID()] = t_id;
+        }
+    }
+
+    // Renumber the genome
+    for(unsigned int i=0; i < a_Genome.m_NeuronGenes.size(); i++)
+    {
+        a_Genome.m_NeuronGenes[i].m_ID = FinalID(t_neuron_ids, a_Genome.m_NeuronGenes[i].m_ID);
+    }
+    for(unsigned int i=0; i < a_Genome.m_LinkGenes.size(); i++)
+    {
+        LinkGene& t_link = a_Genome.m_LinkGenes[i];
+        t_link.m_FromNeuronID = FinalID(t_neuron_ids, t_link.m_FromNeuronID);
+        t_link.m_ToNeuronID = FinalID(t_neuron_ids, t_link.m_ToNeuronID);
+        t_link.m_InnovationID = FinalID(t_innov_ids, t_link.m_InnovationID);
+    }
+    a_Genome.InvalidateIndex();
 }
 
 
@@ -32,6 +32,7 @@
 
 #include <vector>
 #include <fstream>
+#include <unordered_map>
 
 #include "Genes.h"
 #include "Genome.h"
@@ -130,6 +131,9 @@ public:
 // forward
 class Genome;
 
+// The first provisional neuron ID and innovation number given by an overlay database
+#define PROVISIONAL_ID (1 << 30)
+
 ////////////////////////////////////////////////////////
 // This class defines the innovation database structure
 ////////////////////////////////////////////////////////
@@ -147,11 +151,24 @@ private:
     int m_NextNeuronID;
     int m_NextInnovationNum;
 
+    // If not NULL, this database is an overlay over m_Base. Lookups see the innovations
+    // of the base first, and new innovations are kept here with provisional IDs
+    // until they are merged into the base with MergeOverlay().
+    const InnovationDatabase* m_Base;
+
+    // Indexes of m_Innovations by (from, to, type), in ascending order,
+    // so the first and last matches are the front and back
+    std::unordered_map<unsigned long long, std::vector<int> > m_Index;
+    const std::vector<int>* FindIndexed(int a_In, int a_Out, InnovationType a_Type) const;
+    void IndexInnovation(int a_Idx);
+    void RebuildIndex();
+
 public:
 
     ////////////////////////////
     // Constructors
     ////////////////////////////
+    // Add to it only through the methods below, which keep m_Index up to date
     std::vector<Innovation> m_Innovations;
     // Creates an empty database
     InnovationDatabase();
@@ -177,6 +194,15 @@ public:
     // File is assumed to be already opened!
     void Init(std::ifstream& a_file);
 
+    // Makes this an empty overlay over a_Base, which must not change while the overlay is used.
+    // Several overlays can read the same base from different threads.
+    void InitOverlay(const InnovationDatabase& a_Base);
+
+    // Adds the innovations of a_Overlay (an overlay over this database) as if they
+    // happened here, and renumbers the provisional neuron IDs and innovation numbers
+    // in a_Genome, which must be the only genome mutated with the overlay.
+    void MergeOverlay(const InnovationDatabase& a_Overlay, Genome& a_Genome);
+
     // Checks the database if the innovation has already occured
     // Returns the innovation id if true or -1 if false
     // If it is a NEW_LINK innovation, in & out specify the neuron IDs being connected
@@ -205,8 +231,17 @@ public:
     // Clears all innovations in the database
     void Flush();
 
+    // For an overlay, the indexes of the base come first
     Innovation GetInnovationByIdx(int idx) const
     {
+        if (m_Base != NULL)
+        {
+            if (idx < static_cast<int>(m_Base->m_Innovations.size()))
+            {
+                return m_Base->GetInnovationByIdx(idx);
+            }
+            idx -= static_cast<int>(m_Base->m_Innovations.size());
+        }
         return m_Innovations[idx];
     };
 
@@ -31,10 +31,12 @@
 
 #include <math.h>
 #include <float.h>
+#include <string.h>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include "NeuralNetwork.h"
 #include "Assert.h"
 #include "Utils.h"
@@ -145,6 +147,112 @@ inline double af_softplus(double aX)
 }
 
 
+////////////////////////////////////////////////////
+// Single precision versions, for evaluation only. //
+// exp() is approximated, see fast_exp().           //
+////////////////////////////////////////////////////
+
+// exp(x) = 2^(x / ln 2) = 2^n * 2^f, where the integer part n goes straight into the exponent bits
+// and 2^f of the fractional part comes from a degree 5 polynomial. The relative error is up to
+// about 4e-6, mostly from rounding x / ln 2 for large x. The argument is clamped to [-87, 88]
+// and NaN is passed through. There are no branches on the value, so loops over it can be vectorized.
+inline float fast_exp(float aX)
+{
+    // NaN fails both comparisons, so it is replaced here (the cast below would be undefined)
+    float tX = (aX > -87.0f) ? ((aX < 88.0f) ? aX : 88.0f) : -87.0f;
+    float t = tX * 1.44269504f;
+    float n = floorf(t);
+    float f = t - n;
+
+    float p = 1.8775767e-3f;
+    p = p * f + 8.9893397e-3f;
+    p = p * f + 5.5826318e-2f;
+    p = p * f + 2.4015361e-1f;
+    p = p * f + 6.9315308e-1f;
+    p = p * f + 9.9999994e-1f;
+
+    int bits = ((int)n + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(float));
+    return (aX == aX) ? (p * scale) : aX;
+}
+
+inline float af_sigmoid_unsigned(float aX, float aSlope, float aShift)
+{
+    return 1.0f / (1.0f + fast_exp( - aSlope * aX - aShift));
+}
+
+inline float af_sigmoid_signed(float aX, float aSlope, float aShift)
+{
+    float tY = af_sigmoid_unsigned(aX, aSlope, aShift);
+    return (tY - 0.5f) * 2.0f;
+}
+
+inline float af_tanh(float aX, float aSlope, float /*aShift*/)
+{
+    float tE = fast_exp(-2.0f * aX * aSlope);
+    return (1.0f - tE) / (1.0f + tE);
+}
+
+inline float af_tanh_cubic(float aX, float aSlope, float aShift)
+{
+    return af_tanh(aX * aX * aX, aSlope, aShift);
+}
+
+inline float af_step_signed(float aX, float aShift)
+{
+    return (aX > aShift) ? 1.0f : -1.0f;
+}
+
+inline float af_step_unsigned(float aX, float aShift)
+{
+    return (aX > (0.5f + aShift)) ? 1.0f : 0.0f;
+}
+
+inline float af_gauss_signed(float aX, float aSlope, float aShift)
+{
+    float tY = fast_exp( - aSlope * aX * aX + aShift);
+    return (tY - 0.5f) * 2.0f;
+}
+
+inline float af_gauss_unsigned(float aX, float aSlope, float aShift)
+{
+    return fast_exp( - aSlope * aX * aX + aShift);
+}
+
+inline float af_abs(float aX, float aShift)
+{
+    return fabsf(aX + aShift);
+}
+
+inline float af_sine_signed(float aX, float aFreq, float aShift)
+{
+    return sinf(aX * aFreq + aShift);
+}
+
+inline float af_sine_unsigned(float aX, float aFreq, float aShift)
+{
+    float tY = sinf(aX * aFreq + aShift);
+    return (tY + 1.0f) / 2.0f;
+}
+
+inline float af_linear(float aX, float aShift)
+{
+    return (aX + aShift);
+}
+
+inline float af_relu(float aX)
+{
+    return (aX > 0) ? aX : 0;
+}
+
+inline float af_softplus(float aX)
+{
+    // log(1 + exp(x)) rounds to x in float above 20, and fast_exp() is clamped anyway
+    return (aX > 20.0f) ? aX : logf(1.0f + fast_exp(aX));
+}
+
+
 double unsigned_sigmoid_derivative(double x)
 {
     return x * (1 - x);
@@ -155,23 +263,40 @@ double tanh_derivative(double x)
     return 1 - x * x;
 }
 
+// orders neuron indices by their layer, then by their activation function
+struct LayerActivationFunctionLess
+{
+    const std::vector<Neuron>& m_neurons;
+    const std::vector<int>& m_layer;
+    LayerActivationFunctionLess(const std::vector<Neuron>& a_neurons, const std::vector<int>& a_layer)
+        : m_neurons(a_neurons), m_layer(a_layer) {}
+    bool operator()(int a, int b) const
+    {
+        if (m_layer[a] != m_layer[b])
+            return m_layer[a] < m_layer[b];
+        return m_neurons[a].m_activation_function_type < m_neurons[b].m_activation_function_type;
+    }
+};
+
 ///////////////////////////////////////
 // Neural network class implementation
 ///////////////////////////////////////
 NeuralNetwork::NeuralNetwork(bool a_Minimal)
 {
+    m_compiled = false;
+    m_plan_max_weight_valid = false;
     if (!a_Minimal)
     {
         // build an XOR network
 
         // The input neurons are 3 // indexes 0 1 2
-        Neuron t_i1, t_i2, t_i3;
+        Neuron t_i1 = Neuron(), t_i2 = Neuron(), t_i3 = Neuron();
 
         // The output neuron       // index 3
-        Neuron t_o1;
+        Neuron t_o1 = Neuron();
 
         // The hidden neuron       // index 4
-        Neuron t_h1;
+        Neuron t_h1 = Neuron();
 
         m_neurons.push_back(t_i1);
         m_neurons.push_back(t_i2);
@@ -257,6 +382,8 @@ NeuralNetwork::NeuralNetwork(bool a_Minimal)
 
 NeuralNetwork::NeuralNetwork()
 {
+    m_compiled = false;
+    m_plan_max_weight_valid = false;
     // an empty network
     m_num_inputs = m_num_outputs = 0;
     m_total_error = 0;
@@ -273,16 +400,39 @@ NeuralNetwork::NeuralNetwork()
 
 void NeuralNetwork::InitRTRLMatrix()
 {
-    // Allocate memory for the neurons sensitivity matrices.
-    for (unsigned int i = 0; i < m_neurons.size(); i++)
+    // Find the connections to learn, the first one of every (target, source) pair
+    std::vector< std::pair< std::pair<int, int>, int > > t_pairs;
+    for (unsigned int i = 0; i < m_connections.size(); i++)
+    {
+        if (m_connections[i].m_target_neuron_idx >= (int)m_num_inputs)
+        {
+            t_pairs.push_back(std::make_pair(std::make_pair(m_connections[i].m_target_neuron_idx,
+                                                            m_connections[i].m_source_neuron_idx), i));
+        }
+    }
+    std::sort(t_pairs.begin(), t_pairs.end());
+
+    m_rtrl_connection.clear();
+    m_rtrl_target_start.assign(m_neurons.size() + 1, 0);
+    for (unsigned int i = 0; i < t_pairs.size(); i++)
     {
-        m_neurons[i].m_sensitivity_matrix.resize(m_neurons.size()); // first dimention
-        for (unsigned int j = 0; j < m_neurons.size(); j++)
+        if ((i > 0) && (t_pairs[i].first == t_pairs[i - 1].first))
         {
-            m_neurons[i].m_sensitivity_matrix[j].resize(m_neurons.size()); // second dimention
+            continue;
         }
+        m_rtrl_connection.push_back(t_pairs[i].second);
+        m_rtrl_target_start[t_pairs[i].first.first + 1]++;
+    }
+    for (unsigned int k = 0; k < m_neurons.size(); k++)
+    {
+        m_rtrl_target_start[k + 1] += m_rtrl_target_start[k];
     }
 
+    // Allocate memory for the sensitivities of the non-input neurons
+    unsigned int t_rows = (m_neurons.size() > m_num_inputs) ? (m_neurons.size() - m_num_inputs) : 0;
+    m_rtrl_sensitivity.resize(t_rows * m_rtrl_connection.size());
+    m_rtrl_sum.resize(m_rtrl_connection.size());
+
     // now clear it
     FlushCube();
     // clear out the other RTRL stuff as well
@@ -294,281 +444,607 @@ void NeuralNetwork::InitRTRLMatrix()
     }
 }
 
-void NeuralNetwork::ActivateFast()
+// Runs one activation function over a block of slots.
+// The switch is taken once per run, so the inner loops are branch-free
+// (apart from the step functions) and can be vectorized by the compiler.
+// T picks the precision, the af_* overloads of that type do the work.
+template <typename T>
+inline void ActivateBlockT(ActivationFunction a_type, int a_count,
+                           const T* x, const T* a, const T* b,
+                           const int* a_neuron, T* a_activation)
 {
-    // Loop connections. Calculate each connection's output signal.
-    for (unsigned int i = 0; i < m_connections.size(); i++)
-    {
-        m_connections[i].m_signal =
-                m_neurons[m_connections[i].m_source_neuron_idx].m_activation
-                        * m_connections[i].m_weight;
-    }
-    // Loop the connections again. This time add the signals to the target neurons.
-    // This will largely require out of order memory writes. This is the one loop where
-    // this will happen.
-    for (unsigned int i = 0; i < m_connections.size(); i++)
+    int i;
+    switch (a_type)
     {
-        m_neurons[m_connections[i].m_target_neuron_idx].m_activesum +=
-                m_connections[i].m_signal;
+    case SIGNED_SIGMOID:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_sigmoid_signed(x[i], a[i], b[i]);
+        break;
+    case UNSIGNED_SIGMOID:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_sigmoid_unsigned(x[i], a[i], b[i]);
+        break;
+    case TANH:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_tanh(x[i], a[i], b[i]);
+        break;
+    case TANH_CUBIC:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_tanh_cubic(x[i], a[i], b[i]);
+        break;
+    case SIGNED_STEP:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_step_signed(x[i], b[i]);
+        break;
+    case UNSIGNED_STEP:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_step_unsigned(x[i], b[i]);
+        break;
+    case SIGNED_GAUSS:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_gauss_signed(x[i], a[i], b[i]);
+        break;
+    case UNSIGNED_GAUSS:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_gauss_unsigned(x[i], a[i], b[i]);
+        break;
+    case ABS:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_abs(x[i], b[i]);
+        break;
+    case SIGNED_SINE:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_sine_signed(x[i], a[i], b[i]);
+        break;
+    case UNSIGNED_SINE:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_sine_unsigned(x[i], a[i], b[i]);
+        break;
+    case LINEAR:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_linear(x[i], b[i]);
+        break;
+    case RELU:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_relu(x[i]);
+        break;
+    case SOFTPLUS:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_softplus(x[i]);
+        break;
+    default:
+        for (i = 0; i < a_count; i++)
+            a_activation[a_neuron[i]] = af_sigmoid_unsigned(x[i], a[i], b[i]);
+        break;
     }
-    // Now loop nodes_activesums, pass the signals through the activation function
-    // and store the result back to nodes_activations
-    // also skip inputs since they do not get an activation
-    for (unsigned int i = m_num_inputs; i < m_neurons.size(); i++)
+}
+
+void ActivateBlock(ActivationFunction a_type, int a_count,
+                   const double* x, const double* a, const double* b,
+                   const int* a_neuron, double* a_activation)
+{
+    ActivateBlockT(a_type, a_count, x, a, b, a_neuron, a_activation);
+}
+
+void ActivateBlock(ActivationFunction a_type, int a_count,
+                   const float* x, const float* a, const float* b,
+                   const int* a_neuron, float* a_activation)
+{
+    ActivateBlockT(a_type, a_count, x, a, b, a_neuron, a_activation);
+}
+
+// Runs one activation function over a batch of values of the same neuron.
+inline void ActivateBatchBlock(ActivationFunction a_type, int a_count,
+                               const double* x, double a, double b, double* a_activation)
+{
+    int i;
+    switch (a_type)
     {
-        double x = m_neurons[i].m_activesum;
-        m_neurons[i].m_activesum = 0;
-        // Apply the activation function
-        double y = 0.0;
-        y = af_sigmoid_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-        m_neurons[i].m_activation = y;
+    case SIGNED_SIGMOID:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_sigmoid_signed(x[i], a, b);
+        break;
+    case UNSIGNED_SIGMOID:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_sigmoid_unsigned(x[i], a, b);
+        break;
+    case TANH:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_tanh(x[i], a, b);
+        break;
+    case TANH_CUBIC:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_tanh_cubic(x[i], a, b);
+        break;
+    case SIGNED_STEP:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_step_signed(x[i], b);
+        break;
+    case UNSIGNED_STEP:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_step_unsigned(x[i], b);
+        break;
+    case SIGNED_GAUSS:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_gauss_signed(x[i], a, b);
+        break;
+    case UNSIGNED_GAUSS:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_gauss_unsigned(x[i], a, b);
+        break;
+    case ABS:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_abs(x[i], b);
+        break;
+    case SIGNED_SINE:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_sine_signed(x[i], a, b);
+        break;
+    case UNSIGNED_SINE:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_sine_unsigned(x[i], a, b);
+        break;
+    case LINEAR:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_linear(x[i], b);
+        break;
+    case RELU:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_relu(x[i]);
+        break;
+    case SOFTPLUS:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_softplus(x[i]);
+        break;
+    default:
+        for (i = 0; i < a_count; i++)
+            a_activation[i] = af_sigmoid_unsigned(x[i], a, b);
+        break;
     }
 }
 
-void NeuralNetwork::Activate()
+// Freezes the topology into flat arrays. The non-input neurons are grouped by
+// layer and activation function into runs, and the connections are (stably) sorted
+// by the slot of their target, so every neuron's inputs are summed in the same order
+// as before and the results are bit-identical to walking m_connections.
+void NeuralNetwork::Compile()
 {
-    // Loop connections. Calculate each connection's output signal.
-    for (unsigned int i = 0; i < m_connections.size(); i++)
+    unsigned int t_num_neurons = m_neurons.size();
+    unsigned int t_num_connections = m_connections.size();
+    unsigned int t_first = std::min(m_num_inputs, t_num_neurons);
+
+    // Find the layer of every neuron with Kahn's algorithm. Inputs are layer 0
+    // and any other neuron is one layer above its deepest source.
+    // Connections into inputs are ignored, since inputs are never activated.
+    std::vector<int> t_layer(t_num_neurons, 0);
+    std::vector<int> t_in_degree(t_num_neurons, 0);
+    std::vector<int> t_out_start(t_num_neurons + 1, 0);
+    for (unsigned int i = 0; i < t_num_connections; i++)
+    {
+        const Connection& t_c = m_connections[i];
+        if ((unsigned int)t_c.m_target_neuron_idx < t_first)
+            continue;
+
+        t_in_degree[t_c.m_target_neuron_idx]++;
+        t_out_start[t_c.m_source_neuron_idx + 1]++;
+    }
+    for (unsigned int i = 0; i < t_num_neurons; i++)
     {
-        m_connections[i].m_signal =
-                m_neurons[m_connections[i].m_source_neuron_idx].m_activation
-                        * m_connections[i].m_weight;
+        t_out_start[i + 1] += t_out_start[i];
     }
-    // Loop the connections again. This time add the signals to the target neurons.
-    // This will largely require out of order memory writes. This is the one loop where
-    // this will happen.
-    for (unsigned int i = 0; i < m_connections.size(); i++)
+    std::vector<int> t_out_target(t_out_start[t_num_neurons]);
+    std::vector<int> t_out_fill(t_out_start.begin(), t_out_start.end() - 1);
+    for (unsigned int i = 0; i < t_num_connections; i++)
+    {
+        const Connection& t_c = m_connections[i];
+        if ((unsigned int)t_c.m_target_neuron_idx < t_first)
+            continue;
+
+        t_out_target[t_out_fill[t_c.m_source_neuron_idx]++] = t_c.m_target_neuron_idx;
+    }
+
+    std::vector<int> t_queue;
+    t_queue.reserve(t_num_neurons);
+    for (unsigned int i = 0; i < t_num_neurons; i++)
     {
-        m_neurons[m_connections[i].m_target_neuron_idx].m_activesum +=
-                m_connections[i].m_signal;
+        if (i >= t_first)
+            t_layer[i] = 1;
+        if (t_in_degree[i] == 0)
+            t_queue.push_back(i);
     }
-    // Now loop nodes_activesums, pass the signals through the activation function
-    // and store the result back to nodes_activations
-    // also skip inputs since they do not get an activation
-    for (unsigned int i = m_num_inputs; i < m_neurons.size(); i++)
+    for (unsigned int q = 0; q < t_queue.size(); q++)
     {
-        double x = m_neurons[i].m_activesum;
-        m_neurons[i].m_activesum = 0;
-        // Apply the activation function
-        double y = 0.0;
-        switch (m_neurons[i].m_activation_function_type)
+        int t_n = t_queue[q];
+        for (int c = t_out_start[t_n]; c < t_out_start[t_n + 1]; c++)
+        {
+            int t_target = t_out_target[c];
+            t_layer[t_target] = std::max(t_layer[t_target], t_layer[t_n] + 1);
+            if (--t_in_degree[t_target] == 0)
+                t_queue.push_back(t_target);
+        }
+    }
+
+    // a cycle leaves some neurons unvisited, then everything is in one layer
+    m_plan_feedforward = (t_queue.size() == t_num_neurons);
+    if (!m_plan_feedforward)
+    {
+        std::fill(t_layer.begin(), t_layer.end(), 1);
+    }
+
+    // order the slots by layer and activation function, keeping the neuron order within a group
+    m_plan_order.clear();
+    for (unsigned int i = t_first; i < t_num_neurons; i++)
+    {
+        m_plan_order.push_back(i);
+    }
+    std::stable_sort(m_plan_order.begin(), m_plan_order.end(), LayerActivationFunctionLess(m_neurons, t_layer));
+
+    unsigned int t_num_slots = m_plan_order.size();
+    std::vector<int> t_slot(t_num_neurons, -1);
+    for (unsigned int s = 0; s < t_num_slots; s++)
+    {
+        t_slot[m_plan_order[s]] = s;
+    }
+
+    m_plan_runs.clear();
+    m_plan_layer_runs.clear();
+    for (unsigned int s = 0; s < t_num_slots; s++)
+    {
+        ActivationFunction t_type = m_neurons[m_plan_order[s]].m_activation_function_type;
+        bool t_new_layer = (s == 0) || (t_layer[m_plan_order[s]] != t_layer[m_plan_order[s - 1]]);
+        if (t_new_layer)
+        {
+            m_plan_layer_runs.push_back(m_plan_runs.size());
+        }
+        if (t_new_layer || (m_plan_runs.back().m_type != t_type))
+        {
+            ActivationRun t_run;
+            t_run.m_type = t_type;
+            t_run.m_start = s;
+            t_run.m_end = s;
+            m_plan_runs.push_back(t_run);
+        }
+        m_plan_runs.back().m_end = s + 1;
+    }
+    m_plan_layer_runs.push_back(m_plan_runs.size());
+
+    // counting sort of the connections by target slot
+    // connections into input neurons are ignored, they never get an activation
+    m_plan_in_start.assign(t_num_slots + 1, 0);
+    for (unsigned int i = 0; i < t_num_connections; i++)
+    {
+        ASSERT(m_connections[i].m_target_neuron_idx < (int)t_num_neurons);
+        int t_target = t_slot[m_connections[i].m_target_neuron_idx];
+        if (t_target >= 0)
+        {
+            m_plan_in_start[t_target + 1]++;
+        }
+    }
+    for (unsigned int s = 0; s < t_num_slots; s++)
+    {
+        m_plan_in_start[s + 1] += m_plan_in_start[s];
+    }
+
+    m_plan_source.resize(m_plan_in_start[t_num_slots]);
+    m_plan_weight.resize(m_plan_in_start[t_num_slots]);
+    m_plan_connection.resize(m_plan_in_start[t_num_slots]);
+    m_plan_hebb_rate.resize(m_plan_in_start[t_num_slots]);
+    m_plan_hebb_pre_rate.resize(m_plan_in_start[t_num_slots]);
+    m_plan_input_connection.clear();
+    std::vector<int> t_fill(m_plan_in_start.begin(), m_plan_in_start.end() - 1);
+    for (unsigned int i = 0; i < t_num_connections; i++)
+    {
+        int t_target = t_slot[m_connections[i].m_target_neuron_idx];
+        if (t_target < 0)
         {
-        case SIGNED_SIGMOID:
-            y = af_sigmoid_signed(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_SIGMOID:
-            y = af_sigmoid_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case TANH:
-            y = af_tanh(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case TANH_CUBIC:
-            y = af_tanh_cubic(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case SIGNED_STEP:
-            y = af_step_signed(x, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_STEP:
-            y = af_step_unsigned(x, m_neurons[i].m_b);
-            break;
-        case SIGNED_GAUSS:
-            y = af_gauss_signed(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_GAUSS:
-            y = af_gauss_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case ABS:
-            y = af_abs(x, m_neurons[i].m_b);
-            break;
-        case SIGNED_SINE:
-            y = af_sine_signed(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_SINE:
-            y = af_sine_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case LINEAR:
-            y = af_linear(x, m_neurons[i].m_b);
-            break;
-        case RELU:
-            y = af_relu(x);
-            break;
-        case SOFTPLUS:
-            y = af_softplus(x);
-            break;
-        default:
-            y = af_sigmoid_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
+            m_plan_input_connection.push_back(i);
+            continue;
+        }
+
+        int t_pos = t_fill[t_target]++;
+        m_plan_source[t_pos] = m_connections[i].m_source_neuron_idx;
+        m_plan_weight[t_pos] = m_connections[i].m_weight;
+        m_plan_connection[t_pos] = i;
+        m_plan_hebb_rate[t_pos] = m_connections[i].m_hebb_rate;
+        m_plan_hebb_pre_rate[t_pos] = m_connections[i].m_hebb_pre_rate;
+    }
+    m_plan_max_weight_valid = false;
+
+    // per-slot parameters and state
+    m_plan_a.resize(t_num_slots);
+    m_plan_b.resize(t_num_slots);
+    m_plan_bias.resize(t_num_slots);
+    m_plan_timeconst.resize(t_num_slots);
+    m_plan_activesum.assign(t_num_slots, 0.0);
+    m_plan_membrane.resize(t_num_slots);
+    for (unsigned int s = 0; s < t_num_slots; s++)
+    {
+        const Neuron& t_n = m_neurons[m_plan_order[s]];
+        m_plan_a[s] = t_n.m_a;
+        m_plan_b[s] = t_n.m_b;
+        m_plan_bias[s] = t_n.m_bias;
+        m_plan_timeconst[s] = t_n.m_timeconst;
+        m_plan_membrane[s] = t_n.m_membrane_potential;
+    }
+
+    m_plan_activation.resize(t_num_neurons);
+    for (unsigned int i = 0; i < t_num_neurons; i++)
+    {
+        m_plan_activation[i] = m_neurons[i].m_activation;
+    }
+
+    m_plan_num_inputs = m_num_inputs;
+    m_plan_num_connections = t_num_connections;
+    m_compiled = true;
+}
+
+void NeuralNetwork::EnsureCompiled()
+{
+    if ((!m_compiled) ||
+        (m_plan_num_inputs != m_num_inputs) ||
+        (m_plan_activation.size() != m_neurons.size()) ||
+        (m_plan_num_connections != m_connections.size()))
+    {
+        Compile();
+    }
+}
 
+void NeuralNetwork::PropagateSignals(int a_start, int a_end)
+{
+    const int* t_source = m_plan_source.data();
+    const double* t_weight = m_plan_weight.data();
+    const double* t_activation = m_plan_activation.data();
+
+    // Each slot pulls its incoming signals from a contiguous range,
+    // so the sum stays in a register and there are no scattered writes.
+    // All sums are computed before any activation changes.
+    for (int s = a_start; s < a_end; s++)
+    {
+        double t_sum = 0;
+        for (int c = m_plan_in_start[s]; c < m_plan_in_start[s + 1]; c++)
+        {
+            t_sum += t_activation[t_source[c]] * t_weight[c];
         }
-        m_neurons[i].m_activation = y;
+        m_plan_activesum[s] = t_sum;
     }
+}
 
+void NeuralNetwork::ApplyActivationRuns(int a_first, int a_last)
+{
+    for (int r = a_first; r < a_last; r++)
+    {
+        const ActivationRun& t_run = m_plan_runs[r];
+        ActivateBlock(t_run.m_type, t_run.m_end - t_run.m_start,
+                      &m_plan_activesum[t_run.m_start],
+                      &m_plan_a[t_run.m_start],
+                      &m_plan_b[t_run.m_start],
+                      &m_plan_order[t_run.m_start],
+                      m_plan_activation.data());
+    }
 }
 
-void NeuralNetwork::ActivateUseInternalBias()
+void NeuralNetwork::SyncPlanWeights()
 {
-    // Loop connections. Calculate each connection's output signal.
-    for (unsigned int i = 0; i < m_connections.size(); i++)
+    if (!m_compiled)
+        return;
+
+    if (m_plan_num_connections != m_connections.size())
     {
-        m_connections[i].m_signal =
-                m_neurons[m_connections[i].m_source_neuron_idx].m_activation
-                        * m_connections[i].m_weight;
+        m_compiled = false;
+        return;
     }
-    // Loop the connections again. This time add the signals to the target neurons.
-    // This will largely require out of order memory writes. This is the one loop where
-    // this will happen.
-    for (unsigned int i = 0; i < m_connections.size(); i++)
+
+    for (unsigned int i = 0; i < m_plan_weight.size(); i++)
+    {
+        m_plan_weight[i] = m_connections[m_plan_connection[i]].m_weight;
+    }
+    m_plan_max_weight_valid = false;
+}
+
+void NeuralNetwork::SyncConnectionWeights()
+{
+    for (unsigned int i = 0; i < m_plan_weight.size(); i++)
     {
-        m_neurons[m_connections[i].m_target_neuron_idx].m_activesum +=
-                m_connections[i].m_signal;
+        m_connections[m_plan_connection[i]].m_weight = m_plan_weight[i];
     }
-    // Now loop nodes_activesums, pass the signals through the activation function
-    // and store the result back to nodes_activations
-    // also skip inputs since they do not get an activation
-    for (unsigned int i = m_num_inputs; i < m_neurons.size(); i++)
+}
+
+void NeuralNetwork::SyncNeurons()
+{
+    for (unsigned int i = 0; i < m_neurons.size(); i++)
     {
-        double x = m_neurons[i].m_activesum + m_neurons[i].m_bias;
+        m_neurons[i].m_activation = m_plan_activation[i];
         m_neurons[i].m_activesum = 0;
-        // Apply the activation function
-        double y = 0.0;
-        switch (m_neurons[i].m_activation_function_type)
+    }
+    for (unsigned int s = 0; s < m_plan_order.size(); s++)
+    {
+        m_neurons[m_plan_order[s]].m_membrane_potential = m_plan_membrane[s];
+    }
+}
+
+void NeuralNetwork::ActivateFast()
+{
+    EnsureCompiled();
+    PropagateSignals(0, m_plan_order.size());
+
+    // Pass the sums through the activation function
+    // inputs do not have slots, since they do not get an activation
+    for (unsigned int s = 0; s < m_plan_order.size(); s++)
+    {
+        m_plan_activation[m_plan_order[s]] = af_sigmoid_unsigned(m_plan_activesum[s], m_plan_a[s], m_plan_b[s]);
+    }
+
+    SyncNeurons();
+}
+
+void NeuralNetwork::Activate()
+{
+    EnsureCompiled();
+    PropagateSignals(0, m_plan_order.size());
+    ApplyActivationRuns(0, m_plan_runs.size());
+    SyncNeurons();
+}
+
+void NeuralNetwork::ActivateFeedForward()
+{
+    EnsureCompiled();
+    if (!m_plan_feedforward)
+    {
+        Activate();
+        return;
+    }
+
+    // One layer at a time, so every neuron sees the fresh activations of its sources
+    for (unsigned int l = 0; l + 1 < m_plan_layer_runs.size(); l++)
+    {
+        int t_first = m_plan_layer_runs[l];
+        int t_last = m_plan_layer_runs[l + 1];
+        PropagateSignals(m_plan_runs[t_first].m_start, m_plan_runs[t_last - 1].m_end);
+        ApplyActivationRuns(t_first, t_last);
+    }
+
+    SyncNeurons();
+}
+
+void NeuralNetwork::PropagateSignalsBatch(int a_start, int a_end, unsigned int a_batch_size)
+{
+    // every connection is an axpy over the batch
+    for (int s = a_start; s < a_end; s++)
+    {
+        double* t_sum = &m_batch_activesum[s * a_batch_size];
+        std::fill(t_sum, t_sum + a_batch_size, 0.0);
+        for (int c = m_plan_in_start[s]; c < m_plan_in_start[s + 1]; c++)
         {
-        case SIGNED_SIGMOID:
-            y = af_sigmoid_signed(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_SIGMOID:
-            y = af_sigmoid_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case TANH:
-            y = af_tanh(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case TANH_CUBIC:
-            y = af_tanh_cubic(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case SIGNED_STEP:
-            y = af_step_signed(x, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_STEP:
-            y = af_step_unsigned(x, m_neurons[i].m_b);
-            break;
-        case SIGNED_GAUSS:
-            y = af_gauss_signed(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_GAUSS:
-            y = af_gauss_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case ABS:
-            y = af_abs(x, m_neurons[i].m_b);
-            break;
-        case SIGNED_SINE:
-            y = af_sine_signed(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_SINE:
-            y = af_sine_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case LINEAR:
-            y = af_linear(x, m_neurons[i].m_b);
-            break;
-        case RELU:
-            y = af_relu(x);
-            break;
-        case SOFTPLUS:
-            y = af_softplus(x);
-            break;
-        default:
-            y = af_sigmoid_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
+            const double* t_source = &m_batch_activation[m_plan_source[c] * a_batch_size];
+            double t_weight = m_plan_weight[c];
+            for (unsigned int b = 0; b < a_batch_size; b++)
+            {
+                t_sum[b] += t_source[b] * t_weight;
+            }
         }
-        m_neurons[i].m_activation = y;
     }
+}
 
+void NeuralNetwork::ApplyActivationRunsBatch(int a_first, int a_last, unsigned int a_batch_size)
+{
+    for (int r = a_first; r < a_last; r++)
+    {
+        const ActivationRun& t_run = m_plan_runs[r];
+        for (int s = t_run.m_start; s < t_run.m_end; s++)
+        {
+            ActivateBatchBlock(t_run.m_type, a_batch_size,
+                               &m_batch_activesum[s * a_batch_size],
+                               m_plan_a[s], m_plan_b[s],
+                               &m_batch_activation[m_plan_order[s] * a_batch_size]);
+        }
+    }
 }
 
-void NeuralNetwork::ActivateLeaky(double a_dtime)
+void NeuralNetwork::ActivateBatch(const std::vector<double>& a_inputs, unsigned int a_batch_size,
+                                  std::vector<double>& a_outputs, int a_depth)
 {
-    // Loop connections. Calculate each connection's output signal.
-    for (unsigned int i = 0; i < m_connections.size(); i++)
+    EnsureCompiled();
+    ASSERT(a_inputs.size() == a_batch_size * m_num_inputs);
+
+    // start from a flushed network, with the inputs transposed into place
+    m_batch_activation.assign(m_neurons.size() * a_batch_size, 0.0);
+    m_batch_activesum.resize(m_plan_order.size() * a_batch_size);
+    for (unsigned int b = 0; b < a_batch_size; b++)
     {
-        m_connections[i].m_signal =
-                m_neurons[m_connections[i].m_source_neuron_idx].m_activation
-                        * m_connections[i].m_weight;
+        for (unsigned int i = 0; i < m_num_inputs; i++)
+        {
+            m_batch_activation[i * a_batch_size + b] = a_inputs[b * m_num_inputs + i];
+        }
     }
-    // Loop the connections again. This time add the signals to the target neurons.
-    // This will largely require out of order memory writes. This is the one loop where
-    // this will happen.
-    for (unsigned int i = 0; i < m_connections.size(); i++)
+
+    if (m_plan_feedforward)
     {
-        m_neurons[m_connections[i].m_target_neuron_idx].m_activesum +=
-                m_connections[i].m_signal;
+        for (unsigned int l = 0; l + 1 < m_plan_layer_runs.size(); l++)
+        {
+            int t_first = m_plan_layer_runs[l];
+            int t_last = m_plan_layer_runs[l + 1];
+            PropagateSignalsBatch(m_plan_runs[t_first].m_start, m_plan_runs[t_last - 1].m_end, a_batch_size);
+            ApplyActivationRunsBatch(t_first, t_last, a_batch_size);
+        }
     }
-    // Now we have the leaky integrator step for the neurons
-    for (unsigned int i = m_num_inputs; i < m_neurons.size(); i++)
+    else
     {
-        double t_const = a_dtime / m_neurons[i].m_timeconst;
-        m_neurons[i].m_membrane_potential = (1.0 - t_const)
-                * m_neurons[i].m_membrane_potential
-                + t_const * m_neurons[i].m_activesum;
+        for (int d = 0; d < a_depth; d++)
+        {
+            PropagateSignalsBatch(0, m_plan_order.size(), a_batch_size);
+            ApplyActivationRunsBatch(0, m_plan_runs.size(), a_batch_size);
+        }
     }
-    // Now loop nodes_activesums, pass the signals through the activation function
-    // and store the result back to nodes_activations
-    // also skip inputs since they do not get an activation
-    for (unsigned int i = m_num_inputs; i < m_neurons.size(); i++)
+
+    a_outputs.resize(a_batch_size * m_num_outputs);
+    for (unsigned int b = 0; b < a_batch_size; b++)
     {
-        double x = m_neurons[i].m_membrane_potential + m_neurons[i].m_bias;
-        m_neurons[i].m_activesum = 0;
-        // Apply the activation function
-        double y = 0.0;
-        switch (m_neurons[i].m_activation_function_type)
+        for (unsigned int o = 0; o < m_num_outputs; o++)
         {
-        case SIGNED_SIGMOID:
-            y = af_sigmoid_signed(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_SIGMOID:
-            y = af_sigmoid_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case TANH:
-            y = af_tanh(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case TANH_CUBIC:
-            y = af_tanh_cubic(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case SIGNED_STEP:
-            y = af_step_signed(x, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_STEP:
-            y = af_step_unsigned(x, m_neurons[i].m_b);
-            break;
-        case SIGNED_GAUSS:
-            y = af_gauss_signed(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_GAUSS:
-            y = af_gauss_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case ABS:
-            y = af_abs(x, m_neurons[i].m_b);
-            break;
-        case SIGNED_SINE:
-            y = af_sine_signed(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case UNSIGNED_SINE:
-            y = af_sine_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
-        case LINEAR:
-            y = af_linear(x, m_neurons[i].m_b);
-            break;
-        case RELU:
-            y = af_relu(x);
-            break;
-        case SOFTPLUS:
-            y = af_softplus(x);
-            break;
-        default:
-            y = af_sigmoid_unsigned(x, m_neurons[i].m_a, m_neurons[i].m_b);
-            break;
+            a_outputs[b * m_num_outputs + o] = m_batch_activation[(m_num_inputs + o) * a_batch_size + b];
         }
-        m_neurons[i].m_activation = y;
+    }
+}
+
+std::vector< std::vector<double> > NeuralNetwork::ActivateBatch(const std::vector< std::vector<double> >& a_inputs,
+                                                                int a_depth)
+{
+    std::vector<double> t_inputs(a_inputs.size() * m_num_inputs, 0.0);
+    for (unsigned int b = 0; b < a_inputs.size(); b++)
+    {
+        // clip the sample to the number of inputs
+        unsigned int t_len = std::min((unsigned int)a_inputs[b].size(), m_num_inputs);
+        std::copy(a_inputs[b].begin(), a_inputs[b].begin() + t_len, t_inputs.begin() + b * m_num_inputs);
+    }
+
+    std::vector<double> t_outputs;
+    ActivateBatch(t_inputs, a_inputs.size(), t_outputs, a_depth);
+
+    std::vector< std::vector<double> > t_result(a_inputs.size());
+    for (unsigned int b = 0; b < a_inputs.size(); b++)
+    {
+        t_result[b].assign(t_outputs.begin() + b * m_num_outputs, t_outputs.begin() + (b + 1) * m_num_outputs);
+    }
+    return t_result;
+}
+
+bool NeuralNetwork::IsFeedForward()
+{
+    EnsureCompiled();
+    return m_plan_feedforward;
+}
+
+void NeuralNetwork::ActivateUseInternalBias()
+{
+    EnsureCompiled();
+    PropagateSignals(0, m_plan_order.size());
+
+    // add the bias to the sums
+    for (unsigned int s = 0; s < m_plan_order.size(); s++)
+    {
+        m_plan_activesum[s] += m_plan_bias[s];
+    }
+
+    ApplyActivationRuns(0, m_plan_runs.size());
+    SyncNeurons();
+}
+
+void NeuralNetwork::ActivateLeaky(double a_dtime)
+{
+    EnsureCompiled();
+    PropagateSignals(0, m_plan_order.size());
+
+    // Now we have the leaky integrator step for the neurons
+    // and the membrane potential plus the bias goes to the activation function
+    for (unsigned int s = 0; s < m_plan_order.size(); s++)
+    {
+        double t_const = a_dtime / m_plan_timeconst[s];
+        m_plan_membrane[s] = (1.0 - t_const) * m_plan_membrane[s] + t_const * m_plan_activesum[s];
+        m_plan_activesum[s] = m_plan_membrane[s] + m_plan_bias[s];
     }
 
+    ApplyActivationRuns(0, m_plan_runs.size());
+    SyncNeurons();
 }
 
 void NeuralNetwork::Flush()
@@ -579,15 +1055,19 @@ void NeuralNetwork::Flush()
         m_neurons[i].m_activesum = 0;
         m_neurons[i].m_membrane_potential = 0;
     }
+
+    if (m_compiled)
+    {
+        std::fill(m_plan_activation.begin(), m_plan_activation.end(), 0.0);
+        std::fill(m_plan_activesum.begin(), m_plan_activesum.end(), 0.0);
+        std::fill(m_plan_membrane.begin(), m_plan_membrane.end(), 0.0);
+    }
 }
 
 void NeuralNetwork::FlushCube()
 {
-    // clear the cube
-    for (unsigned int i = 0; i < m_neurons.size(); i++)
-        for (unsigned int j = 0; j < m_neurons.size(); j++)
-            for (unsigned int k = 0; k < m_neurons.size(); k++)
-                m_neurons[k].m_sensitivity_matrix[i][j] = 0;
+    // clear the sensitivities
+    std::fill(m_rtrl_sensitivity.begin(), m_rtrl_sensitivity.end(), 0.0);
 }
 void NeuralNetwork::Input(std::vector<double>& a_Inputs)
 {
@@ -601,6 +1081,14 @@ void NeuralNetwork::Input(std::vector<double>& a_Inputs)
     {
         m_neurons[i].m_activation = a_Inputs[i];
     }
+
+    if (m_compiled && (m_plan_activation.size() == m_neurons.size()))
+    {
+        for (unsigned int i = 0; i < mx; i++)
+        {
+            m_plan_activation[i] = a_Inputs[i];
+        }
+    }
 }
 
 #ifdef USE_BOOST_PYTHON
@@ -645,6 +1133,38 @@ void NeuralNetwork::Input_numpy(py::numeric::array& a_Inputs)
     Input(inp);
 }
 
+py::list NeuralNetwork::ActivateBatch_python(py::object& a_Inputs, int a_depth)
+{
+    int t_batch_size = py::len(a_Inputs);
+    std::vector<double> t_inputs(t_batch_size * m_num_inputs, 0.0);
+    for (int b = 0; b < t_batch_size; b++)
+    {
+        py::object t_row = a_Inputs[b];
+
+        // clip the sample to the number of inputs
+        int len = std::min((int)py::len(t_row), (int)m_num_inputs);
+        for (int i = 0; i < len; i++)
+        {
+            t_inputs[b * m_num_inputs + i] = py::extract<double>(t_row[i]);
+        }
+    }
+
+    std::vector<double> t_outputs;
+    ActivateBatch(t_inputs, t_batch_size, t_outputs, a_depth);
+
+    py::list t_result;
+    for (int b = 0; b < t_batch_size; b++)
+    {
+        py::list t_row;
+        for (unsigned int o = 0; o < m_num_outputs; o++)
+        {
+            t_row.append(t_outputs[b * m_num_outputs + o]);
+        }
+        t_result.append(t_row);
+    }
+    return t_result;
+}
+
 #endif
 
 std::vector<double> NeuralNetwork::Output()
@@ -657,147 +1177,223 @@ std::vector<double> NeuralNetwork::Output()
     return t_output;
 }
 
-void NeuralNetwork::Adapt(Parameters& a_Parameters)
+// The Hebbian rule for one connection with weight w from a source with activation x
+// to a target with activation y, where a_max is the largest absolute weight in the network.
+// Both cases are computed and the one for the sign of the weight is selected,
+// so the loops over the connections don't branch on the data.
+inline double HebbianWeight(double w, double x, double y, double a_hebb_rate, double a_hebb_pre_rate,
+                            double a_max, double a_clamp)
 {
+    // positive weight
+    double t_positive = w + ((a_hebb_rate * (a_max - w) * x * y)
+                             + a_hebb_pre_rate * a_max * x * (y - 1.0));
+
+    // negative weight
+    // In the inhibatory case, we strengthen the synapse when output is low and
+    // input is high
+    double t_negative = -(w + (a_hebb_pre_rate * (a_max - w) * x * (1.0 - y)
+                               - a_hebb_rate * a_max * x * y));
+
+    double t_w = (w > 0) ? t_positive : ((w < 0) ? t_negative : w);
+    return std::min(std::max(t_w, -a_clamp), a_clamp);
+}
+
+double NeuralNetwork::MaxAbsWeight()
+{
+    if (m_plan_max_weight_valid)
+    {
+        return m_plan_max_weight;
+    }
+
     // find max absolute magnitude of the weight
     double t_max_weight = -999999999;
-    for (unsigned int i = 0; i < m_connections.size(); i++)
+    for (unsigned int i = 0; i < m_plan_weight.size(); i++)
     {
-        if (fabs(m_connections[i].m_weight) > t_max_weight)
-        {
-            t_max_weight = fabs(m_connections[i].m_weight);
-        }
+        t_max_weight = std::max(t_max_weight, fabs(m_plan_weight[i]));
+    }
+    for (unsigned int i = 0; i < m_plan_input_connection.size(); i++)
+    {
+        t_max_weight = std::max(t_max_weight, fabs(m_connections[m_plan_input_connection[i]].m_weight));
     }
+    return t_max_weight;
+}
 
-    for (unsigned int i = 0; i < m_connections.size(); i++)
+double NeuralNetwork::AdaptPlan(double a_MaxAbsWeight, double a_Clamp, bool a_Propagate)
+{
+    const int* t_source = m_plan_source.data();
+    double* t_weight = m_plan_weight.data();
+    const double* t_hebb_rate = m_plan_hebb_rate.data();
+    const double* t_hebb_pre_rate = m_plan_hebb_pre_rate.data();
+    const double* t_activation = m_plan_activation.data();
+
+    double t_max_weight = -999999999;
+    for (unsigned int s = 0; s < m_plan_order.size(); s++)
     {
-        /////////////////////////////////////
-        // modify weight of that connection
-        ////
-        double t_incoming_neuron_activation =
-                m_neurons[m_connections[i].m_source_neuron_idx].m_activation;
-        double t_outgoing_neuron_activation =
-                m_neurons[m_connections[i].m_target_neuron_idx].m_activation;
-        if (m_connections[i].m_weight > 0) // positive weight
+        double t_target = t_activation[m_plan_order[s]];
+        double t_sum = 0;
+        for (int c = m_plan_in_start[s]; c < m_plan_in_start[s + 1]; c++)
         {
-            double t_delta = (m_connections[i].m_hebb_rate
-                    * (t_max_weight - m_connections[i].m_weight)
-                    * t_incoming_neuron_activation
-                    * t_outgoing_neuron_activation)
-                    + m_connections[i].m_hebb_pre_rate * t_max_weight
-                            * t_incoming_neuron_activation
-                            * (t_outgoing_neuron_activation - 1.0);
-            m_connections[i].m_weight = (m_connections[i].m_weight + t_delta);
+            double t_input = t_activation[t_source[c]];
+            t_sum += t_input * t_weight[c];
+            t_weight[c] = HebbianWeight(t_weight[c], t_input, t_target,
+                                        t_hebb_rate[c], t_hebb_pre_rate[c], a_MaxAbsWeight, a_Clamp);
+            t_max_weight = std::max(t_max_weight, fabs(t_weight[c]));
         }
-        else if (m_connections[i].m_weight < 0) // negative weight
+        if (a_Propagate)
         {
-            // In the inhibatory case, we strengthen the synapse when output is low and
-            // input is high
-            double t_delta = m_connections[i].m_hebb_pre_rate
-                    * (t_max_weight - m_connections[i].m_weight)
-                    * t_incoming_neuron_activation
-                    * (1.0 - t_outgoing_neuron_activation)
-                    - m_connections[i].m_hebb_rate * t_max_weight
-                            * t_incoming_neuron_activation
-                            * t_outgoing_neuron_activation;
-            m_connections[i].m_weight = -(m_connections[i].m_weight + t_delta);
+            m_plan_activesum[s] = t_sum;
         }
-
-        Clamp(m_connections[i].m_weight, -a_Parameters.MaxWeight,
-                a_Parameters.MaxWeight);
     }
+    return t_max_weight;
 }
 
-int NeuralNetwork::ConnectionExists(int a_to, int a_from)
+double NeuralNetwork::AdaptInputConnections(double a_MaxAbsWeight, double a_Clamp)
 {
-    for (unsigned int i = 0; i < m_connections.size(); i++)
+    double t_max_weight = -999999999;
+    for (unsigned int i = 0; i < m_plan_input_connection.size(); i++)
     {
-        if ((m_connections[i].m_source_neuron_idx == a_from)
-                && (m_connections[i].m_target_neuron_idx == a_to))
-        {
-            return i;
-        }
+        Connection& t_c = m_connections[m_plan_input_connection[i]];
+        t_c.m_weight = HebbianWeight(t_c.m_weight,
+                                     m_plan_activation[t_c.m_source_neuron_idx],
+                                     m_plan_activation[t_c.m_target_neuron_idx],
+                                     t_c.m_hebb_rate, t_c.m_hebb_pre_rate, a_MaxAbsWeight, a_Clamp);
+        t_max_weight = std::max(t_max_weight, fabs(t_c.m_weight));
     }
+    return t_max_weight;
+}
+
+void NeuralNetwork::Adapt(Parameters& a_Parameters)
+{
+    EnsureCompiled();
 
-    return -1;
+    // the largest weight after this change is found on the way and kept for the next one
+    double t_max_weight = MaxAbsWeight();
+    double t_new_max_weight = std::max(AdaptInputConnections(t_max_weight, a_Parameters.MaxWeight),
+                                       AdaptPlan(t_max_weight, a_Parameters.MaxWeight, false));
+    m_plan_max_weight = t_new_max_weight;
+    m_plan_max_weight_valid = true;
+
+    SyncConnectionWeights();
+}
+
+void NeuralNetwork::ActivateAdapt(Parameters& a_Parameters)
+{
+    EnsureCompiled();
+
+    double t_max_weight = MaxAbsWeight();
+    double t_new_max_weight = std::max(AdaptInputConnections(t_max_weight, a_Parameters.MaxWeight),
+                                       AdaptPlan(t_max_weight, a_Parameters.MaxWeight, true));
+    m_plan_max_weight = t_new_max_weight;
+    m_plan_max_weight_valid = true;
+
+    ApplyActivationRuns(0, m_plan_runs.size());
+    SyncNeurons();
+    SyncConnectionWeights();
 }
 
+// Updates the sensitivity p[k][ij] of every non-input neuron k to every learned connection j -> i:
+//     p[k][ij] = f'(k) * (sum over the sources l of k of w[kl] * p[l][ij]  +  (i == k ? activation of j : 0))
+// The neurons are updated in order and in place, so the sensitivities of the neurons before k
+// are already the new ones. A whole row of p is done at a time, along the learned connections.
 void NeuralNetwork::RTRL_update_gradients()
 {
+    ASSERT(m_rtrl_target_start.size() == (m_neurons.size() + 1));
+    unsigned int t_count = m_rtrl_connection.size();
+    if (t_count == 0)
+    {
+        return;
+    }
+
+    double* t_sum = &m_rtrl_sum[0];
+
     // for every neuron
     for (unsigned int k = m_num_inputs; k < m_neurons.size(); k++)
     {
-        // for all possible connections
-        for (unsigned int i = m_num_inputs; i < m_neurons.size(); i++)
-            // to
-            for (unsigned int j = 0; j < m_neurons.size(); j++) // from
+        //double t_derivative = unsigned_sigmoid_derivative( m_neurons[k].m_activation );
+        double t_derivative = 0;
+        if (m_neurons[k].m_activation_function_type
+                == NEAT::UNSIGNED_SIGMOID)
+        {
+            t_derivative = unsigned_sigmoid_derivative(
+                    m_neurons[k].m_activation);
+        }
+        else if (m_neurons[k].m_activation_function_type
+                == NEAT::TANH)
+        {
+            t_derivative = tanh_derivative(
+                    m_neurons[k].m_activation);
+        }
+
+        std::fill(t_sum, t_sum + t_count, 0.0);
+
+        // calculate the sums over the sources, in the order of the sources
+        // (the inputs have no sensitivities)
+        for (int c = m_rtrl_target_start[k]; c < m_rtrl_target_start[k + 1]; c++)
+        {
+            const Connection& t_in = m_connections[m_rtrl_connection[c]];
+            if (t_in.m_source_neuron_idx < (int)m_num_inputs)
             {
-                int t_idx = ConnectionExists(i, j);
-                if (t_idx != -1)
-                {
-                    //double t_derivative = unsigned_sigmoid_derivative( m_neurons[k].m_activation );
-                    double t_derivative = 0;
-                    if (m_neurons[k].m_activation_function_type
-                            == NEAT::UNSIGNED_SIGMOID)
-                    {
-                        t_derivative = unsigned_sigmoid_derivative(
-                                m_neurons[k].m_activation);
-                    }
-                    else if (m_neurons[k].m_activation_function_type
-                            == NEAT::TANH)
-                    {
-                        t_derivative = tanh_derivative(
-                                m_neurons[k].m_activation);
-                    }
-
-                    double t_sum = 0;
-                    // calculate the other sum
-                    for (unsigned int l = 0; l < m_neurons.size(); l++)
-                    {
-                        int t_l_idx = ConnectionExists(k, l);
-                        if (t_l_idx != -1)
-                        {
-                            t_sum += m_connections[t_l_idx].m_weight
-                                    * m_neurons[l].m_sensitivity_matrix[i][j];
-                        }
-                    }
-
-                    if (i == k)
-                    {
-                        t_sum += m_neurons[j].m_activation;
-                    }
-                    m_neurons[k].m_sensitivity_matrix[i][j] = t_derivative
-                            * t_sum;
-                }
-                else
-                {
-                    m_neurons[k].m_sensitivity_matrix[i][j] = 0;
-                }
+                continue;
             }
 
-    }
+            double t_weight = t_in.m_weight;
+            const double* t_p = &m_rtrl_sensitivity[(t_in.m_source_neuron_idx - m_num_inputs) * t_count];
+            for (unsigned int t = 0; t < t_count; t++)
+            {
+                t_sum[t] += t_weight * t_p[t];
+            }
+        }
 
+        // the connections into k itself
+        for (int c = m_rtrl_target_start[k]; c < m_rtrl_target_start[k + 1]; c++)
+        {
+            t_sum[c] += m_neurons[m_connections[m_rtrl_connection[c]].m_source_neuron_idx].m_activation;
+        }
+
+        double* t_p = &m_rtrl_sensitivity[(k - m_num_inputs) * t_count];
+        for (unsigned int t = 0; t < t_count; t++)
+        {
+            t_p[t] = t_derivative * t_sum[t];
+        }
+    }
 }
 
-// please pay attention. notice here only one output is assumed
 void NeuralNetwork::RTRL_update_error(double a_target)
 {
-    // add to total error
-    m_total_error = (a_target - Output()[0]);
+    std::vector<double> t_targets(1, a_target);
+    RTRL_update_error(t_targets);
+}
+
+// The outputs are the neurons right after the inputs, so the sensitivities of output o are at row o.
+// The total error is the sum of the absolute errors of the outputs, so errors of opposite sign don't cancel.
+void NeuralNetwork::RTRL_update_error(const std::vector<double>& a_targets)
+{
+    ASSERT(m_rtrl_target_start.size() == (m_neurons.size() + 1));
+    ASSERT(a_targets.size() <= m_num_outputs);
+    unsigned int t_count = m_rtrl_connection.size();
+
+    std::vector<double> t_outputs = Output();
+    std::vector<double> t_errors(a_targets.size());
+    m_total_error = 0;
+    for (unsigned int o = 0; o < a_targets.size(); o++)
+    {
+        t_errors[o] = a_targets[o] - t_outputs[o];
+        m_total_error += std::fabs(t_errors[o]);
+    }
+    if (a_targets.empty() || (t_count == 0))
+    {
+        return;
+    }
+
     // adjust each weight
-    for (unsigned int i = 0; i < m_neurons.size(); i++) // to
+    for (unsigned int t = 0; t < t_count; t++)
     {
-        for (unsigned int j = 0; j < m_neurons.size(); j++) // from
+        double t_delta = t_errors[0] * m_rtrl_sensitivity[t];
+        for (unsigned int o = 1; o < a_targets.size(); o++)
         {
-            int t_idx = ConnectionExists(i, j);
-            if (t_idx != -1)
-            {
-                // we know the first output's index is m_num_inputs
-                double t_delta = m_total_error
-                        * m_neurons[m_num_inputs].m_sensitivity_matrix[i][j];
-                m_total_weight_change[t_idx] += t_delta * LEARNING_RATE;
-            }
+            t_delta += t_errors[o] * m_rtrl_sensitivity[o * t_count + t];
         }
+        m_total_weight_change[m_rtrl_connection[t]] += t_delta * LEARNING_RATE;
     }
 }
 
@@ -809,6 +1405,8 @@ void NeuralNetwork::RTRL_update_weights()
         m_total_weight_change[i] = 0; // clear this out
     }
     m_total_error = 0;
+
+    SyncPlanWeights();
 }
 
 void NeuralNetwork::Save(const char* a_filename)
@@ -95,9 +95,6 @@ public:
     double m_split_y;
     NeuronType m_type;
 
-    // the sensitivity matrix of this neuron (for RTRL learning)
-    std::vector< std::vector< double > > m_sensitivity_matrix;
-
     // comparison operator (nessesary for boost::python)
     bool operator==(Neuron const& other) const
     {
@@ -112,18 +109,122 @@ public:
     }
 };
 
+// Sets a_activation[a_neuron[i]] = f(x[i], a[i], b[i]) for a_count values,
+// where f is the activation function a_type (see NeuralNetwork.cpp)
+void ActivateBlock(ActivationFunction a_type, int a_count,
+                   const double* x, const double* a, const double* b,
+                   const int* a_neuron, double* a_activation);
+// Same in single precision, where exp() (and so the sigmoids, tanh and gauss) is approximated
+void ActivateBlock(ActivationFunction a_type, int a_count,
+                   const float* x, const float* a, const float* b,
+                   const int* a_neuron, float* a_activation);
+
+class PopulationEvaluator;
+
 class NeuralNetwork
 {
+    // reads the compiled plan to copy it into its arena
+    friend class PopulationEvaluator;
+
     /////////////////////
     // RTRL variables
     double m_total_error;
 
     // Always the size of m_connections
     std::vector<double> m_total_weight_change;
+
+    // The sensitivities are kept only for the connections that RTRL learns, the first connection
+    // of every (target, source) pair whose target isn't an input, in the order of (target, source).
+    std::vector<int> m_rtrl_connection;   // learned connection -> index in m_connections
+    // The learned connections into neuron k are [m_rtrl_target_start[k], m_rtrl_target_start[k+1]),
+    // one for each distinct source, so they also give the weights the sensitivities flow through
+    std::vector<int> m_rtrl_target_start;
+    // The sensitivity of non-input neuron k to learned connection t is at
+    // [(k - m_num_inputs) * m_rtrl_connection.size() + t]
+    std::vector<double> m_rtrl_sensitivity;
+    std::vector<double> m_rtrl_sum; // one row of sums, used while updating
     /////////////////////
 
-    // returns the index if that connection exists or -1 otherwise
-    int ConnectionExists(int a_to, int a_from);
+    /////////////////////
+    // Compiled execution plan (see Compile())
+    bool m_compiled;
+    unsigned int m_plan_num_inputs;
+    unsigned int m_plan_num_connections;
+
+    // Every non-input neuron gets a slot in the plan. The slots are ordered
+    // by topological layer (for feed-forward networks, otherwise there is one layer),
+    // and within a layer so that neurons sharing an activation function are adjacent.
+    std::vector<int>    m_plan_order;      // slot -> neuron index
+    bool m_plan_feedforward;
+
+    // A run of consecutive slots whose neurons share the same activation function
+    struct ActivationRun
+    {
+        ActivationFunction m_type;
+        int m_start, m_end;
+    };
+    std::vector<ActivationRun> m_plan_runs;
+    // The runs of layer l are [m_plan_layer_runs[l], m_plan_layer_runs[l+1])
+    std::vector<int> m_plan_layer_runs;
+
+    // The connections as parallel arrays, sorted by target slot.
+    // The incoming connections of slot s are [m_plan_in_start[s], m_plan_in_start[s+1])
+    std::vector<int>    m_plan_source;
+    std::vector<double> m_plan_weight;
+    std::vector<int>    m_plan_connection; // index of the connection in m_connections
+    std::vector<int>    m_plan_in_start;   // size is number of slots + 1
+    std::vector<double> m_plan_hebb_rate;
+    std::vector<double> m_plan_hebb_pre_rate;
+    // the connections into input neurons are not in the plan, but the Hebbian rule still changes them
+    std::vector<int>    m_plan_input_connection;
+
+    // The largest absolute weight, carried over from the last Hebbian update,
+    // so the next update doesn't need a separate pass to find it
+    double m_plan_max_weight;
+    bool m_plan_max_weight_valid;
+
+    // Per-slot activation parameters, split out from the displaying data
+    std::vector<double> m_plan_a;
+    std::vector<double> m_plan_b;
+    std::vector<double> m_plan_bias;
+    std::vector<double> m_plan_timeconst;
+
+    // Per-slot state
+    std::vector<double> m_plan_activesum;  // also the input to the activation function
+    std::vector<double> m_plan_membrane;
+
+    // Per-neuron state (indexed by neuron, so the inputs can be read directly)
+    std::vector<double> m_plan_activation;
+
+    // recompiles if the topology was changed through the accessor methods
+    void EnsureCompiled();
+    // sums the incoming signals of the slots [a_start, a_end) into m_plan_activesum
+    void PropagateSignals(int a_start, int a_end);
+    // passes m_plan_activesum through the activation functions of the runs [a_first, a_last)
+    void ApplyActivationRuns(int a_first, int a_last);
+    // Applies the Hebbian rule to the plan's connections, where a_MaxAbsWeight is the largest
+    // absolute weight before the change and the weights are clamped to +/- a_Clamp.
+    // Also does what PropagateSignals() does over all slots if a_Propagate is true.
+    // Returns the largest absolute weight after the change.
+    double AdaptPlan(double a_MaxAbsWeight, double a_Clamp, bool a_Propagate);
+    // same for the connections into input neurons
+    double AdaptInputConnections(double a_MaxAbsWeight, double a_Clamp);
+    // the largest absolute weight, the carried over one if there is one
+    double MaxAbsWeight();
+    // copies the plan's weights back from m_connections
+    void SyncPlanWeights();
+    // copies the plan's weights to m_connections
+    void SyncConnectionWeights();
+    // copies the dense neuron state to m_neurons
+    void SyncNeurons();
+
+    // Batch state, the batch dimension is contiguous.
+    // The values of neuron i (slot s) are at [i*batch_size, (i+1)*batch_size)
+    std::vector<double> m_batch_activation; // per neuron
+    std::vector<double> m_batch_activesum;  // per slot
+    void PropagateSignalsBatch(int a_start, int a_end, unsigned int a_batch_size);
+    void ApplyActivationRunsBatch(int a_first, int a_last, unsigned int a_batch_size);
+    /////////////////////
 
 public:
 
@@ -134,23 +235,54 @@ public:
     NeuralNetwork(bool a_Minimal); // if given false, the constructor will create a standard XOR network topology.
     NeuralNetwork();
 
-    void InitRTRLMatrix(); // initializes the sensitivity cube for RTRL learning.
-    // assumes that neuron and connection data are already initialized
+    void InitRTRLMatrix(); // initializes the sensitivity tensor for RTRL learning.
+    // assumes that neuron and connection data are already initialized,
+    // call it again after the topology was changed
+
+    // Freezes the topology into the packed plan that the Activate* methods run from.
+    // Done automatically after AddNeuron()/AddConnection()/SetNeurons()/SetConnections()/
+    // EditNeurons()/EditConnections()/Clear()/Load(), but must be called again after m_neurons
+    // or m_connections (including the weights and Hebbian rates, which the plan keeps copies of)
+    // were edited directly, or through references kept from before the last activation.
+    void Compile();
+    bool IsCompiled() const { return m_compiled; }
 
     void ActivateFast();          // assumes unsigned sigmoids everywhere.
     void Activate();              // any activation functions are supported
     void ActivateUseInternalBias(); // like Activate() but uses m_bias as well
     void ActivateLeaky(double step); // activates in leaky integrator mode
 
+    // Activates a feed-forward network in a single pass, in topological order,
+    // so the outputs are exact after one call instead of depth calls to Activate().
+    // For networks with cycles this is the same as Activate().
+    void ActivateFeedForward();
+    bool IsFeedForward(); // true if the network has no cycles
+
+    // Evaluates a batch of independent samples, without touching the network's own state.
+    // a_inputs holds a_batch_size rows of NumInputs() values and a_outputs receives
+    // a_batch_size rows of NumOutputs() values. Every sample starts from a flushed network
+    // and is activated a_depth times like Activate(), or once with ActivateFeedForward()
+    // if the network has no cycles (a_depth is ignored then).
+    void ActivateBatch(const std::vector<double>& a_inputs, unsigned int a_batch_size,
+                       std::vector<double>& a_outputs, int a_depth);
+    // Same, with one vector per sample
+    std::vector< std::vector<double> > ActivateBatch(const std::vector< std::vector<double> >& a_inputs,
+                                                     int a_depth);
+
     void RTRL_update_gradients();
-    void RTRL_update_error(double a_target);
+    void RTRL_update_error(double a_target); // for the first output only
+    void RTRL_update_error(const std::vector<double>& a_targets); // one target per output
     void RTRL_update_weights();   // performs the backprop step
 
     // Hebbian learning
     void Adapt(Parameters& a_Parameters);
+    // Like Activate(), but applies the Hebbian rule of Adapt() in the same pass over the connections.
+    // The signals use the weights from before the change and the rule sees the activations
+    // from before this step (including the new inputs), so the change takes effect in the next step.
+    void ActivateAdapt(Parameters& a_Parameters);
 
     void Flush();     // clears all activations
-    void FlushCube(); // clears the sensitivity cube
+    void FlushCube(); // clears the sensitivity tensor
 
     void Input(std::vector<double>& a_Inputs);
 
@@ -158,14 +290,23 @@ public:
 
     void Input_python_list(py::list& a_Inputs);
     void Input_numpy(py::numeric::array& a_Inputs);
+    // takes a list of lists (or a 2D numpy array), returns a list of lists
+    py::list ActivateBatch_python(py::object& a_Inputs, int a_depth);
 
 #endif
 
     std::vector<double> Output();
 
     // accessor methods
-    void AddNeuron(const Neuron& a_n) { m_neurons.push_back( a_n ); }
-    void AddConnection(const Connection& a_c) { m_connections.push_back( a_c ); }
+    void AddNeuron(const Neuron& a_n) { m_neurons.push_back( a_n ); m_compiled = false; }
+    void AddConnection(const Connection& a_c) { m_connections.push_back( a_c ); m_compiled = false; }
+    // replace all neurons/connections, the plan is rebuilt on the next activation
+    void SetNeurons(const std::vector<Neuron>& a_neurons) { m_neurons = a_neurons; m_compiled = false; }
+    void SetConnections(const std::vector<Connection>& a_connections) { m_connections = a_connections; m_compiled = false; }
+    // give access to the neurons/connections for editing them in place (the Python properties use these),
+    // the plan is rebuilt on the next activation
+    std::vector<Neuron>& EditNeurons() { m_compiled = false; return m_neurons; }
+    std::vector<Connection>& EditConnections() { m_compiled = false; return m_connections; }
     Connection GetConnectionByIndex(unsigned int a_idx) const
     {
         return m_connections[a_idx];
@@ -195,6 +336,7 @@ public:
         m_connections.clear();
         m_total_weight_change.clear();
         SetInputOutputDimentions(0, 0);
+        m_compiled = false;
     }
 
     double GetConnectionLenght(Neuron source, Neuron target)
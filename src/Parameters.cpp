@@ -146,6 +146,12 @@ namespace NEAT
         // Fraction of individuals to be copied unchanged
         EliteFraction = 0.01;
 
+        // Number of threads to use (0 means one per hardware thread)
+        NumThreads = 1;
+
+        // Produce the offspring in parallel or not
+        ParallelReproduction = false;
+
 
 
 
@@ -207,6 +213,9 @@ namespace NEAT
         // Per how many evaluations to recompute the sparseness of the population
         NoveltySearch_Recompute_Sparseness_Each = 25;
 
+        // Search the archive with vantage point trees
+        NoveltySearch_VPTree = false;
+
 
 
 
@@ -586,6 +595,18 @@ namespace NEAT
                     RouletteWheelSelection = false;
             }
 
+            if (s == "NumThreads")
+                a_DataFile >> NumThreads;
+
+            if (s == "ParallelReproduction")
+            {
+                a_DataFile >> tf;
+                if (tf == "true" || tf == "1" || tf == "1.0")
+                    ParallelReproduction = true;
+                else
+                    ParallelReproduction = false;
+            }
+
             if (s == "PhasedSearching")
             {
                 a_DataFile >> tf;
@@ -646,6 +667,15 @@ namespace NEAT
             if (s == "NoveltySearch_Recompute_Sparseness_Each")
                 a_DataFile >> NoveltySearch_Recompute_Sparseness_Each;
 
+            if (s == "NoveltySearch_VPTree")
+            {
+                a_DataFile >> tf;
+                if (tf == "true" || tf == "1" || tf == "1.0")
+                    NoveltySearch_VPTree = true;
+                else
+                    NoveltySearch_VPTree = false;
+            }
+
             if (s == "MutateAddNeuronProb")
                 a_DataFile >> MutateAddNeuronProb;
 
@@ -975,6 +1005,8 @@ namespace NEAT
         fprintf(a_fstream, "InterspeciesCrossoverRate %3.20f\n", InterspeciesCrossoverRate);
         fprintf(a_fstream, "MultipointCrossoverRate %3.20f\n", MultipointCrossoverRate);
         fprintf(a_fstream, "RouletteWheelSelection %s\n", RouletteWheelSelection == true ? "true" : "false");
+        fprintf(a_fstream, "NumThreads %d\n", NumThreads);
+        fprintf(a_fstream, "ParallelReproduction %s\n", ParallelReproduction == true ? "true" : "false");
         fprintf(a_fstream, "PhasedSearching %s\n", PhasedSearching == true ? "true" : "false");
         fprintf(a_fstream, "DeltaCoding %s\n", DeltaCoding == true ? "true" : "false");
         fprintf(a_fstream, "SimplifyingPhaseMPCTreshold %d\n", SimplifyingPhaseMPCTreshold);
@@ -991,6 +1023,7 @@ namespace NEAT
                 NoveltySearch_Quick_Archiving_Min_Evaluations);
         fprintf(a_fstream, "NoveltySearch_Pmin_raising_multiplier %3.20f\n", NoveltySearch_Pmin_raising_multiplier);
         fprintf(a_fstream, "NoveltySearch_Recompute_Sparseness_Each %d\n", NoveltySearch_Recompute_Sparseness_Each);
+        fprintf(a_fstream, "NoveltySearch_VPTree %s\n", NoveltySearch_VPTree == true ? "true" : "false");
         fprintf(a_fstream, "MutateAddNeuronProb %3.20f\n", MutateAddNeuronProb);
         fprintf(a_fstream, "SplitRecurrent %s\n", SplitRecurrent == true ? "true" : "false");
         fprintf(a_fstream, "SplitLoopedRecurrent %s\n", SplitLoopedRecurrent == true ? "true" : "false");
@@ -1079,5 +1112,17 @@ namespace NEAT
         fprintf(a_fstream, "NEAT_ParametersEnd\n");
     }
 
+    void Parameters::InternTraits()
+    {
+        std::map<std::string, TraitParameters>* t_maps[3] = { &NeuronTraits, &LinkTraits, &GenomeTraits };
+        for(int i=0; i<3; i++)
+        {
+            for(auto it = t_maps[i]->begin(); it != t_maps[i]->end(); it++)
+            {
+                it->second.Intern(it->first);
+            }
+        }
+    }
+
 
 } // namespace NEAT
@@ -165,6 +165,14 @@ public:
     // Fraction of individuals to be copied unchanged
     double EliteFraction;
 
+    // Number of threads to use (0 means one per hardware thread)
+    unsigned int NumThreads;
+
+    // Produce the offspring of an epoch in parallel, using NumThreads threads.
+    // The result depends only on the seed, not on the number of threads,
+    // but is different from the serial reproduction.
+    bool ParallelReproduction;
+
 
 
     ///////////////////////////////////
@@ -221,6 +229,10 @@ public:
     // Per how many evaluations to recompute the sparseness
     unsigned int NoveltySearch_Recompute_Sparseness_Each;
 
+    // Search the archive with vantage point trees instead of measuring the distance to every behavior.
+    // Only for behaviors whose Distance_To() is a metric (symmetric, obeys the triangle inequality).
+    bool NoveltySearch_VPTree;
+
 
     ///////////////////////////////////
     // Mutation parameters
@@ -468,6 +480,10 @@ public:
 
     // resets the parameters to built-in defaults
     void Reset();
+
+    // Interns the names of all trait parameters (see TraitParameters::Intern()).
+    // Call it after editing the trait maps directly.
+    void InternTraits();
     
 #ifdef USE_BOOST_PYTHON
 
@@ -714,16 +730,19 @@ public:
     void SetNeuronTraitParameters(std::string name, py::dict trait_params)
     {
         NeuronTraits[name] = TraitParamsFromDict(trait_params);
+        NeuronTraits[name].Intern(name);
     }
 
     void SetLinkTraitParameters(std::string name, py::dict trait_params)
     {
         LinkTraits[name] = TraitParamsFromDict(trait_params);
+        LinkTraits[name].Intern(name);
     }
     
     void SetGenomeTraitParameters(std::string name, py::dict trait_params)
     {
         GenomeTraits[name] = TraitParamsFromDict(trait_params);
+        GenomeTraits[name].Intern(name);
     }
     
     py::list ListNeuronTraitParameters()
@@ -933,6 +952,10 @@ public:
         ar & EliteFraction;
 
         ar & ArchiveEnforcement;
+
+        ar & NumThreads;
+        ar & ParallelReproduction;
+        ar & NoveltySearch_VPTree;
     }
     
 #endif
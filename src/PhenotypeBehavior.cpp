@@ -29,9 +29,453 @@
 
 
 
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
 #include "PhenotypeBehavior.h"
 
 namespace NEAT
 {
 
+///////////////////////////////////////////////////////////////////////////////
+// Built-in behaviors
+///////////////////////////////////////////////////////////////////////////////
+
+// The vector of a built-in behavior, empty if it has no data yet
+static const std::vector<double>& BehaviorVector(const PhenotypeBehavior* a_Behavior)
+{
+    static const std::vector<double> t_empty;
+    return a_Behavior->m_Data.empty() ? t_empty : a_Behavior->m_Data[0];
+}
+
+// The batch distances take the others by value or by pointer
+static PhenotypeBehavior* Item(std::vector< PhenotypeBehavior >& a_Others, unsigned int a_Index)
+{
+    return &a_Others[a_Index];
+}
+static PhenotypeBehavior* Item(std::vector< PhenotypeBehavior* >& a_Others, unsigned int a_Index)
+{
+    return a_Others[a_Index];
+}
+
+// The size of both vectors, they must be of the same size
+static unsigned int CommonSize(const std::vector<double>& a_A, const std::vector<double>& a_B)
+{
+    if (a_A.size() != a_B.size())
+    {
+        throw std::runtime_error("Behaviors of different sizes");
+    }
+    return a_A.size();
+}
+
+// The kernels keep four independent sums so the compiler can unroll and vectorize the loops
+static double ManhattanKernel(const double* a_A, const double* a_B, unsigned int a_Size)
+{
+    double t_s0 = 0, t_s1 = 0, t_s2 = 0, t_s3 = 0;
+    unsigned int i = 0;
+    for(; (i+4) <= a_Size; i += 4)
+    {
+        t_s0 += std::fabs(a_A[i  ] - a_B[i  ]);
+        t_s1 += std::fabs(a_A[i+1] - a_B[i+1]);
+        t_s2 += std::fabs(a_A[i+2] - a_B[i+2]);
+        t_s3 += std::fabs(a_A[i+3] - a_B[i+3]);
+    }
+    for(; i < a_Size; i++)
+    {
+        t_s0 += std::fabs(a_A[i] - a_B[i]);
+    }
+    return (t_s0 + t_s1) + (t_s2 + t_s3);
+}
+
+static double SquaredEuclideanKernel(const double* a_A, const double* a_B, unsigned int a_Size)
+{
+    double t_s0 = 0, t_s1 = 0, t_s2 = 0, t_s3 = 0;
+    unsigned int i = 0;
+    for(; (i+4) <= a_Size; i += 4)
+    {
+        double t_d0 = a_A[i  ] - a_B[i  ];
+        double t_d1 = a_A[i+1] - a_B[i+1];
+        double t_d2 = a_A[i+2] - a_B[i+2];
+        double t_d3 = a_A[i+3] - a_B[i+3];
+        t_s0 += t_d0 * t_d0;
+        t_s1 += t_d1 * t_d1;
+        t_s2 += t_d2 * t_d2;
+        t_s3 += t_d3 * t_d3;
+    }
+    for(; i < a_Size; i++)
+    {
+        double t_d = a_A[i] - a_B[i];
+        t_s0 += t_d * t_d;
+    }
+    return (t_s0 + t_s1) + (t_s2 + t_s3);
+}
+
+static double DotKernel(const double* a_A, const double* a_B, unsigned int a_Size)
+{
+    double t_s0 = 0, t_s1 = 0, t_s2 = 0, t_s3 = 0;
+    unsigned int i = 0;
+    for(; (i+4) <= a_Size; i += 4)
+    {
+        t_s0 += a_A[i  ] * a_B[i  ];
+        t_s1 += a_A[i+1] * a_B[i+1];
+        t_s2 += a_A[i+2] * a_B[i+2];
+        t_s3 += a_A[i+3] * a_B[i+3];
+    }
+    for(; i < a_Size; i++)
+    {
+        t_s0 += a_A[i] * a_B[i];
+    }
+    return (t_s0 + t_s1) + (t_s2 + t_s3);
+}
+
+static double CosineFromDot(double a_Dot, double a_NormA, double a_NormB)
+{
+    if ((a_NormA == 0) || (a_NormB == 0))
+    {
+        return ((a_NormA == 0) && (a_NormB == 0)) ? 0 : 1;
+    }
+    double t_cos = a_Dot / (a_NormA * a_NormB);
+    // rounding may take it slightly out of range
+    t_cos = std::max(-1.0, std::min(1.0, t_cos));
+    return 1 - t_cos;
+}
+
+double ManhattanBehavior::Distance_To(PhenotypeBehavior* a_Other)
+{
+    const std::vector<double>& t_a = BehaviorVector(this);
+    const std::vector<double>& t_b = BehaviorVector(a_Other);
+    unsigned int t_size = CommonSize(t_a, t_b);
+    return (t_size == 0) ? 0 : ManhattanKernel(&t_a[0], &t_b[0], t_size);
+}
+
+template<class Others>
+static void ManhattanDistances(PhenotypeBehavior* a_This, Others& a_Others, std::vector<double>& a_Distances)
+{
+    const std::vector<double>& t_a = BehaviorVector(a_This);
+    unsigned int t_size = t_a.size();
+    for(unsigned int i=0; i<a_Others.size(); i++)
+    {
+        const std::vector< std::vector<double> >& t_data = Item(a_Others, i)->m_Data;
+        if ((t_size == 0) || t_data.empty() || (t_data[0].size() != t_size))
+        {
+            a_Distances.push_back( a_This->Distance_To(Item(a_Others, i)) );
+            continue;
+        }
+        a_Distances.push_back( ManhattanKernel(&t_a[0], &t_data[0][0], t_size) );
+    }
+}
+
+void ManhattanBehavior::Distances_To(std::vector< PhenotypeBehavior >& a_Others, std::vector<double>& a_Distances)
+{
+    ManhattanDistances(this, a_Others, a_Distances);
+}
+
+void ManhattanBehavior::Distances_To(std::vector< PhenotypeBehavior* >& a_Others, std::vector<double>& a_Distances)
+{
+    ManhattanDistances(this, a_Others, a_Distances);
+}
+
+double EuclideanBehavior::Distance_To(PhenotypeBehavior* a_Other)
+{
+    const std::vector<double>& t_a = BehaviorVector(this);
+    const std::vector<double>& t_b = BehaviorVector(a_Other);
+    unsigned int t_size = CommonSize(t_a, t_b);
+    return (t_size == 0) ? 0 : std::sqrt(SquaredEuclideanKernel(&t_a[0], &t_b[0], t_size));
+}
+
+template<class Others>
+static void EuclideanDistances(PhenotypeBehavior* a_This, Others& a_Others, std::vector<double>& a_Distances)
+{
+    const std::vector<double>& t_a = BehaviorVector(a_This);
+    unsigned int t_size = t_a.size();
+    for(unsigned int i=0; i<a_Others.size(); i++)
+    {
+        const std::vector< std::vector<double> >& t_data = Item(a_Others, i)->m_Data;
+        if ((t_size == 0) || t_data.empty() || (t_data[0].size() != t_size))
+        {
+            a_Distances.push_back( a_This->Distance_To(Item(a_Others, i)) );
+            continue;
+        }
+        a_Distances.push_back( std::sqrt(SquaredEuclideanKernel(&t_a[0], &t_data[0][0], t_size)) );
+    }
+}
+
+void EuclideanBehavior::Distances_To(std::vector< PhenotypeBehavior >& a_Others, std::vector<double>& a_Distances)
+{
+    EuclideanDistances(this, a_Others, a_Distances);
+}
+
+void EuclideanBehavior::Distances_To(std::vector< PhenotypeBehavior* >& a_Others, std::vector<double>& a_Distances)
+{
+    EuclideanDistances(this, a_Others, a_Distances);
+}
+
+double CosineBehavior::Distance_To(PhenotypeBehavior* a_Other)
+{
+    const std::vector<double>& t_a = BehaviorVector(this);
+    const std::vector<double>& t_b = BehaviorVector(a_Other);
+    unsigned int t_size = CommonSize(t_a, t_b);
+    if (t_size == 0)
+    {
+        return 0;
+    }
+    return CosineFromDot(DotKernel(&t_a[0], &t_b[0], t_size),
+                         std::sqrt(DotKernel(&t_a[0], &t_a[0], t_size)),
+                         std::sqrt(DotKernel(&t_b[0], &t_b[0], t_size)));
+}
+
+template<class Others>
+static void CosineDistances(PhenotypeBehavior* a_This, Others& a_Others, std::vector<double>& a_Distances)
+{
+    const std::vector<double>& t_a = BehaviorVector(a_This);
+    // our own norm is the same for all
+    double t_norm = t_a.empty() ? 0 : std::sqrt(DotKernel(&t_a[0], &t_a[0], t_a.size()));
+    unsigned int t_size = t_a.size();
+    for(unsigned int i=0; i<a_Others.size(); i++)
+    {
+        const std::vector< std::vector<double> >& t_data = Item(a_Others, i)->m_Data;
+        if ((t_size == 0) || t_data.empty() || (t_data[0].size() != t_size))
+        {
+            a_Distances.push_back( a_This->Distance_To(Item(a_Others, i)) );
+            continue;
+        }
+        const double* t_b = &t_data[0][0];
+        a_Distances.push_back( CosineFromDot(DotKernel(&t_a[0], t_b, t_size), t_norm,
+                                             std::sqrt(DotKernel(t_b, t_b, t_size))) );
+    }
+}
+
+void CosineBehavior::Distances_To(std::vector< PhenotypeBehavior >& a_Others, std::vector<double>& a_Distances)
+{
+    CosineDistances(this, a_Others, a_Distances);
+}
+
+void CosineBehavior::Distances_To(std::vector< PhenotypeBehavior* >& a_Others, std::vector<double>& a_Distances)
+{
+    CosineDistances(this, a_Others, a_Distances);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Behavior indexes
+///////////////////////////////////////////////////////////////////////////////
+
+LinearBehaviorIndex::LinearBehaviorIndex()
+{
+    m_Archive = NULL;
+}
+
+void LinearBehaviorIndex::Update(std::vector< PhenotypeBehavior >& a_Archive, PhenotypeBehavior* /*a_Measure*/)
+{
+    m_Archive = &a_Archive;
+}
+
+void LinearBehaviorIndex::Nearest(PhenotypeBehavior* a_Behavior, unsigned int a_K, std::vector<double>& a_Distances)
+{
+    ASSERT(m_Archive != NULL);
+
+    m_Buffer.clear();
+    m_Buffer.reserve(m_Archive->size());
+    a_Behavior->Distances_To(*m_Archive, m_Buffer);
+
+    // only the K smallest are needed, not their order
+    if (a_K < m_Buffer.size())
+    {
+        std::nth_element(m_Buffer.begin(), m_Buffer.begin() + a_K, m_Buffer.end());
+        m_Buffer.resize(a_K);
+    }
+    a_Distances.insert(a_Distances.end(), m_Buffer.begin(), m_Buffer.end());
+}
+
+
+VPTreeBehaviorIndex::VPTreeBehaviorIndex()
+{
+    m_Archive = NULL;
+    m_Count = 0;
+}
+
+void VPTreeBehaviorIndex::Update(std::vector< PhenotypeBehavior >& a_Archive, PhenotypeBehavior* a_Measure)
+{
+    if ((m_Archive != &a_Archive) || (a_Archive.size() < m_Count))
+    {
+        m_Archive = &a_Archive;
+        m_Count = 0;
+        m_Trees.clear();
+    }
+
+    while(m_Count < a_Archive.size())
+    {
+        Tree t_tree;
+        t_tree.m_Items.push_back(m_Count);
+        m_Count++;
+
+        // merge with the trees of the same size, like carrying when counting in binary
+        while((!m_Trees.empty()) && (m_Trees.back().m_Items.size() == t_tree.m_Items.size()))
+        {
+            t_tree.m_Items.insert(t_tree.m_Items.end(), m_Trees.back().m_Items.begin(), m_Trees.back().m_Items.end());
+            m_Trees.pop_back();
+        }
+
+        Build(t_tree, 0, t_tree.m_Items.size(), a_Measure);
+        m_Trees.push_back(t_tree);
+    }
+}
+
+// Swaps the data of two behaviors for as long as it lives, so the data is
+// swapped back even if a Distance_To() in between throws
+class ScopedDataSwap
+{
+public:
+    ScopedDataSwap(PhenotypeBehavior& a_A, PhenotypeBehavior& a_B)
+        : m_A(a_A), m_B(a_B)
+    {
+        m_A.m_Data.swap(m_B.m_Data);
+    }
+    ~ScopedDataSwap()
+    {
+        m_A.m_Data.swap(m_B.m_Data);
+    }
+
+private:
+    PhenotypeBehavior& m_A;
+    PhenotypeBehavior& m_B;
+
+    ScopedDataSwap(const ScopedDataSwap&);
+    ScopedDataSwap& operator=(const ScopedDataSwap&);
+};
+
+// Makes a node of the first item in the range and puts the rest below it.
+// Returns the node's index or -1 for an empty range.
+int VPTreeBehaviorIndex::Build(Tree& a_Tree, unsigned int a_Begin, unsigned int a_End, PhenotypeBehavior* a_Measure)
+{
+    if (a_Begin >= a_End)
+    {
+        return -1;
+    }
+
+    Node t_node;
+    t_node.m_Item = a_Tree.m_Items[a_Begin];
+    t_node.m_Radius = 0;
+    t_node.m_Inside = -1;
+    t_node.m_Outside = -1;
+    int t_idx = a_Tree.m_Nodes.size();
+    a_Tree.m_Nodes.push_back(t_node);
+
+    if ((a_End - a_Begin) == 1)
+    {
+        return t_idx;
+    }
+
+    // split the rest at the median distance from the vantage point,
+    // a_Measure stands in for it with its data
+    m_Pairs.clear();
+    {
+        ScopedDataSwap t_swap(*a_Measure, (*m_Archive)[t_node.m_Item]);
+        for(unsigned int i=a_Begin+1; i<a_End; i++)
+        {
+            unsigned int t_item = a_Tree.m_Items[i];
+            m_Pairs.push_back( std::make_pair( a_Measure->Distance_To( &((*m_Archive)[t_item]) ), t_item ) );
+        }
+    }
+    unsigned int t_median = m_Pairs.size() / 2;
+    std::nth_element(m_Pairs.begin(), m_Pairs.begin() + t_median, m_Pairs.end());
+    double t_radius = m_Pairs[t_median].first;
+    for(unsigned int i=0; i<m_Pairs.size(); i++)
+    {
+        a_Tree.m_Items[a_Begin + 1 + i] = m_Pairs[i].second;
+    }
+
+    unsigned int t_split = a_Begin + 1 + t_median + 1;
+    int t_inside = Build(a_Tree, a_Begin + 1, t_split, a_Measure);
+    int t_outside = Build(a_Tree, t_split, a_End, a_Measure);
+
+    a_Tree.m_Nodes[t_idx].m_Radius = t_radius;
+    a_Tree.m_Nodes[t_idx].m_Inside = t_inside;
+    a_Tree.m_Nodes[t_idx].m_Outside = t_outside;
+    return t_idx;
+}
+
+// How far the K-th nearest distance found so far is, with a little room for rounding errors
+// in distances of about a_Scale. Anything is in reach until K were found.
+double VPTreeBehaviorIndex::Reach(unsigned int a_K, double a_Scale) const
+{
+    if (m_Heap.size() < a_K)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    return m_Heap.front() + 1e-9 * (m_Heap.front() + a_Scale) + 1e-12;
+}
+
+void VPTreeBehaviorIndex::Search(const Tree& a_Tree, int a_Node, PhenotypeBehavior* a_Behavior, unsigned int a_K)
+{
+    if (a_Node == -1)
+    {
+        return;
+    }
+
+    const Node& t_node = a_Tree.m_Nodes[a_Node];
+    double t_dist = a_Behavior->Distance_To( &((*m_Archive)[t_node.m_Item]) );
+
+    // m_Heap keeps the K smallest distances so far, the largest of them on top
+    if (m_Heap.size() < a_K)
+    {
+        m_Heap.push_back(t_dist);
+        std::push_heap(m_Heap.begin(), m_Heap.end());
+    }
+    else if (t_dist < m_Heap.front())
+    {
+        std::pop_heap(m_Heap.begin(), m_Heap.end());
+        m_Heap.back() = t_dist;
+        std::push_heap(m_Heap.begin(), m_Heap.end());
+    }
+
+    // A subtree is skipped only if the triangle inequality puts all of it farther than the K-th nearest
+    double t_tau = Reach(a_K, t_dist + t_node.m_Radius);
+
+    if (t_dist <= t_node.m_Radius)
+    {
+        if ((t_dist - t_tau) <= t_node.m_Radius)
+        {
+            Search(a_Tree, t_node.m_Inside, a_Behavior, a_K);
+        }
+
+        t_tau = Reach(a_K, t_dist + t_node.m_Radius);
+        if ((t_dist + t_tau) >= t_node.m_Radius)
+        {
+            Search(a_Tree, t_node.m_Outside, a_Behavior, a_K);
+        }
+    }
+    else
+    {
+        if ((t_dist + t_tau) >= t_node.m_Radius)
+        {
+            Search(a_Tree, t_node.m_Outside, a_Behavior, a_K);
+        }
+
+        t_tau = Reach(a_K, t_dist + t_node.m_Radius);
+        if ((t_dist - t_tau) <= t_node.m_Radius)
+        {
+            Search(a_Tree, t_node.m_Inside, a_Behavior, a_K);
+        }
+    }
+}
+
+void VPTreeBehaviorIndex::Nearest(PhenotypeBehavior* a_Behavior, unsigned int a_K, std::vector<double>& a_Distances)
+{
+    ASSERT(m_Archive != NULL);
+
+    if (a_K == 0)
+    {
+        return;
+    }
+
+    m_Heap.clear();
+    for(unsigned int i=0; i<m_Trees.size(); i++)
+    {
+        Search(m_Trees[i], 0, a_Behavior, a_K);
+    }
+    a_Distances.insert(a_Distances.end(), m_Heap.begin(), m_Heap.end());
+}
+
 };
@@ -65,6 +65,24 @@ public:
         return 0;
     }
 
+    // Appends to a_Distances the distance to each behavior in a_Others, in the same order.
+    // Overload it to measure many behaviors without a virtual call for each one.
+    virtual void Distances_To(std::vector< PhenotypeBehavior >& a_Others, std::vector<double>& a_Distances)
+    {
+        for(unsigned int i=0; i<a_Others.size(); i++)
+        {
+            a_Distances.push_back( Distance_To(&(a_Others[i])) );
+        }
+    }
+    // The same for behaviors kept elsewhere, like the ones of the population
+    virtual void Distances_To(std::vector< PhenotypeBehavior* >& a_Others, std::vector<double>& a_Distances)
+    {
+        for(unsigned int i=0; i<a_Others.size(); i++)
+        {
+            a_Distances.push_back( Distance_To(a_Others[i]) );
+        }
+    }
+
     // This method tells us whether the behavior is the one
     // we're looking for. Not necessary to call/overload this in open-ended evolution
     virtual bool   Successful()
@@ -79,6 +97,120 @@ public:
 };
 
 
+// Built-in behaviors made of a single vector of numbers, m_Data[0], all of the same size
+// (measuring behaviors of different sizes throws std::runtime_error).
+// Derive from one of them and overload only Acquire() (and Successful()) to fill m_Data[0],
+// the distances are computed in place without calling back into the derived class.
+
+// Sum of absolute differences
+class ManhattanBehavior : public PhenotypeBehavior
+{
+public:
+    ManhattanBehavior(unsigned int a_Size = 0) { m_Data.assign(1, std::vector<double>(a_Size, 0)); }
+
+    virtual double Distance_To(PhenotypeBehavior* a_Other);
+    virtual void Distances_To(std::vector< PhenotypeBehavior >& a_Others, std::vector<double>& a_Distances);
+    virtual void Distances_To(std::vector< PhenotypeBehavior* >& a_Others, std::vector<double>& a_Distances);
+};
+
+// Straight line distance
+class EuclideanBehavior : public PhenotypeBehavior
+{
+public:
+    EuclideanBehavior(unsigned int a_Size = 0) { m_Data.assign(1, std::vector<double>(a_Size, 0)); }
+
+    virtual double Distance_To(PhenotypeBehavior* a_Other);
+    virtual void Distances_To(std::vector< PhenotypeBehavior >& a_Others, std::vector<double>& a_Distances);
+    virtual void Distances_To(std::vector< PhenotypeBehavior* >& a_Others, std::vector<double>& a_Distances);
+};
+
+// 1 - cosine of the angle between the vectors, 0 to 2. A zero vector is at distance 1 from the rest.
+// Not a metric, so don't use it with NoveltySearch_VPTree.
+class CosineBehavior : public PhenotypeBehavior
+{
+public:
+    CosineBehavior(unsigned int a_Size = 0) { m_Data.assign(1, std::vector<double>(a_Size, 0)); }
+
+    virtual double Distance_To(PhenotypeBehavior* a_Other);
+    virtual void Distances_To(std::vector< PhenotypeBehavior >& a_Others, std::vector<double>& a_Distances);
+    virtual void Distances_To(std::vector< PhenotypeBehavior* >& a_Others, std::vector<double>& a_Distances);
+};
+
+
+// Finds the behaviors in an archive that are nearest to a behavior, as measured by Distance_To().
+// Archives only grow, so the index keeps up by looking at the behaviors added since the last Update().
+class BehaviorIndex
+{
+public:
+    virtual ~BehaviorIndex(){};
+
+    // Brings the index up to date with a_Archive. Starts over if it shrank or is another archive.
+    // The archive may hold copies made as the base class, so distances between archived behaviors
+    // are measured by a_Measure, a behavior of the right class. Its m_Data is borrowed during the call.
+    virtual void Update(std::vector< PhenotypeBehavior >& a_Archive, PhenotypeBehavior* a_Measure) = 0;
+
+    // Appends to a_Distances the distances from a_Behavior to its a_K nearest behaviors in the archive.
+    // They are appended in no particular order.
+    virtual void Nearest(PhenotypeBehavior* a_Behavior, unsigned int a_K, std::vector<double>& a_Distances) = 0;
+};
+
+
+// Measures the distance to every behavior, works with any Distance_To()
+class LinearBehaviorIndex : public BehaviorIndex
+{
+public:
+    LinearBehaviorIndex();
+
+    virtual void Update(std::vector< PhenotypeBehavior >& a_Archive, PhenotypeBehavior* a_Measure);
+    virtual void Nearest(PhenotypeBehavior* a_Behavior, unsigned int a_K, std::vector<double>& a_Distances);
+
+private:
+    std::vector< PhenotypeBehavior >* m_Archive;
+    std::vector<double> m_Buffer;
+};
+
+
+// Vantage point trees, they skip most of the archive but Distance_To() must be a metric
+// (symmetric, and obeying the triangle inequality), like the euclidean distance.
+// The behaviors are kept in trees of 1, 2, 4, 8.. behaviors. Two trees of the same size
+// are merged into one, so adding is cheap on average and no tree goes out of balance.
+class VPTreeBehaviorIndex : public BehaviorIndex
+{
+public:
+    VPTreeBehaviorIndex();
+
+    virtual void Update(std::vector< PhenotypeBehavior >& a_Archive, PhenotypeBehavior* a_Measure);
+    virtual void Nearest(PhenotypeBehavior* a_Behavior, unsigned int a_K, std::vector<double>& a_Distances);
+
+private:
+    struct Node
+    {
+        unsigned int m_Item;   // the vantage point, index in the archive
+        double m_Radius;       // median distance from it to the items below
+        int m_Inside;          // items not farther than m_Radius, -1 if none
+        int m_Outside;         // items not nearer than m_Radius, -1 if none
+    };
+
+    struct Tree
+    {
+        std::vector<unsigned int> m_Items;
+        std::vector<Node> m_Nodes;
+    };
+
+    int Build(Tree& a_Tree, unsigned int a_Begin, unsigned int a_End, PhenotypeBehavior* a_Measure);
+    void Search(const Tree& a_Tree, int a_Node, PhenotypeBehavior* a_Behavior, unsigned int a_K);
+    double Reach(unsigned int a_K, double a_Scale) const;
+
+    std::vector< PhenotypeBehavior >* m_Archive;
+    unsigned int m_Count;
+    std::vector<Tree> m_Trees;
+
+    // used while building and searching
+    std::vector< std::pair<double, unsigned int> > m_Pairs;
+    std::vector<double> m_Heap;
+};
+
+
 };
 
 
@@ -40,6 +40,7 @@
 #include "Population.h"
 #include "Utils.h"
 #include "Assert.h"
+#include "ThreadPool.h"
 
 
 namespace NEAT
@@ -52,6 +53,7 @@ Population::Population(const Genome& a_Seed, const Parameters& a_Parameters,
     m_RNG.Seed(a_RNG_seed);
     m_BestFitnessEver = 0.0;
     m_Parameters = a_Parameters;
+    m_Parameters.InternTraits();
 
     m_Generation = 0;
     m_NumEvaluations = 0;
@@ -94,7 +96,7 @@ Population::Population(const Genome& a_Seed, const Parameters& a_Parameters,
                     {
                         if (i != j) // don't compare the same genome
                         {
-                            if (m_Genomes[i].CompatibilityDistance(m_Genomes[j], m_Parameters) < 0.000001) // equal genomes?
+                            if (m_Genomes[i].CompatibilityDistance(m_Genomes[j], m_Parameters, 0.000001) < 0.000001) // equal genomes?
                             {
                                 is_invalid = true;
                                 break;
@@ -162,6 +164,7 @@ Population::Population(const char *a_FileName)
 
     // Load the parameters
     m_Parameters.Load(t_DataFile);
+    m_Parameters.InternTraits();
 
     // Load the innovation database
     m_InnovationDatabase.Init(t_DataFile);
@@ -256,34 +259,58 @@ void Population::Speciate()
     m_Species.clear();
 
 
-    bool t_added = false;
-
     // NOTE: we are comparing the new generation's genomes to the representatives from the previous generation!
     // Any new species that is created is assigned a representative from the new generation.
-    for(unsigned int i=0; i<m_Genomes.size(); i++)
+
+    // Each genome goes to the first compatible species, in genome order. The genomes are
+    // taken in blocks: a block is first compared to the species that exist before it
+    // in parallel, then placed serially, comparing only to the species the block created.
+    ThreadPool t_pool(CanRunInParallel() ? m_Parameters.NumThreads : 1);
+    unsigned int t_block_size = t_pool.NumThreads() * 16;
+    std::vector<int> t_match; // index of the first compatible species, or -1
+
+    for(unsigned int t_start=0; t_start<m_Genomes.size(); t_start += t_block_size)
     {
-        t_added = false;
+        unsigned int t_count = std::min(t_block_size, static_cast<unsigned int>(m_Genomes.size()) - t_start);
+        unsigned int t_num_known = m_Species.size();
 
-        // iterate through each species and check if compatible. If compatible, then add to the species.
-        // if not compatible, create a new species.
-        for(unsigned int j=0; j<m_Species.size(); j++)
+        t_match.assign(t_count, -1);
+        t_pool.ParallelFor(t_count, [&](unsigned int i)
         {
-            Genome tmp = m_Species[j].GetRepresentative();
-            if (m_Genomes[i].IsCompatibleWith( tmp, m_Parameters ))
+            for(unsigned int j=0; j<t_num_known; j++)
             {
-                // Compatible, add to species
-                m_Species[j].AddIndividual( m_Genomes[i] );
-                t_added = true;
-
-                break;
+                if (m_Genomes[t_start + i].IsCompatibleWith( m_Species[j].Representative(), m_Parameters ))
+                {
+                    t_match[i] = j;
+                    break;
+                }
             }
-        }
+        });
 
-        if (!t_added)
+        for(unsigned int i=0; i<t_count; i++)
         {
-            // didn't find compatible species, create new species
-            m_Species.push_back( Species(m_Genomes[i], m_NextSpeciesID));
-            m_NextSpeciesID++;
+            Genome& t_genome = m_Genomes[t_start + i];
+
+            // check the species created since the block started
+            for(unsigned int j=t_num_known; (j<m_Species.size()) && (t_match[i] == -1); j++)
+            {
+                if (t_genome.IsCompatibleWith( m_Species[j].Representative(), m_Parameters ))
+                {
+                    t_match[i] = j;
+                }
+            }
+
+            if (t_match[i] != -1)
+            {
+                // Compatible, add to species
+                m_Species[t_match[i]].AddIndividual( t_genome );
+            }
+            else
+            {
+                // didn't find compatible species, create new species
+                m_Species.push_back( Species(t_genome, m_NextSpeciesID));
+                m_NextSpeciesID++;
+            }
         }
     }
 
@@ -362,7 +389,7 @@ void Population::CountOffspring()
 
 
 // This little tool function helps ordering the genomes by fitness
-bool species_greater(Species ls, Species rs)
+bool species_greater(const Species &ls, const Species &rs)
 {
     return ((ls.GetBestFitness()) > (rs.GetBestFitness()));
 }
@@ -444,6 +471,9 @@ void Population::UpdateSpecies()
 // the epoch method - the heart of the GA
 void Population::Epoch()
 {   
+    // the trait parameters may have been edited since the last generation
+    m_Parameters.InternTraits();
+
     // So, all genomes are evaluated..
     for(unsigned int i=0; i<m_Species.size(); i++)
     {
@@ -664,15 +694,23 @@ void Population::Epoch()
 
     // Perform reproduction for each species
     m_TempSpecies.clear();
+    m_TempClones.Clear();
     m_TempSpecies = m_Species;
     for(unsigned int i=0; i<m_TempSpecies.size(); i++)
     {
         m_TempSpecies[i].Clear();
     }
 
-    for(unsigned int i=0; i<m_Species.size(); i++)
+    if (m_Parameters.ParallelReproduction && CanRunInParallel())
     {
-        m_Species[i].Reproduce(*this, m_Parameters, m_RNG);
+        ReproduceParallel();
+    }
+    else
+    {
+        for(unsigned int i=0; i<m_Species.size(); i++)
+        {
+            m_Species[i].Reproduce(*this, m_Parameters, m_RNG);
+        }
     }
     m_Species = m_TempSpecies;
 
@@ -739,6 +777,190 @@ void Population::Epoch()
 
 
 
+// Reproduces all species into m_TempSpecies, like Species::Reproduce() does for each one in turn.
+// Every baby is made by a task of its own, with its own RNG (seeded from m_RNG) and its own
+// overlay of the innovation database, so the babies don't depend on the number of threads.
+// They are then merged, checked for clones and placed into species serially, in task order.
+void Population::ReproduceParallel()
+{
+    // one task per baby, in the order the serial reproduction makes them
+    std::vector<int> t_species; // the parent species
+    std::vector<int> t_elite;   // index of the elite individual to copy, or -1
+    for(unsigned int i=0; i<m_Species.size(); i++)
+    {
+        int t_total, t_elite_count;
+        m_Species[i].GetOffspringCounts(m_Parameters, t_total, t_elite_count);
+        for(int j=0; j<t_total; j++)
+        {
+            t_species.push_back(i);
+            t_elite.push_back((j < t_elite_count) ? j : -1);
+        }
+    }
+
+    unsigned int t_num_tasks = t_species.size();
+    std::vector<Genome> t_babies(t_num_tasks);
+    std::vector<RNG> t_rngs(t_num_tasks);
+    std::vector<InnovationDatabase> t_overlays(t_num_tasks);
+    long t_seed = m_RNG.RandInt(0, RAND_MAX);
+
+    ThreadPool t_pool(m_Parameters.NumThreads);
+    t_pool.ParallelFor(t_num_tasks, [&](unsigned int i)
+    {
+        if (t_elite[i] != -1)
+        {
+            return;
+        }
+
+        t_rngs[i].Seed(t_seed + i);
+        t_overlays[i].InitOverlay(m_InnovationDatabase);
+        t_babies[i] = m_Species[t_species[i]].ProduceBaby(false, *this, t_overlays[i], m_Parameters, t_rngs[i]);
+    });
+
+    for(unsigned int i=0; i<t_num_tasks; i++)
+    {
+        Species& t_parent = m_Species[t_species[i]];
+        Genome& t_baby = t_babies[i];
+
+        if (t_elite[i] != -1)
+        {
+            t_baby = t_parent.m_Individuals[t_elite[i]];
+        }
+        else
+        {
+            m_InnovationDatabase.MergeOverlay(t_overlays[i], t_baby);
+
+            // the retries see the babies placed so far, so they are made here
+            bool t_baby_exists_in_pop = t_parent.BabyExists(t_baby, *this, m_Parameters);
+            while (t_baby_exists_in_pop || (t_baby.FailsConstraints(m_Parameters)))
+            {
+                t_baby = t_parent.ProduceBaby(t_baby_exists_in_pop, *this, m_InnovationDatabase, m_Parameters, t_rngs[i]);
+                t_baby_exists_in_pop = t_parent.BabyExists(t_baby, *this, m_Parameters);
+            }
+        }
+
+        Species::AddBaby(t_baby, *this, m_Parameters);
+    }
+}
+
+
+bool Population::CanRunInParallel() const
+{
+#ifndef USE_BOOST_RANDOM
+    // the C library RNG is global
+    return false;
+#else
+
+#ifdef USE_BOOST_PYTHON
+    // Python traits can't be mutated outside of the interpreter's thread
+    const std::map< std::string, TraitParameters >* t_traits[3] =
+        { &m_Parameters.NeuronTraits, &m_Parameters.LinkTraits, &m_Parameters.GenomeTraits };
+    for(unsigned int i=0; i<3; i++)
+    {
+        for(std::map< std::string, TraitParameters >::const_iterator t_it = t_traits[i]->begin();
+            t_it != t_traits[i]->end(); t_it++)
+        {
+            if (t_it->second.type == "pyobject")
+            {
+                return false;
+            }
+        }
+    }
+#endif
+
+    return true;
+#endif
+}
+
+
+
+
+bool Population::TempSpeciesHasClone(const Genome& a_Genome, double a_Delta, Parameters& a_Parameters)
+{
+    // AddBaby() indexes the babies as they are placed, rebuild the index if it was bypassed
+    unsigned int t_count = 0;
+    for(unsigned int i=0; i<m_TempSpecies.size(); i++)
+    {
+        t_count += m_TempSpecies[i].m_Individuals.size();
+    }
+    if (t_count != m_TempClones.Size())
+    {
+        m_TempClones.Clear();
+        for(unsigned int i=0; i<m_TempSpecies.size(); i++)
+        {
+            for(unsigned int j=0; j<m_TempSpecies[i].m_Individuals.size(); j++)
+            {
+                m_TempClones.Add(m_TempSpecies[i].m_Individuals[j], CloneIndex::Ref(i, j));
+            }
+        }
+    }
+
+    std::vector<CloneIndex::Ref> t_refs;
+    if (m_TempClones.Candidates(a_Genome, a_Delta, a_Parameters, t_refs))
+    {
+        for(unsigned int i=0; i<t_refs.size(); i++)
+        {
+            const Genome& t_other = m_TempSpecies[t_refs[i].first].m_Individuals[t_refs[i].second];
+            if (a_Genome.CompatibilityDistance(t_other, a_Parameters, a_Delta) < a_Delta)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the index can't help with these parameters, compare to everyone
+    for(unsigned int i=0; i<m_TempSpecies.size(); i++)
+    {
+        for(unsigned int j=0; j<m_TempSpecies[i].m_Individuals.size(); j++)
+        {
+            if (a_Genome.CompatibilityDistance(m_TempSpecies[i].m_Individuals[j], a_Parameters, a_Delta) < a_Delta)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+bool Population::ArchiveHasClone(const Genome& a_Genome, double a_Delta, Parameters& a_Parameters)
+{
+    // the archive only grows, so index the genomes added since the last time
+    if (m_ArchiveClones.Size() > m_GenomeArchive.size())
+    {
+        m_ArchiveClones.Clear();
+    }
+    for(unsigned int i=m_ArchiveClones.Size(); i<m_GenomeArchive.size(); i++)
+    {
+        m_ArchiveClones.Add(m_GenomeArchive[i], CloneIndex::Ref(i, 0));
+    }
+
+    std::vector<CloneIndex::Ref> t_refs;
+    if (m_ArchiveClones.Candidates(a_Genome, a_Delta, a_Parameters, t_refs))
+    {
+        for(unsigned int i=0; i<t_refs.size(); i++)
+        {
+            if (a_Genome.CompatibilityDistance(m_GenomeArchive[t_refs[i].first], a_Parameters, a_Delta) < a_Delta)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the index can't help with these parameters, compare to everyone
+    for(unsigned int i=0; i<m_GenomeArchive.size(); i++)
+    {
+        if (a_Genome.CompatibilityDistance(m_GenomeArchive[i], a_Parameters, a_Delta) < a_Delta)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
 
 Genome g_dummy; // empty genome
 Genome& Population::AccessGenomeByIndex(unsigned int const a_idx)
@@ -827,43 +1049,19 @@ void Population::ReassignSpecies(unsigned int a_genome_idx)
 {
     ASSERT(a_genome_idx < m_Genomes.size());
 
-    // first remember where is this genome exactly
-    unsigned int t_species_idx = 0, t_genome_rel_idx = 0;
-    unsigned int t_counter = 0;
-
-    // to keep the genome
-    Genome t_genome;
-
-    // search for it
-    bool t_f = false;
-    t_species_idx = 0;
-    for(unsigned int i=0; i<m_Species.size(); i++)
+    // first remember where is this genome exactly,
+    // skipping whole species until the index falls in one
+    unsigned int t_species_idx = 0, t_genome_rel_idx = a_genome_idx;
+    while(t_genome_rel_idx >= m_Species[t_species_idx].m_Individuals.size())
     {
-        t_genome_rel_idx = 0;
-        for(unsigned int j=0; j<m_Species[i].m_Individuals.size(); j++)
-        {
-            if (t_counter == a_genome_idx)
-            {
-                // get the genome and break
-                t_genome = m_Species[i].m_Individuals[j];
-                t_f = true;
-                break;
-            }
-
-            t_counter++;
-            t_genome_rel_idx++;
-        }
-
-        if (!t_f)
-        {
-            t_species_idx++;
-        }
-        else
-        {
-            break;
-        }
+        t_genome_rel_idx -= m_Species[t_species_idx].m_Individuals.size();
+        t_species_idx++;
+        ASSERT(t_species_idx < m_Species.size());
     }
 
+    // to keep the genome, it leaves its place so it's moved out
+    Genome t_genome = std::move(m_Species[t_species_idx].m_Individuals[t_genome_rel_idx]);
+
     // Remove it from its species
     m_Species[t_species_idx].RemoveIndividual(t_genome_rel_idx);
 
@@ -887,12 +1085,10 @@ void Population::ReassignSpecies(unsigned int a_genome_idx)
     else
     {
         // try to find a compatible species
-        Genome t_to_compare = t_cur_species->GetRepresentative();
-
         t_found = false;
         while((t_cur_species != m_Species.end()) && (!t_found))
         {
-            if (t_genome.IsCompatibleWith( t_to_compare, m_Parameters ))
+            if (t_genome.IsCompatibleWith(t_cur_species->Representative(), m_Parameters ))
             {
                 // found a compatible species
                 t_cur_species->AddIndividual(t_genome);
@@ -902,10 +1098,6 @@ void Population::ReassignSpecies(unsigned int a_genome_idx)
             {
                 // keep searching for a matching species
                 t_cur_species++;
-                if (t_cur_species != m_Species.end())
-                {
-                    t_to_compare = t_cur_species->GetRepresentative();
-                }
             }
         }
 
@@ -931,19 +1123,25 @@ Genome* Population::Tick(Genome& a_deleted_genome)
 
     m_NumEvaluations++;
 
-    // Find and save the best genome and fitness
+    // Find and save the best genome and fitness, and update the species' best fitness.
+    // Only the positions of the best genomes are kept during the pass, they are copied once after it.
+    int t_best_ever_species = -1, t_best_ever_idx = -1;
+    int t_best_species = -1, t_best_idx = -1;
+    double t_f = std::numeric_limits<double>::min();
     for(unsigned int i=0; i<m_Species.size(); i++)
     {
         m_Species[i].IncreaseEvalsNoImprovement();
 
         for(unsigned int j=0; j<m_Species[i].m_Individuals.size(); j++)
         {
-            if (m_Species[i].m_Individuals[j].GetFitness() <= 0.0)
+            Genome& t_genome = m_Species[i].m_Individuals[j];
+
+            if (t_genome.GetFitness() <= 0.0)
             {
-                m_Species[i].m_Individuals[j].SetFitness(0.00001);
+                t_genome.SetFitness(0.00001);
             }
 
-            const double  t_Fitness = m_Species[i].m_Individuals[j].GetFitness();
+            const double  t_Fitness = t_genome.GetFitness();
             if (t_Fitness > m_BestFitnessEver)
             {
                 // Reset the stagnation counter only if the fitness jump is greater or equal to the delta.
@@ -953,30 +1151,34 @@ Genome* Population::Tick(Genome& a_deleted_genome)
                 }
 
                 m_BestFitnessEver = t_Fitness;
-                m_BestGenomeEver  = m_Species[i].m_Individuals[j];
+                t_best_ever_species = i;
+                t_best_ever_idx = j;
             }
-        }
-    }
 
-    double t_f = std::numeric_limits<double>::min();
-    for(unsigned int i=0; i<m_Species.size(); i++)
-    {
-        for(unsigned int j=0; j<m_Species[i].m_Individuals.size(); j++)
-        {
-            if (m_Species[i].m_Individuals[j].GetFitness() > t_f)
+            if (t_Fitness > t_f)
             {
-                t_f = m_Species[i].m_Individuals[j].GetFitness();
-                m_BestGenome = m_Species[i].m_Individuals[j];
+                t_f = t_Fitness;
+                t_best_species = i;
+                t_best_idx = j;
             }
 
-            if (m_Species[i].m_Individuals[j].GetFitness() >= m_Species[i].GetBestFitness())
+            if (t_Fitness >= m_Species[i].GetBestFitness())
             {
-                m_Species[i].m_BestFitness = m_Species[i].m_Individuals[j].GetFitness();
+                m_Species[i].m_BestFitness = t_Fitness;
                 m_Species[i].m_EvalsNoImprovement = 0;
             }
         }
     }
 
+    if (t_best_ever_species != -1)
+    {
+        m_BestGenomeEver = m_Species[t_best_ever_species].m_Individuals[t_best_ever_idx];
+    }
+    if (t_best_species != -1)
+    {
+        m_BestGenome = m_Species[t_best_species].m_Individuals[t_best_idx];
+    }
+
 
     // adjust the compatibility treshold
     bool t_changed = false;
@@ -1008,8 +1210,14 @@ Genome* Population::Tick(Genome& a_deleted_genome)
         }
     }
 
-    // Sort individuals within species by fitness
-    Sort();
+    // Sort individuals within species by fitness.
+    // Usually only the last baby is out of place, so it's just moved where it belongs.
+    for(unsigned int i=0; i<m_Species.size(); i++)
+    {
+        ASSERT(m_Species[i].NumIndividuals() > 0);
+        m_Species[i].ResortIndividuals();
+    }
+    std::sort(m_Species.begin(), m_Species.end(), species_greater);
 
     // Remove the worst individual
     a_deleted_genome = RemoveWorstIndividual();
@@ -1044,12 +1252,10 @@ Genome* Population::Tick(Genome& a_deleted_genome)
     else
     {
         // try to find a compatible species
-        Genome t_to_compare = t_cur_species->GetRepresentative();
-
         t_found = false;
         while((t_cur_species != m_Species.end()) && (!t_found))
         {
-            if (t_baby.IsCompatibleWith( t_to_compare, m_Parameters))
+            if (t_baby.IsCompatibleWith(t_cur_species->Representative(), m_Parameters))
             {
                 // found a compatible species
                 t_cur_species->AddIndividual(t_baby);
@@ -1060,10 +1266,6 @@ Genome* Population::Tick(Genome& a_deleted_genome)
             {
                 // keep searching for a matching species
                 t_cur_species++;
-                if (t_cur_species != m_Species.end())
-                {
-                    t_to_compare = t_cur_species->GetRepresentative();
-                }
             }
         }
 
@@ -1090,16 +1292,15 @@ Genome Population::RemoveWorstIndividual()
     //unsigned int t_worst_absolute_idx=0; // within the population
     unsigned int t_worst_species_idx=0; // within the population
     double       t_worst_fitness = std::numeric_limits<double>::max();
-
-    Genome t_genome;
+    bool         t_worst_found = false;
 
     // Find and kill the individual with the worst *adjusted* fitness
-    int t_abs_counter = 0;
     for(unsigned int i=0; i<m_Species.size(); i++)
     {
+        double t_size = static_cast<double>(m_Species[i].m_Individuals.size());
         for(unsigned int j=0; j<m_Species[i].m_Individuals.size(); j++)
         {
-            double t_adjusted_fitness = m_Species[i].m_Individuals[j].GetFitness() / static_cast<double>(m_Species[i].m_Individuals.size());
+            double t_adjusted_fitness = m_Species[i].m_Individuals[j].GetFitness() / t_size;
 
             // only only evaluated individuals can be removed
             if ((t_adjusted_fitness < t_worst_fitness) && (m_Species[i].m_Individuals[j].IsEvaluated()))
@@ -1107,14 +1308,18 @@ Genome Population::RemoveWorstIndividual()
                 t_worst_fitness = t_adjusted_fitness;
                 t_worst_idx = j;
                 t_worst_species_idx = i;
-                //t_worst_absolute_idx = t_abs_counter;
-                t_genome = m_Species[i].m_Individuals[j];
+                t_worst_found = true;
             }
-
-            t_abs_counter++;
         }
     }
 
+    // it is going away, so it's moved out instead of copied
+    Genome t_genome;
+    if (t_worst_found)
+    {
+        t_genome = std::move(m_Species[t_worst_species_idx].m_Individuals[t_worst_idx]);
+    }
+
     // The individual is now removed
     m_Species[t_worst_species_idx].RemoveIndividual(t_worst_idx);
 
@@ -1146,18 +1351,37 @@ Genome Population::RemoveWorstIndividual()
 // Warning! All derived classes MUST NOT have any member variables! Change the algorithms only!
 void Population::InitPhenotypeBehaviorData(std::vector< PhenotypeBehavior >* a_population, std::vector< PhenotypeBehavior >* a_archive)
 {
-    // Now make each genome point to its behavior
     a_population->resize(NumGenomes());
+    std::vector< PhenotypeBehavior* > t_behaviors;
+    for(unsigned int i=0; i<a_population->size(); i++)
+    {
+        t_behaviors.push_back( &((*a_population)[i]) );
+    }
+    BindPhenotypeBehaviors(t_behaviors, a_archive);
+}
+
+void Population::BindPhenotypeBehaviors(std::vector< PhenotypeBehavior* >& a_behaviors, std::vector< PhenotypeBehavior >* a_archive)
+{
+    // Now make each genome point to its behavior
     m_BehaviorArchive = a_archive;
     m_BehaviorArchive->clear();
 
-    ASSERT(a_population->size() == NumGenomes());
+    if (m_Parameters.NoveltySearch_VPTree)
+    {
+        m_BehaviorIndex.reset(new VPTreeBehaviorIndex());
+    }
+    else
+    {
+        m_BehaviorIndex.reset(new LinearBehaviorIndex());
+    }
+
+    ASSERT(a_behaviors.size() == NumGenomes());
     int counter = 0;
     for(unsigned int i=0; i<m_Species.size(); i++)
     {
         for(unsigned int j=0; j<m_Species[i].m_Individuals.size(); j++, counter++)
         {
-            m_Species[i].m_Individuals[j].m_PhenotypeBehavior = &((*a_population)[counter]);
+            m_Species[i].m_Individuals[j].m_PhenotypeBehavior = a_behaviors[counter];
             m_Species[i].m_Individuals[j].SetFitness(0);
         }
     }
@@ -1168,30 +1392,34 @@ double Population::ComputeSparseness(Genome& genome)
 {
     // this will hold the distances from our new behavior
     std::vector< double > t_distances_list;
-    t_distances_list.clear();
+    t_distances_list.reserve(NumGenomes() + m_Parameters.NoveltySearch_K + 1);
 
-    // first add all distances from the population
+    // first add all distances from the population, measured in one batch
+    m_PopulationBehaviors.clear();
     for(unsigned int i=0; i<m_Species.size(); i++)
     {
         for(unsigned int j=0; j<m_Species[i].m_Individuals.size(); j++)
         {
-            double distance = genome.m_PhenotypeBehavior->Distance_To( m_Species[i].m_Individuals[j].m_PhenotypeBehavior );
-            t_distances_list.push_back( distance );
+            m_PopulationBehaviors.push_back( m_Species[i].m_Individuals[j].m_PhenotypeBehavior );
         }
     }
+    genome.m_PhenotypeBehavior->Distances_To( m_PopulationBehaviors, t_distances_list );
 
-    // then add all distances from the archive
-    for(unsigned int i=0; i<m_BehaviorArchive->size(); i++)
+    // then add the distances to the nearest ones in the archive, the others can't be among the K+1 nearest
+    if (!m_BehaviorIndex)
     {
-        t_distances_list.push_back( genome.m_PhenotypeBehavior->Distance_To( &((*m_BehaviorArchive)[i])));
+        m_BehaviorIndex.reset(new LinearBehaviorIndex());
     }
+    m_BehaviorIndex->Update(*m_BehaviorArchive, genome.m_PhenotypeBehavior);
+    m_BehaviorIndex->Nearest(genome.m_PhenotypeBehavior, m_Parameters.NoveltySearch_K + 1, t_distances_list);
 
-    // sort the list, smaller first
-    std::sort( t_distances_list.begin(), t_distances_list.end() );
+    // sort the K+1 smallest, smaller first
+    unsigned int t_count = std::min(m_Parameters.NoveltySearch_K + 1, (unsigned int)t_distances_list.size());
+    std::partial_sort( t_distances_list.begin(), t_distances_list.begin() + t_count, t_distances_list.end() );
 
     // now compute the sparseness
     double t_sparseness = 0;
-    for(unsigned int i=1; i< (m_Parameters.NoveltySearch_K+1); i++)
+    for(unsigned int i=1; i<t_count; i++)
     {
         t_sparseness += t_distances_list[i];
     }
@@ -107,6 +107,12 @@ private:
     // Calculates the current mean population complexity
     void CalculateMPC();
 
+    // Does the reproduction of Epoch() with m_Parameters.NumThreads threads
+    void ReproduceParallel();
+
+    // False if the genome operations may call something that can't run in a worker thread
+    bool CanRunInParallel() const;
+
 
     // best fitness ever achieved
     double m_BestFitnessEver;
@@ -127,6 +133,9 @@ private:
     // The initial list of genomes
     std::vector<Genome> m_Genomes;
 
+    // The behaviors of the population, gathered by ComputeSparseness()
+    std::vector< PhenotypeBehavior* > m_PopulationBehaviors;
+
 public:
 
     // The archive
@@ -236,6 +245,14 @@ public:
     //////////////////////
     // NEW STUFF
     std::vector<Species> m_TempSpecies; // useful in reproduction
+    CloneIndex m_TempClones;    // the genomes in m_TempSpecies, for the clone checks
+    CloneIndex m_ArchiveClones; // the genomes in m_GenomeArchive, for the clone checks
+
+    // Returns true if a genome closer than a_Delta to a_Genome is in m_TempSpecies
+    bool TempSpeciesHasClone(const Genome& a_Genome, double a_Delta, Parameters& a_Parameters);
+
+    // Returns true if a genome closer than a_Delta to a_Genome is in m_GenomeArchive
+    bool ArchiveHasClone(const Genome& a_Genome, double a_Delta, Parameters& a_Parameters);
 
 
     //////////////////////
@@ -276,11 +293,34 @@ public:
     // Necessary to contain derived custom classes.
     std::vector< PhenotypeBehavior >* m_BehaviorArchive;
 
+    // Finds the nearest behaviors in the archive. Made by InitPhenotypeBehaviorData(),
+    // set it after that to use a custom one.
+    boost::shared_ptr<BehaviorIndex> m_BehaviorIndex;
+
     // Call this function to allocate memory for your custom
     // behaviors. This initializes everything.
     void InitPhenotypeBehaviorData(std::vector< PhenotypeBehavior >* a_population, 
                                    std::vector< PhenotypeBehavior >* a_archive);
 
+    // The same for a population of a built-in behavior, like EuclideanBehavior,
+    // or of any other class derived from PhenotypeBehavior
+    template<class T>
+    void InitPhenotypeBehaviorData(std::vector< T >* a_population,
+                                   std::vector< PhenotypeBehavior >* a_archive)
+    {
+        a_population->resize(NumGenomes());
+        std::vector< PhenotypeBehavior* > t_behaviors;
+        for(unsigned int i=0; i<a_population->size(); i++)
+        {
+            t_behaviors.push_back( &((*a_population)[i]) );
+        }
+        BindPhenotypeBehaviors(t_behaviors, a_archive);
+    }
+
+    // Makes each genome point to its behavior and starts the archive
+    void BindPhenotypeBehaviors(std::vector< PhenotypeBehavior* >& a_behaviors,
+                                std::vector< PhenotypeBehavior >* a_archive);
+
     // This is the main method performing novelty search.
     // Performs one reproduction and assigns novelty scores
     // based on the current population and the archive.
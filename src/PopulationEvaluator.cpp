@@ -0,0 +1,344 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//    MultiNEAT - Python/C++ NeuroEvolution of Augmenting Topologies Library
+//
+//    Copyright (C) 2012 Peter Chervenski
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with this program.  If not, see < http://www.gnu.org/licenses/ >.
+//
+//    Contact info:
+//
+//    Peter Chervenski < spookey@abv.bg >
+//    Shane Ryan < shane.mcdonald.ryan@gmail.com >
+///////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// File:        PopulationEvaluator.cpp
+// Description: Implementation of the PopulationEvaluator class.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Genome.h"
+#include "Population.h"
+#include "PopulationEvaluator.h"
+#include "Assert.h"
+
+namespace NEAT
+{
+
+PopulationEvaluator::PopulationEvaluator(unsigned int a_num_threads, bool a_single_precision)
+    : m_pool(a_num_threads), m_single_precision(a_single_precision)
+{
+    m_num_inputs = m_num_outputs = 0;
+}
+
+void PopulationEvaluator::Build(Population& a_Pop)
+{
+    m_genomes.clear();
+    for (unsigned int i = 0; i < a_Pop.m_Species.size(); i++)
+    {
+        for (unsigned int j = 0; j < a_Pop.m_Species[i].m_Individuals.size(); j++)
+        {
+            m_genomes.push_back(&a_Pop.m_Species[i].m_Individuals[j]);
+        }
+    }
+
+    // the phenotypes are built and compiled in parallel, then packed together
+    std::vector<NeuralNetwork> t_nets(m_genomes.size());
+    m_pool.ParallelFor(m_genomes.size(), [&](unsigned int i)
+    {
+        m_genomes[i]->BuildPhenotype(t_nets[i]);
+        t_nets[i].Compile();
+    });
+
+    m_networks.clear();
+    m_source.clear();
+    m_in_start.assign(1, 0);
+    m_order.clear();
+    m_runs.clear();
+    m_layer_runs.clear();
+    m_double = Values<double>();
+    m_single = Values<float>();
+
+    m_num_inputs = m_num_outputs = 0;
+    if (!t_nets.empty())
+    {
+        m_num_inputs = t_nets[0].NumInputs();
+        m_num_outputs = t_nets[0].NumOutputs();
+    }
+
+    for (unsigned int i = 0; i < t_nets.size(); i++)
+    {
+        AppendNetwork(t_nets[i]);
+    }
+
+    m_double.m_activesum.assign(m_order.size(), 0.0);
+    if (m_single_precision)
+    {
+        // the plans are in double precision, only the arena is converted
+        m_single.m_weight.assign(m_double.m_weight.begin(), m_double.m_weight.end());
+        m_single.m_a.assign(m_double.m_a.begin(), m_double.m_a.end());
+        m_single.m_b.assign(m_double.m_b.begin(), m_double.m_b.end());
+        m_single.m_activation.assign(m_double.m_activation.begin(), m_double.m_activation.end());
+        m_single.m_activesum.assign(m_order.size(), 0.0f);
+        m_double = Values<double>();
+    }
+}
+
+void PopulationEvaluator::AppendNetwork(const NeuralNetwork& a_net)
+{
+    if ((a_net.NumInputs() != m_num_inputs) || (a_net.NumOutputs() != m_num_outputs))
+    {
+        throw std::runtime_error("All networks in a PopulationEvaluator must have the same number of inputs and outputs");
+    }
+
+    NetworkRange t_range;
+    int t_neuron_offset = m_double.m_activation.size();
+    int t_slot_offset = m_order.size();
+    int t_connection_offset = m_source.size();
+    int t_run_offset = m_runs.size();
+
+    t_range.m_neuron_start = t_neuron_offset;
+    t_range.m_slot_start = t_slot_offset;
+    t_range.m_slot_end = t_slot_offset + a_net.m_plan_order.size();
+    t_range.m_layer_start = m_layer_runs.size();
+    t_range.m_layer_end = m_layer_runs.size() + a_net.m_plan_layer_runs.size();
+    t_range.m_feedforward = a_net.m_plan_feedforward;
+    m_networks.push_back(t_range);
+
+    for (unsigned int c = 0; c < a_net.m_plan_source.size(); c++)
+    {
+        m_source.push_back(a_net.m_plan_source[c] + t_neuron_offset);
+    }
+    m_double.m_weight.insert(m_double.m_weight.end(), a_net.m_plan_weight.begin(), a_net.m_plan_weight.end());
+    for (unsigned int s = 1; s < a_net.m_plan_in_start.size(); s++)
+    {
+        m_in_start.push_back(a_net.m_plan_in_start[s] + t_connection_offset);
+    }
+
+    m_double.m_a.insert(m_double.m_a.end(), a_net.m_plan_a.begin(), a_net.m_plan_a.end());
+    m_double.m_b.insert(m_double.m_b.end(), a_net.m_plan_b.begin(), a_net.m_plan_b.end());
+    for (unsigned int s = 0; s < a_net.m_plan_order.size(); s++)
+    {
+        m_order.push_back(a_net.m_plan_order[s] + t_neuron_offset);
+    }
+    for (unsigned int r = 0; r < a_net.m_plan_runs.size(); r++)
+    {
+        NeuralNetwork::ActivationRun t_run = a_net.m_plan_runs[r];
+        t_run.m_start += t_slot_offset;
+        t_run.m_end += t_slot_offset;
+        m_runs.push_back(t_run);
+    }
+    for (unsigned int l = 0; l < a_net.m_plan_layer_runs.size(); l++)
+    {
+        m_layer_runs.push_back(a_net.m_plan_layer_runs[l] + t_run_offset);
+    }
+
+    m_double.m_activation.insert(m_double.m_activation.end(),
+                                 a_net.m_plan_activation.begin(), a_net.m_plan_activation.end());
+}
+
+void PopulationEvaluator::Flush()
+{
+    std::fill(m_double.m_activation.begin(), m_double.m_activation.end(), 0.0);
+    std::fill(m_double.m_activesum.begin(), m_double.m_activesum.end(), 0.0);
+    std::fill(m_single.m_activation.begin(), m_single.m_activation.end(), 0.0f);
+    std::fill(m_single.m_activesum.begin(), m_single.m_activesum.end(), 0.0f);
+}
+
+template <typename T>
+void PopulationEvaluator::PropagateSignals(Values<T>& a_values, int a_start, int a_end)
+{
+    const int* t_source = m_source.data();
+    const T* t_weight = a_values.m_weight.data();
+    const T* t_activation = a_values.m_activation.data();
+
+    for (int s = a_start; s < a_end; s++)
+    {
+        T t_sum = 0;
+        for (int c = m_in_start[s]; c < m_in_start[s + 1]; c++)
+        {
+            t_sum += t_activation[t_source[c]] * t_weight[c];
+        }
+        a_values.m_activesum[s] = t_sum;
+    }
+}
+
+template <typename T>
+void PopulationEvaluator::ApplyActivationRuns(Values<T>& a_values, int a_first, int a_last)
+{
+    for (int r = a_first; r < a_last; r++)
+    {
+        const NeuralNetwork::ActivationRun& t_run = m_runs[r];
+        ActivateBlock(t_run.m_type, t_run.m_end - t_run.m_start,
+                      &a_values.m_activesum[t_run.m_start],
+                      &a_values.m_a[t_run.m_start],
+                      &a_values.m_b[t_run.m_start],
+                      &m_order[t_run.m_start],
+                      a_values.m_activation.data());
+    }
+}
+
+template <typename T>
+void PopulationEvaluator::ActivateNetwork(Values<T>& a_values, unsigned int a_idx, int a_depth)
+{
+    const NetworkRange& t_net = m_networks[a_idx];
+    if (t_net.m_layer_end - t_net.m_layer_start < 2)
+        return; // only inputs
+
+    if (t_net.m_feedforward)
+    {
+        for (int l = t_net.m_layer_start; l + 1 < t_net.m_layer_end; l++)
+        {
+            int t_first = m_layer_runs[l];
+            int t_last = m_layer_runs[l + 1];
+            PropagateSignals(a_values, m_runs[t_first].m_start, m_runs[t_last - 1].m_end);
+            ApplyActivationRuns(a_values, t_first, t_last);
+        }
+    }
+    else
+    {
+        for (int d = 0; d < a_depth; d++)
+        {
+            PropagateSignals(a_values, t_net.m_slot_start, t_net.m_slot_end);
+            ApplyActivationRuns(a_values, m_layer_runs[t_net.m_layer_start], m_layer_runs[t_net.m_layer_end - 1]);
+        }
+    }
+}
+
+template <typename T>
+void PopulationEvaluator::StepNetworks(Values<T>& a_values, const std::vector<double>& a_observations,
+                                       std::vector<double>& a_actions, int a_depth)
+{
+    // a few chunks per thread, so uneven networks balance out
+    unsigned int t_num_chunks = std::min((unsigned int)m_networks.size(), m_pool.NumThreads() * 4);
+    unsigned int t_chunk_size = t_num_chunks ? (m_networks.size() + t_num_chunks - 1) / t_num_chunks : 0;
+
+    m_pool.ParallelFor(t_num_chunks, [&](unsigned int a_chunk)
+    {
+        unsigned int t_end = std::min((unsigned int)m_networks.size(), (a_chunk + 1) * t_chunk_size);
+        for (unsigned int i = a_chunk * t_chunk_size; i < t_end; i++)
+        {
+            T* t_activation = &a_values.m_activation[m_networks[i].m_neuron_start];
+            for (unsigned int k = 0; k < m_num_inputs; k++)
+            {
+                t_activation[k] = (T)a_observations[i * m_num_inputs + k];
+            }
+
+            ActivateNetwork(a_values, i, a_depth);
+
+            for (unsigned int k = 0; k < m_num_outputs; k++)
+            {
+                a_actions[i * m_num_outputs + k] = t_activation[m_num_inputs + k];
+            }
+        }
+    });
+}
+
+void PopulationEvaluator::Step(const std::vector<double>& a_observations, std::vector<double>& a_actions, int a_depth)
+{
+    ASSERT(a_observations.size() == m_networks.size() * m_num_inputs);
+    a_actions.resize(m_networks.size() * m_num_outputs);
+
+    if (m_single_precision)
+    {
+        StepNetworks(m_single, a_observations, a_actions, a_depth);
+    }
+    else
+    {
+        StepNetworks(m_double, a_observations, a_actions, a_depth);
+    }
+}
+
+std::vector< std::vector<double> > PopulationEvaluator::Step(const std::vector< std::vector<double> >& a_observations,
+                                                             int a_depth)
+{
+    ASSERT(a_observations.size() == m_networks.size());
+    std::vector<double> t_observations(m_networks.size() * m_num_inputs, 0.0);
+    for (unsigned int i = 0; i < a_observations.size(); i++)
+    {
+        // clip the observation to the number of inputs
+        unsigned int t_len = std::min((unsigned int)a_observations[i].size(), m_num_inputs);
+        std::copy(a_observations[i].begin(), a_observations[i].begin() + t_len, t_observations.begin() + i * m_num_inputs);
+    }
+
+    std::vector<double> t_actions;
+    Step(t_observations, t_actions, a_depth);
+
+    std::vector< std::vector<double> > t_result(m_networks.size());
+    for (unsigned int i = 0; i < m_networks.size(); i++)
+    {
+        t_result[i].assign(t_actions.begin() + i * m_num_outputs, t_actions.begin() + (i + 1) * m_num_outputs);
+    }
+    return t_result;
+}
+
+void PopulationEvaluator::SetFitnesses(const std::vector<double>& a_fitnesses)
+{
+    ASSERT(a_fitnesses.size() == m_genomes.size());
+    for (unsigned int i = 0; i < m_genomes.size(); i++)
+    {
+        m_genomes[i]->SetFitness(a_fitnesses[i]);
+        m_genomes[i]->SetEvaluated();
+    }
+}
+
+#ifdef USE_BOOST_PYTHON
+
+py::list PopulationEvaluator::Step_python(py::object& a_observations, int a_depth)
+{
+    ASSERT(py::len(a_observations) == (int)m_networks.size());
+    std::vector<double> t_observations(m_networks.size() * m_num_inputs, 0.0);
+    for (unsigned int i = 0; i < m_networks.size(); i++)
+    {
+        py::object t_row = a_observations[i];
+
+        // clip the observation to the number of inputs
+        int len = std::min((int)py::len(t_row), (int)m_num_inputs);
+        for (int k = 0; k < len; k++)
+        {
+            t_observations[i * m_num_inputs + k] = py::extract<double>(t_row[k]);
+        }
+    }
+
+    std::vector<double> t_actions;
+    Step(t_observations, t_actions, a_depth);
+
+    py::list t_result;
+    for (unsigned int i = 0; i < m_networks.size(); i++)
+    {
+        py::list t_row;
+        for (unsigned int k = 0; k < m_num_outputs; k++)
+        {
+            t_row.append(t_actions[i * m_num_outputs + k]);
+        }
+        t_result.append(t_row);
+    }
+    return t_result;
+}
+
+void PopulationEvaluator::SetFitnesses_python(py::object& a_fitnesses)
+{
+    std::vector<double> t_fitnesses(py::len(a_fitnesses));
+    for (unsigned int i = 0; i < t_fitnesses.size(); i++)
+    {
+        t_fitnesses[i] = py::extract<double>(a_fitnesses[i]);
+    }
+    SetFitnesses(t_fitnesses);
+}
+
+#endif
+
+} // namespace NEAT
@@ -0,0 +1,152 @@
+#ifndef _POPULATIONEVALUATOR_H
+#define _POPULATIONEVALUATOR_H
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//    MultiNEAT - Python/C++ NeuroEvolution of Augmenting Topologies Library
+//
+//    Copyright (C) 2012 Peter Chervenski
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with this program.  If not, see < http://www.gnu.org/licenses/ >.
+//
+//    Contact info:
+//
+//    Peter Chervenski < spookey@abv.bg >
+//    Shane Ryan < shane.mcdonald.ryan@gmail.com >
+///////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// File:        PopulationEvaluator.h
+// Description: Evaluates the phenotypes of a whole population in lockstep.
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef USE_BOOST_PYTHON
+
+#include <boost/python.hpp>
+
+namespace py = boost::python;
+
+#endif
+
+#include <vector>
+
+#include "NeuralNetwork.h"
+#include "ThreadPool.h"
+
+namespace NEAT
+{
+
+class Genome;
+class Population;
+
+//////////////////////////////////////////////
+// Builds the phenotypes of all genomes into one arena and steps them
+// together on a batch of observations, one row per network.
+// The networks keep their state between steps, like Input()/Activate()/Output().
+// The arena can be kept in single precision, which halves its size and doubles
+// the width of the vectorized loops. The genomes stay in double precision.
+//////////////////////////////////////////////
+class PopulationEvaluator
+{
+    ThreadPool m_pool;
+    bool m_single_precision;
+
+    // the genomes the networks were built from, in AccessGenomeByIndex() order
+    std::vector<Genome*> m_genomes;
+    unsigned int m_num_inputs, m_num_outputs;
+
+    // where a network lives in the arena
+    struct NetworkRange
+    {
+        int m_neuron_start;
+        int m_slot_start, m_slot_end;
+        int m_layer_start, m_layer_end; // into m_layer_runs, the last entry closes the last layer
+        bool m_feedforward;
+    };
+    std::vector<NetworkRange> m_networks;
+
+    // The arena - the compiled plans of all networks concatenated,
+    // with all neuron, slot and run indices made global.
+    std::vector<int>    m_source;
+    std::vector<int>    m_in_start;
+    std::vector<int>    m_order;
+    std::vector<NeuralNetwork::ActivationRun> m_runs;
+    std::vector<int>    m_layer_runs;
+
+    // the values of the arena and the state of all networks, in one precision
+    template <typename T>
+    struct Values
+    {
+        std::vector<T> m_weight;
+        std::vector<T> m_a;
+        std::vector<T> m_b;
+        std::vector<T> m_activation;
+        std::vector<T> m_activesum;
+    };
+    // only one of them is filled, depending on m_single_precision
+    Values<double> m_double;
+    Values<float>  m_single;
+
+    void AppendNetwork(const NeuralNetwork& a_net);
+    template <typename T> void PropagateSignals(Values<T>& a_values, int a_start, int a_end);
+    template <typename T> void ApplyActivationRuns(Values<T>& a_values, int a_first, int a_last);
+    template <typename T> void ActivateNetwork(Values<T>& a_values, unsigned int a_idx, int a_depth);
+    template <typename T> void StepNetworks(Values<T>& a_values, const std::vector<double>& a_observations,
+                                            std::vector<double>& a_actions, int a_depth);
+
+    PopulationEvaluator(const PopulationEvaluator&);
+    PopulationEvaluator& operator=(const PopulationEvaluator&);
+
+public:
+
+    // a_num_threads includes the calling thread, 0 means one per hardware thread.
+    // With a_single_precision the networks are evaluated in float,
+    // with approximated activation functions (see ActivateBlock()).
+    PopulationEvaluator(unsigned int a_num_threads = 0, bool a_single_precision = false);
+
+    // Builds the phenotypes of all genomes in the population (in parallel).
+    // Must be called again after every Epoch(), since the genomes change.
+    void Build(Population& a_Pop);
+
+    unsigned int NumNetworks() const { return m_networks.size(); }
+    unsigned int NumInputs() const { return m_num_inputs; }
+    unsigned int NumOutputs() const { return m_num_outputs; }
+    bool IsSinglePrecision() const { return m_single_precision; }
+    Genome& GetGenome(unsigned int a_idx) { return *m_genomes[a_idx]; }
+
+    // clears the activations of all networks
+    void Flush();
+
+    // Feeds row i of a_observations (NumNetworks() rows of NumInputs() values) to network i,
+    // activates all networks and writes their outputs to row i of a_actions.
+    // Every network is activated a_depth times like Activate(),
+    // or once with ActivateFeedForward() if it has no cycles.
+    void Step(const std::vector<double>& a_observations, std::vector<double>& a_actions, int a_depth);
+    // Same, with one vector per network
+    std::vector< std::vector<double> > Step(const std::vector< std::vector<double> >& a_observations, int a_depth);
+
+    // sets the fitness of every genome and marks it evaluated
+    void SetFitnesses(const std::vector<double>& a_fitnesses);
+
+#ifdef USE_BOOST_PYTHON
+
+    // takes a list of lists (or a 2D numpy array), returns a list of lists
+    py::list Step_python(py::object& a_observations, int a_depth);
+    void SetFitnesses_python(py::object& a_fitnesses);
+
+#endif
+};
+
+} // namespace NEAT
+
+#endif
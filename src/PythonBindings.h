@@ -36,6 +36,8 @@
 #include "Genes.h"
 #include "Genome.h"
 #include "Population.h"
+#include "PopulationEvaluator.h"
+#include "ThreadPool.h"
 #include "Species.h"
 #include "Parameters.h"
 #include "Random.h"
@@ -145,10 +147,15 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
             .def("RTRL_update_gradients",
             &NeuralNetwork::RTRL_update_gradients)
             .def("RTRL_update_error",
-            &NeuralNetwork::RTRL_update_error)
+            (void (NeuralNetwork::*)(double)) &NeuralNetwork::RTRL_update_error)
+            .def("RTRL_update_error",
+            (void (NeuralNetwork::*)(const std::vector<double>&)) &NeuralNetwork::RTRL_update_error)
             .def("RTRL_update_weights",
             &NeuralNetwork::RTRL_update_weights)
 
+            .def("Compile",
+            &NeuralNetwork::Compile)
+
             .def("ActivateFast",
             &NeuralNetwork::ActivateFast)
             .def("Activate",
@@ -157,9 +164,17 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
             &NeuralNetwork::ActivateUseInternalBias)
             .def("ActivateLeaky",
             &NeuralNetwork::ActivateLeaky)
+            .def("ActivateFeedForward",
+            &NeuralNetwork::ActivateFeedForward)
+            .def("IsFeedForward",
+            &NeuralNetwork::IsFeedForward)
+            .def("ActivateBatch",
+            &NeuralNetwork::ActivateBatch_python)
 
             .def("Adapt",
             &NeuralNetwork::Adapt)
+            .def("ActivateAdapt",
+            &NeuralNetwork::ActivateAdapt)
 
             .def("Flush",
             &NeuralNetwork::Flush)
@@ -195,8 +210,12 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
             .def("GetTotalConnectionLength", &NeuralNetwork::GetTotalConnectionLength)
 
 
-            .def_readwrite("neurons", &NeuralNetwork::m_neurons)
-            .def_readwrite("connections", &NeuralNetwork::m_connections)
+            // reading or assigning them recompiles the network on the next activation,
+            // since the returned items can be edited in place
+            .add_property("neurons", make_function(&NeuralNetwork::EditNeurons, return_internal_reference<>()),
+                          &NeuralNetwork::SetNeurons)
+            .add_property("connections", make_function(&NeuralNetwork::EditConnections, return_internal_reference<>()),
+                          &NeuralNetwork::SetConnections)
             ;
 
 
@@ -236,8 +255,10 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
             .def("NumInputs", &Genome::NumInputs)
             .def("NumOutputs", &Genome::NumOutputs)
 
-            .def_readwrite("NeuronGenes", &Genome::m_NeuronGenes)
-            .def_readwrite("LinkGenes", &Genome::m_LinkGenes)
+            // assigning them drops the gene index, call InvalidateIndex() after editing their items in place
+            .add_property("NeuronGenes", make_getter(&Genome::m_NeuronGenes), &Genome::SetNeuronGenes)
+            .add_property("LinkGenes", make_getter(&Genome::m_LinkGenes), &Genome::SetLinkGenes)
+            .def("InvalidateIndex", &Genome::InvalidateIndex)
             .def_readwrite("behavior", &Genome::m_behavior)
 
             .def("GetFitness", &Genome::GetFitness)
@@ -250,8 +271,11 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
             .def("PrintAllTraits", &Genome::PrintAllTraits)
 
             .def("BuildPhenotype", &Genome::BuildPhenotype)
-            .def("BuildHyperNEATPhenotype", &Genome::BuildHyperNEATPhenotype)
-            .def("BuildESHyperNEATPhenotype", &Genome::BuildESHyperNEATPhenotype)
+            .def("BuildHyperNEATPhenotype", (void (Genome::*)(NeuralNetwork&, Substrate&)) &Genome::BuildHyperNEATPhenotype)
+            .def("BuildHyperNEATPhenotype", (void (Genome::*)(NeuralNetwork&, Substrate&, unsigned int)) &Genome::BuildHyperNEATPhenotype)
+            .def("BuildHyperNEATPhenotype", (void (Genome::*)(NeuralNetwork&, Substrate&, ThreadPool&)) &Genome::BuildHyperNEATPhenotype)
+            .def("BuildESHyperNEATPhenotype", (void (Genome::*)(NeuralNetwork&, Substrate&, Parameters&)) &Genome::BuildESHyperNEATPhenotype)
+            .def("BuildESHyperNEATPhenotype", (void (Genome::*)(NeuralNetwork&, Substrate&, Parameters&, ThreadPool&)) &Genome::BuildESHyperNEATPhenotype)
 
             .def("Randomize_LinkWeights", &Genome::Randomize_LinkWeights)
             .def("Randomize_Traits", &Genome::Randomize_Traits)
@@ -347,6 +371,18 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
             .def_readwrite("m_Data", &PhenotypeBehavior::m_Data)
             ;
 
+    class_<ManhattanBehavior, bases<PhenotypeBehavior> >("ManhattanBehavior", init< optional<unsigned int> >())
+            .def("Distance_To", &ManhattanBehavior::Distance_To)
+            ;
+
+    class_<EuclideanBehavior, bases<PhenotypeBehavior> >("EuclideanBehavior", init< optional<unsigned int> >())
+            .def("Distance_To", &EuclideanBehavior::Distance_To)
+            ;
+
+    class_<CosineBehavior, bases<PhenotypeBehavior> >("CosineBehavior", init< optional<unsigned int> >())
+            .def("Distance_To", &CosineBehavior::Distance_To)
+            ;
+
 
 
 ///////////////////////////////////////////////////////////////////
@@ -357,7 +393,11 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
             .def(init<char*>())
             .def("Epoch", &Population::Epoch)
             .def("Tick", &Population::Tick, return_value_policy<reference_existing_object>())
-            .def("InitPhenotypeBehaviorData", &Population::InitPhenotypeBehaviorData)
+            .def("InitPhenotypeBehaviorData", (void (Population::*)(std::vector<PhenotypeBehavior>*, std::vector<PhenotypeBehavior>*))
+                                              &Population::InitPhenotypeBehaviorData)
+            .def("InitPhenotypeBehaviorData", &Population::InitPhenotypeBehaviorData<ManhattanBehavior>)
+            .def("InitPhenotypeBehaviorData", &Population::InitPhenotypeBehaviorData<EuclideanBehavior>)
+            .def("InitPhenotypeBehaviorData", &Population::InitPhenotypeBehaviorData<CosineBehavior>)
             .def("NoveltySearchTick", &Population::NoveltySearchTick)
             .def("Save", &Population::Save)
             .def("GetBestFitnessEver", &Population::GetBestFitnessEver)
@@ -375,6 +415,33 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
             .def_readwrite("RNG", &Population::m_RNG)
             ;
 
+///////////////////////////////////////////////////////////////////
+// ThreadPool class
+///////////////////////////////////////////////////////////////////
+
+    class_<ThreadPool, boost::noncopyable>("ThreadPool", init<>())
+            .def(init<unsigned int>())
+            .def("NumThreads", &ThreadPool::NumThreads)
+            ;
+
+///////////////////////////////////////////////////////////////////
+// PopulationEvaluator class
+///////////////////////////////////////////////////////////////////
+
+    class_<PopulationEvaluator, boost::noncopyable>("PopulationEvaluator", init<>())
+            .def(init<unsigned int>())
+            .def(init<unsigned int, bool>())
+            .def("Build", &PopulationEvaluator::Build)
+            .def("Flush", &PopulationEvaluator::Flush)
+            .def("Step", &PopulationEvaluator::Step_python)
+            .def("SetFitnesses", &PopulationEvaluator::SetFitnesses_python)
+            .def("GetGenome", &PopulationEvaluator::GetGenome, return_value_policy<reference_existing_object>())
+            .def("NumNetworks", &PopulationEvaluator::NumNetworks)
+            .def("NumInputs", &PopulationEvaluator::NumInputs)
+            .def("NumOutputs", &PopulationEvaluator::NumOutputs)
+            .def("IsSinglePrecision", &PopulationEvaluator::IsSinglePrecision)
+            ;
+
 ///////////////////////////////////////////////////////////////////
 // Parameters class
 ///////////////////////////////////////////////////////////////////
@@ -434,6 +501,7 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
             .def_readwrite("NoveltySearch_Quick_Archiving_Min_Evaluations", &Parameters::NoveltySearch_Quick_Archiving_Min_Evaluations)
             .def_readwrite("NoveltySearch_Pmin_raising_multiplier", &Parameters::NoveltySearch_Pmin_raising_multiplier)
             .def_readwrite("NoveltySearch_Recompute_Sparseness_Each", &Parameters::NoveltySearch_Recompute_Sparseness_Each)
+            .def_readwrite("NoveltySearch_VPTree", &Parameters::NoveltySearch_VPTree)
             .def_readwrite("MutateAddNeuronProb", &Parameters::MutateAddNeuronProb)
             .def_readwrite("SplitRecurrent", &Parameters::SplitRecurrent)
             .def_readwrite("SplitLoopedRecurrent", &Parameters::SplitLoopedRecurrent)
@@ -515,6 +583,8 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
             .def_readwrite("GeometrySeed", &Parameters::GeometrySeed)
             .def_readwrite("TournamentSize", &Parameters::TournamentSize)
             .def_readwrite("EliteFraction", &Parameters::EliteFraction)
+            .def_readwrite("NumThreads", &Parameters::NumThreads)
+            .def_readwrite("ParallelReproduction", &Parameters::ParallelReproduction)
 
 			.def_pickle(Parameters_pickle_suite())
         ;
@@ -578,6 +648,18 @@ BOOST_PYTHON_MODULE(_MultiNEAT)
     class_< std::vector<PhenotypeBehavior> >("PhenotypeBehaviorList")
             .def(vector_indexing_suite< std::vector<PhenotypeBehavior> >() )
             ;
+
+    class_< std::vector<ManhattanBehavior> >("ManhattanBehaviorList")
+            .def(vector_indexing_suite< std::vector<ManhattanBehavior> >() )
+            ;
+
+    class_< std::vector<EuclideanBehavior> >("EuclideanBehaviorList")
+            .def(vector_indexing_suite< std::vector<EuclideanBehavior> >() )
+            ;
+
+    class_< std::vector<CosineBehavior> >("CosineBehaviorList")
+            .def(vector_indexing_suite< std::vector<CosineBehavior> >() )
+            ;
 };
 
 #endif // USE_BOOST_PYTHON
@@ -46,12 +46,12 @@ namespace NEAT
     RNG global_rng;
     
     // Sorts the members of this species by fitness
-    bool fitness_greater(Genome *ls, Genome *rs)
+    bool fitness_greater(const Genome *ls, const Genome *rs)
     {
         return ((ls->GetFitness()) > (rs->GetFitness()));
     }
     
-    bool genome_greater(Genome ls, Genome rs)
+    bool genome_greater(const Genome &ls, const Genome &rs)
     {
         return (ls.GetFitness() > rs.GetFitness());
     }
@@ -120,34 +120,34 @@ namespace NEAT
 
 
     // returns an individual randomly selected from the best N%
-    Genome Species::GetIndividual(Parameters &a_Parameters, RNG &a_RNG) const
+    const Genome &Species::GetIndividual(Parameters &a_Parameters, RNG &a_RNG) const
     {
         ASSERT(m_Individuals.size() > 0);
 
         // Make a pool of only evaluated individuals!
-        std::vector<Genome> t_Evaluated;
+        std::vector<const Genome *> t_Evaluated;
         for (unsigned int i = 0; i < m_Individuals.size(); i++)
         {
             if (m_Individuals[i].IsEvaluated())
-                t_Evaluated.push_back(m_Individuals[i]);
+                t_Evaluated.push_back(&m_Individuals[i]);
         }
 
         ASSERT(t_Evaluated.size() > 0);
 
         if (t_Evaluated.size() == 1)
         {
-            return (t_Evaluated[0]);
+            return *(t_Evaluated[0]);
         }
         else if (t_Evaluated.size() == 2)
         {
-            return (t_Evaluated[Rounded(a_RNG.RandFloat())]);
+            return *(t_Evaluated[Rounded(a_RNG.RandFloat())]);
         }
 
         // Warning!!!! The individuals must be sorted by best fitness for this to work
         int t_chosen_one = 0;
         
         // then sort them here just to make sure
-        std::sort(t_Evaluated.begin(), t_Evaluated.end(), genome_greater);
+        std::sort(t_Evaluated.begin(), t_Evaluated.end(), fitness_greater);
 
         // Here might be introduced better selection scheme, but this works OK for now
         if (!a_Parameters.RouletteWheelSelection)
@@ -182,12 +182,12 @@ namespace NEAT
             std::vector<double> t_probs;
             for (unsigned int i = 0; i < t_Evaluated.size(); i++)
             {
-                t_probs.push_back(t_Evaluated[i].GetFitness());
+                t_probs.push_back(t_Evaluated[i]->GetFitness());
             }
             t_chosen_one = a_RNG.Roulette(t_probs);
         }
 
-        return (t_Evaluated[t_chosen_one]);
+        return *(t_Evaluated[t_chosen_one]);
     }
 
 
@@ -313,6 +313,41 @@ namespace NEAT
         std::sort(m_Individuals.begin(), m_Individuals.end(), genome_greater);
     }
 
+    void Species::ResortIndividuals()
+    {
+        unsigned int t_unsorted = 0;
+        for (unsigned int i = 1; i < m_Individuals.size(); i++)
+        {
+            if (genome_greater(m_Individuals[i], m_Individuals[i - 1]))
+            {
+                t_unsorted++;
+            }
+        }
+
+        if (t_unsorted == 0)
+        {
+            return;
+        }
+
+        // too many to move one by one
+        if (t_unsorted > 8)
+        {
+            std::stable_sort(m_Individuals.begin(), m_Individuals.end(), genome_greater);
+            return;
+        }
+
+        // move each one that is better than the one before it up to its place
+        for (unsigned int i = 1; i < m_Individuals.size(); i++)
+        {
+            if (genome_greater(m_Individuals[i], m_Individuals[i - 1]))
+            {
+                std::vector<Genome>::iterator t_pos = std::upper_bound(m_Individuals.begin(), m_Individuals.begin() + i,
+                                                                       m_Individuals[i], genome_greater);
+                std::rotate(t_pos, m_Individuals.begin() + i, m_Individuals.begin() + i + 1);
+            }
+        }
+    }
+
 
 // Removes an individual from the species by its index within the species
     void Species::RemoveIndividual(unsigned int a_idx)
@@ -321,6 +356,17 @@ namespace NEAT
         m_Individuals.erase(m_Individuals.begin() + a_idx);
     }
 
+    // how many babies this species will spawn and how many of them are copies of its elite
+    void Species::GetOffspringCounts(const Parameters &a_Parameters, int &a_Total, int &a_Elite) const
+    {
+        a_Total = Rounded(GetOffspringRqd());
+        a_Elite = Rounded(a_Parameters.EliteFraction * m_Individuals.size());
+        if (a_Elite < 1) // can't be 0
+        {
+            a_Elite = 1;
+        }
+    }
+
     // Reproduce mates & mutates the individuals of the species
     // It may access the global species list in the population
     // because some babies may turn out to belong in another species
@@ -330,12 +376,8 @@ namespace NEAT
     {
         Genome t_baby; // temp genome for reproduction
 
-        int t_offspring_count = Rounded(GetOffspringRqd());
-        int elite_offspring = Rounded(a_Parameters.EliteFraction * m_Individuals.size());
-        if (elite_offspring < 1) // can't be 0
-        {
-            elite_offspring = 1;
-        }
+        int t_offspring_count, elite_offspring;
+        GetOffspringCounts(a_Parameters, t_offspring_count, elite_offspring);
         // ensure we have a champ
         int elite_count = 0;
         // no offspring?! yikes.. dead species!
@@ -364,208 +406,211 @@ namespace NEAT
             {
                 do // - while the baby already exists somewhere in the new population or turned invalid in some way
                 {
-                    // this tells us if the baby is a result of mating
-                    bool t_mated = false;
+                    t_baby = ProduceBaby(t_baby_exists_in_pop, a_Pop, a_Pop.AccessInnovationDatabase(), a_Parameters, a_RNG);
+                    t_baby_exists_in_pop = BabyExists(t_baby, a_Pop, a_Parameters);
+                }
+                while (t_baby_exists_in_pop || (t_baby.FailsConstraints(a_Parameters))); // end do
+            }
 
-                    // There must be individuals there..
-                    ASSERT(NumIndividuals() > 0);
+            AddBaby(t_baby, a_Pop, a_Parameters);
+        }
+    }
 
-                    // for a species of size 1 we can only mutate
-                    // NOTE: but does it make sense since we know this is the champ?
-                    if (NumIndividuals() == 1)
-                    {
-                        t_baby = GetIndividual(a_Parameters, a_RNG);
-                        t_mated = false;
-                    }
-                        // else we can mate
-                    else
-                    {
-                        Genome t_mom = GetIndividual(a_Parameters, a_RNG);
 
-                        // choose whether to mate at all
-                        // Do not allow crossover when in simplifying phase
-                        if ((a_RNG.RandFloat() < a_Parameters.CrossoverRate) && (a_Pop.GetSearchMode() != SIMPLIFYING))
-                        {
-                            // get the father
-                            Genome t_dad;
-                            bool t_interspecies = false;
+    // Selects the parent(s) and makes one mutated or mated baby.
+    // New innovations go to a_Innovs.
+    Genome Species::ProduceBaby(bool a_BabyIsClone, Population &a_Pop, InnovationDatabase &a_Innovs,
+                                Parameters &a_Parameters, RNG &a_RNG) const
+    {
+        Genome t_baby;
 
-                            // There is a probability that the father may come from another species
-                            if ((a_RNG.RandFloat() < a_Parameters.InterspeciesCrossoverRate) &&
-                                (a_Pop.m_Species.size() > 1))
-                            {
-                                // Find different species (random one) // !!!!!!!!!!!!!!!!!
-                                int t_diffspec = a_RNG.RandInt(0, static_cast<int>(a_Pop.m_Species.size() - 1));
-                                t_dad = a_Pop.m_Species[t_diffspec].GetIndividual(a_Parameters, a_RNG);
-                                t_interspecies = true;
-                            }
-                            else
-                            {
-                                // Mate within species
-                                t_dad = GetIndividual(a_Parameters, a_RNG);
-
-                                // The other parent should be a different one
-                                // number of tries to find different parent
-                                int t_tries = 1024;
-                                if (!a_Parameters.AllowClones)
-                                {
-                                    while (((t_mom.GetID() == t_dad.GetID()) ||
-                                            (t_mom.CompatibilityDistance(t_dad, a_Parameters) < COMPAT_EQUALITY_DELTA)) &&
-                                           (t_tries--))
-                                    {
-                                        t_dad = GetIndividual(a_Parameters, a_RNG);
-                                    }
-                                }
-                                else
-                                {
-                                    while (((t_mom.GetID() == t_dad.GetID())) && (t_tries--))
-                                    {
-                                        t_dad = GetIndividual(a_Parameters, a_RNG);
-                                    }
-                                }
-                                t_interspecies = false;
-                            }
+        // this tells us if the baby is a result of mating
+        bool t_mated = false;
 
-                            // OK we have both mom and dad so mate them
-                            // Choose randomly one of two types of crossover
-                            if (a_RNG.RandFloat() < a_Parameters.MultipointCrossoverRate)
-                            {
-                                t_baby = t_mom.Mate(t_dad, false, t_interspecies, a_RNG, a_Parameters);
-                            }
-                            else
-                            {
-                                t_baby = t_mom.Mate(t_dad, true, t_interspecies, a_RNG, a_Parameters);
-                            }
+        // There must be individuals there..
+        ASSERT(NumIndividuals() > 0);
 
-                            t_mated = true;
-                        }
-                            // don't mate - reproduce the mother asexually
-                        else
-                        {
-                            t_baby = t_mom;
-                            t_mated = false;
-                        }
-                    }
+        // for a species of size 1 we can only mutate
+        // NOTE: but does it make sense since we know this is the champ?
+        if (NumIndividuals() == 1)
+        {
+            t_baby = GetIndividual(a_Parameters, a_RNG);
+            t_mated = false;
+        }
+            // else we can mate
+        else
+        {
+            const Genome &t_mom = GetIndividual(a_Parameters, a_RNG);
 
-                    // Mutate the baby
-                    if ((!t_mated) || (a_RNG.RandFloat() < a_Parameters.OverallMutationRate))
-                    {
-                        MutateGenome(t_baby_exists_in_pop, a_Pop, t_baby, a_Parameters, a_RNG);
-                    }
+            // choose whether to mate at all
+            // Do not allow crossover when in simplifying phase
+            if ((a_RNG.RandFloat() < a_Parameters.CrossoverRate) && (a_Pop.GetSearchMode() != SIMPLIFYING))
+            {
+                // get the father
+                const Genome *t_dad = NULL;
+                bool t_interspecies = false;
 
-                    // Check if this baby is already present somewhere in the offspring
-                    // we don't want that
-                    t_baby_exists_in_pop = false;
-                    // Unless of course, we want clones to exist
+                // There is a probability that the father may come from another species
+                if ((a_RNG.RandFloat() < a_Parameters.InterspeciesCrossoverRate) &&
+                    (a_Pop.m_Species.size() > 1))
+                {
+                    // Find different species (random one) // !!!!!!!!!!!!!!!!!
+                    int t_diffspec = a_RNG.RandInt(0, static_cast<int>(a_Pop.m_Species.size() - 1));
+                    t_dad = &a_Pop.m_Species[t_diffspec].GetIndividual(a_Parameters, a_RNG);
+                    t_interspecies = true;
+                }
+                else
+                {
+                    // Mate within species
+                    t_dad = &GetIndividual(a_Parameters, a_RNG);
+
+                    // The other parent should be a different one
+                    // number of tries to find different parent
+                    int t_tries = 1024;
                     if (!a_Parameters.AllowClones)
                     {
-                        for (unsigned int i = 0; i < a_Pop.m_TempSpecies.size(); i++)
+                        while (((t_mom.GetID() == t_dad->GetID()) ||
+                                (t_mom.CompatibilityDistance(*t_dad, a_Parameters, COMPAT_EQUALITY_DELTA) < COMPAT_EQUALITY_DELTA)) &&
+                               (t_tries--))
                         {
-                            for (unsigned int j = 0; j < a_Pop.m_TempSpecies[i].m_Individuals.size(); j++)
-                            {
-                                if (
-                                        (t_baby.CompatibilityDistance(a_Pop.m_TempSpecies[i].m_Individuals[j],
-                                                                      a_Parameters) < COMPAT_EQUALITY_DELTA) // identical genome?
-                                        )
-                                {
-                                    t_baby_exists_in_pop = true;
-                                    break;
-                                }
-                            }
+                            t_dad = &GetIndividual(a_Parameters, a_RNG);
                         }
                     }
-
-                    // In case we want to enforce always new individuals
-                    if (a_Parameters.ArchiveEnforcement)
+                    else
                     {
-                        for (unsigned int i = 0; i < a_Pop.m_GenomeArchive.size(); i++)
+                        while (((t_mom.GetID() == t_dad->GetID())) && (t_tries--))
                         {
-                            if (
-                                    (t_baby.CompatibilityDistance(a_Pop.m_GenomeArchive[i],
-                                                                  a_Parameters) < COMPAT_EQUALITY_DELTA) // identical genome?
-                                    )
-                            {
-                                t_baby_exists_in_pop = true;
-                                break;
-                            }
+                            t_dad = &GetIndividual(a_Parameters, a_RNG);
                         }
                     }
+                    t_interspecies = false;
                 }
-                while (t_baby_exists_in_pop || (t_baby.FailsConstraints(a_Parameters))); // end do
+
+                // OK we have both mom and dad so mate them
+                // Choose randomly one of two types of crossover
+                if (a_RNG.RandFloat() < a_Parameters.MultipointCrossoverRate)
+                {
+                    t_baby = t_mom.Mate(*t_dad, false, t_interspecies, a_RNG, a_Parameters);
+                }
+                else
+                {
+                    t_baby = t_mom.Mate(*t_dad, true, t_interspecies, a_RNG, a_Parameters);
+                }
+
+                t_mated = true;
+            }
+                // don't mate - reproduce the mother asexually
+            else
+            {
+                t_baby = t_mom;
+                t_mated = false;
             }
+        }
 
-            // We have a new offspring now
-            // give the offspring a new ID
-            t_baby.SetID(a_Pop.GetNextGenomeID());
-            a_Pop.IncrementNextGenomeID();
+        // Mutate the baby
+        if ((!t_mated) || (a_RNG.RandFloat() < a_Parameters.OverallMutationRate))
+        {
+            MutateGenome(a_BabyIsClone, a_Pop, a_Innovs, t_baby, a_Parameters, a_RNG);
+        }
 
-            // sort the baby's genes
-            t_baby.SortGenes();
+        return t_baby;
+    }
 
-            // clear the baby's fitness
-            t_baby.SetFitness(0);
-            t_baby.SetAdjFitness(0);
-            t_baby.SetOffspringAmount(0);
 
-            t_baby.ResetEvaluated();
+    // Returns true if the baby is a clone of a genome already in the new population (or the archive)
+    bool Species::BabyExists(Genome &t_baby, Population &a_Pop, Parameters &a_Parameters) const
+    {
+        // Check if this baby is already present somewhere in the offspring
+        // we don't want that
+        bool t_baby_exists_in_pop = false;
+        // Unless of course, we want clones to exist
+        if (!a_Parameters.AllowClones)
+        {
+            t_baby_exists_in_pop = a_Pop.TempSpeciesHasClone(t_baby, COMPAT_EQUALITY_DELTA, a_Parameters);
+        }
 
-            // Archive the baby if needed
-            if (a_Parameters.ArchiveEnforcement)
-            {
-                a_Pop.m_GenomeArchive.push_back(t_baby);
-            }
+        // In case we want to enforce always new individuals
+        if ((!t_baby_exists_in_pop) && a_Parameters.ArchiveEnforcement)
+        {
+            t_baby_exists_in_pop = a_Pop.ArchiveHasClone(t_baby, COMPAT_EQUALITY_DELTA, a_Parameters);
+        }
 
-            //////////////////////////////////
-            // put the baby to its species  //
-            //////////////////////////////////
+        return t_baby_exists_in_pop;
+    }
 
-            // before Reproduce() is invoked, it is assumed that a
-            // clone of the population exists with the name of m_TempSpecies
-            // we will store results there.
-            // after all reproduction completes, the original species will be replaced back
 
-            bool t_found = false;
-            std::vector<Species>::iterator t_cur_species = a_Pop.m_TempSpecies.begin();
+    // Gives the baby a new ID and puts it in a compatible species in a_Pop.m_TempSpecies
+    void Species::AddBaby(Genome &t_baby, Population &a_Pop, Parameters &a_Parameters)
+    {
+        // We have a new offspring now
+        // give the offspring a new ID
+        t_baby.SetID(a_Pop.GetNextGenomeID());
+        a_Pop.IncrementNextGenomeID();
 
-            // No species yet?
-            if (t_cur_species == a_Pop.m_TempSpecies.end())
-            {
-                // create the first species and place the baby there
-                a_Pop.m_TempSpecies.push_back(Species(t_baby, a_Pop.GetNextSpeciesID()));
-                a_Pop.IncrementNextSpeciesID();
-            }
-            else
-            {
-                // try to find a compatible species
-                Genome t_to_compare = t_cur_species->GetRepresentative();
+        // sort the baby's genes
+        t_baby.SortGenes();
+
+        // clear the baby's fitness
+        t_baby.SetFitness(0);
+        t_baby.SetAdjFitness(0);
+        t_baby.SetOffspringAmount(0);
 
-                t_found = false;
-                while ((t_cur_species != a_Pop.m_TempSpecies.end()) && (!t_found))
+        t_baby.ResetEvaluated();
+
+        // Archive the baby if needed
+        if (a_Parameters.ArchiveEnforcement)
+        {
+            a_Pop.m_GenomeArchive.push_back(t_baby);
+        }
+
+        //////////////////////////////////
+        // put the baby to its species  //
+        //////////////////////////////////
+
+        // before Reproduce() is invoked, it is assumed that a
+        // clone of the population exists with the name of m_TempSpecies
+        // we will store results there.
+        // after all reproduction completes, the original species will be replaced back
+
+        bool t_found = false;
+        std::vector<Species>::iterator t_cur_species = a_Pop.m_TempSpecies.begin();
+
+        // No species yet?
+        if (t_cur_species == a_Pop.m_TempSpecies.end())
+        {
+            // create the first species and place the baby there
+            a_Pop.m_TempSpecies.push_back(Species(t_baby, a_Pop.GetNextSpeciesID()));
+            a_Pop.IncrementNextSpeciesID();
+            a_Pop.m_TempClones.Add(t_baby, CloneIndex::Ref(a_Pop.m_TempSpecies.size() - 1, 0));
+        }
+        else
+        {
+            // try to find a compatible species
+            t_found = false;
+            while ((t_cur_species != a_Pop.m_TempSpecies.end()) && (!t_found))
+            {
+                if (t_baby.IsCompatibleWith(t_cur_species->Representative(), a_Parameters))
                 {
-                    if (t_baby.IsCompatibleWith(t_to_compare, a_Parameters))
-                    {
-                        // found a compatible species
-                        t_cur_species->AddIndividual(t_baby);
-                        t_found = true; // the search is over
-                    }
-                    else
-                    {
-                        // keep searching for a matching species
-                        t_cur_species++;
-                        if (t_cur_species != a_Pop.m_TempSpecies.end())
-                        {
-                            t_to_compare = t_cur_species->GetRepresentative();
-                        }
-                    }
+                    // found a compatible species
+                    t_cur_species->AddIndividual(t_baby);
+                    a_Pop.m_TempClones.Add(t_baby, CloneIndex::Ref(t_cur_species - a_Pop.m_TempSpecies.begin(),
+                                                                   t_cur_species->m_Individuals.size() - 1));
+                    t_found = true; // the search is over
                 }
-
-                // if couldn't find a match, make a new species
-                if (!t_found)
+                else
                 {
-                    a_Pop.m_TempSpecies.push_back(Species(t_baby, a_Pop.GetNextSpeciesID()));
-                    a_Pop.IncrementNextSpeciesID();
+                    // keep searching for a matching species
+                    t_cur_species++;
                 }
             }
+
+            // if couldn't find a match, make a new species
+            if (!t_found)
+            {
+                a_Pop.m_TempSpecies.push_back(Species(t_baby, a_Pop.GetNextSpeciesID()));
+                a_Pop.IncrementNextSpeciesID();
+                a_Pop.m_TempClones.Add(t_baby, CloneIndex::Ref(a_Pop.m_TempSpecies.size() - 1, 0));
+            }
         }
     }
 
@@ -622,14 +667,14 @@ namespace NEAT
                 // else we can mate
             else
             {
-                Genome t_mom = GetIndividual(a_Parameters, a_RNG);
+                const Genome &t_mom = GetIndividual(a_Parameters, a_RNG);
             
                 // choose whether to mate at all
                 // Do not allow crossover when in simplifying phase
                 if ((a_RNG.RandFloat() < a_Parameters.CrossoverRate) && (a_Pop.GetSearchMode() != SIMPLIFYING))
                 {
                     // get the father
-                    Genome t_dad;
+                    const Genome *t_dad = NULL;
                     bool t_interspecies = false;
                 
                     // There is a probability that the father may come from another species
@@ -638,31 +683,31 @@ namespace NEAT
                     {
                         // Find different species (random one) // !!!!!!!!!!!!!!!!!
                         int t_diffspec = a_RNG.RandInt(0, static_cast<int>(a_Pop.m_Species.size() - 1));
-                        t_dad = a_Pop.m_Species[t_diffspec].GetIndividual(a_Parameters, a_RNG);
+                        t_dad = &a_Pop.m_Species[t_diffspec].GetIndividual(a_Parameters, a_RNG);
                         t_interspecies = true;
                     }
                     else
                     {
                         // Mate within species
-                        t_dad = GetIndividual(a_Parameters, a_RNG);
+                        t_dad = &GetIndividual(a_Parameters, a_RNG);
                     
                         // The other parent should be a different one
                         // number of tries to find different parent
                         int t_tries = 1024;
                         if (!a_Parameters.AllowClones)
                         {
-                            while (((t_mom.GetID() == t_dad.GetID()) ||
-                                    (t_mom.CompatibilityDistance(t_dad, a_Parameters) < COMPAT_EQUALITY_DELTA)) &&
+                            while (((t_mom.GetID() == t_dad->GetID()) ||
+                                    (t_mom.CompatibilityDistance(*t_dad, a_Parameters, COMPAT_EQUALITY_DELTA) < COMPAT_EQUALITY_DELTA)) &&
                                    (t_tries--))
                             {
-                                t_dad = GetIndividual(a_Parameters, a_RNG);
+                                t_dad = &GetIndividual(a_Parameters, a_RNG);
                             }
                         }
                         else
                         {
-                            while (((t_mom.GetID() == t_dad.GetID())) && (t_tries--))
+                            while (((t_mom.GetID() == t_dad->GetID())) && (t_tries--))
                             {
-                                t_dad = GetIndividual(a_Parameters, a_RNG);
+                                t_dad = &GetIndividual(a_Parameters, a_RNG);
                             }
                         }
                         t_interspecies = false;
@@ -672,11 +717,11 @@ namespace NEAT
                     // Choose randomly one of two types of crossover
                     if (a_RNG.RandFloat() < a_Parameters.MultipointCrossoverRate)
                     {
-                        t_baby = t_mom.Mate(t_dad, false, t_interspecies, a_RNG, a_Parameters);
+                        t_baby = t_mom.Mate(*t_dad, false, t_interspecies, a_RNG, a_Parameters);
                     }
                     else
                     {
-                        t_baby = t_mom.Mate(t_dad, true, t_interspecies, a_RNG, a_Parameters);
+                        t_baby = t_mom.Mate(*t_dad, true, t_interspecies, a_RNG, a_Parameters);
                     }
                 
                     t_mated = true;
@@ -708,7 +753,7 @@ namespace NEAT
                     {
                         if (
                                 (t_baby.CompatibilityDistance(a_Pop.m_Species[i].m_Individuals[j],
-                                                              a_Parameters) < COMPAT_EQUALITY_DELTA) // identical genome?
+                                                              a_Parameters, COMPAT_EQUALITY_DELTA) < COMPAT_EQUALITY_DELTA) // identical genome?
                                 )
                         {
                             t_baby_exists_in_pop = true;
@@ -719,19 +764,9 @@ namespace NEAT
             }
 
             // In case we want to enforce always new individuals
-            if (a_Parameters.ArchiveEnforcement)
+            if ((!t_baby_exists_in_pop) && a_Parameters.ArchiveEnforcement)
             {
-                for (unsigned int i = 0; i < a_Pop.m_GenomeArchive.size(); i++)
-                {
-                    if (
-                            (t_baby.CompatibilityDistance(a_Pop.m_GenomeArchive[i],
-                                                          a_Parameters) < COMPAT_EQUALITY_DELTA) // identical genome?
-                            )
-                    {
-                        t_baby_exists_in_pop = true;
-                        break;
-                    }
-                }
+                t_baby_exists_in_pop = a_Pop.ArchiveHasClone(t_baby, COMPAT_EQUALITY_DELTA, a_Parameters);
             }
         }
         while (t_baby_exists_in_pop || t_baby.FailsConstraints(a_Parameters)); // end do
@@ -766,18 +801,26 @@ namespace NEAT
     void
     Species::MutateGenome(bool t_baby_is_clone, Population &a_Pop, Genome &t_baby, Parameters &a_Parameters, RNG &a_RNG)
     {
+        MutateGenome(t_baby_is_clone, a_Pop, a_Pop.AccessInnovationDatabase(), t_baby, a_Parameters, a_RNG);
+    }
+
+    // Mutates a genome, registering any new structure in a_Innovs
+    void
+    Species::MutateGenome(bool t_baby_is_clone, const Population &a_Pop, InnovationDatabase &a_Innovs,
+                          Genome &t_baby, Parameters &a_Parameters, RNG &a_RNG) const
+    {
 #if 0
         if ((a_RNG.RandFloat() < a_Parameters.MutateAddNeuronProb) && (a_Pop.GetSearchMode() != SIMPLIFYING))
         {
-            t_baby.Mutate_AddNeuron(a_Pop.AccessInnovationDatabase(), a_Parameters, a_RNG);
+            t_baby.Mutate_AddNeuron(a_Innovs, a_Parameters, a_RNG);
         }
         else if ((a_RNG.RandFloat() < a_Parameters.MutateAddLinkProb) && (a_Pop.GetSearchMode() != SIMPLIFYING))
         {
-            t_baby.Mutate_AddLink(a_Pop.AccessInnovationDatabase(), a_Parameters, a_RNG);
+            t_baby.Mutate_AddLink(a_Innovs, a_Parameters, a_RNG);
         }
         else if ((a_RNG.RandFloat() < a_Parameters.MutateRemSimpleNeuronProb) && (a_Pop.GetSearchMode() != COMPLEXIFYING))
         {
-            t_baby.Mutate_RemoveSimpleNeuron(a_Pop.AccessInnovationDatabase(), a_RNG);
+            t_baby.Mutate_RemoveSimpleNeuron(a_Innovs, a_RNG);
         }
         else if ((a_RNG.RandFloat() < a_Parameters.MutateRemLinkProb) && (a_Pop.GetSearchMode() != COMPLEXIFYING))
         {
@@ -915,15 +958,15 @@ namespace NEAT
             switch (ChosenMutation)
             {
                 case ADD_NODE:
-                    t_mutation_success = t_baby.Mutate_AddNeuron(a_Pop.AccessInnovationDatabase(), a_Parameters, a_RNG);
+                    t_mutation_success = t_baby.Mutate_AddNeuron(a_Innovs, a_Parameters, a_RNG);
                     break;
             
                 case ADD_LINK:
-                    t_mutation_success = t_baby.Mutate_AddLink(a_Pop.AccessInnovationDatabase(), a_Parameters, a_RNG);
+                    t_mutation_success = t_baby.Mutate_AddLink(a_Innovs, a_Parameters, a_RNG);
                     break;
             
                 case REMOVE_NODE:
-                    t_mutation_success = t_baby.Mutate_RemoveSimpleNeuron(a_Pop.AccessInnovationDatabase(), a_RNG);
+                    t_mutation_success = t_baby.Mutate_RemoveSimpleNeuron(a_Innovs, a_RNG);
                     break;
             
                 case REMOVE_LINK:
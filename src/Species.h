@@ -102,9 +102,15 @@ public:
     // initializes a species with a leader genome and an ID number
     Species(const Genome& a_Seed, int a_id);
 
+    Species(const Species& a_S) = default;
+
     // assignment operator
     Species& operator=(const Species& a_g);
 
+    // moving leaves the genomes where they are, so sorting and erasing species is cheap
+    Species(Species&& a_S) noexcept = default;
+    Species& operator=(Species&& a_S) noexcept = default;
+
     // comparison operator (nessesary for boost::python)
     // todo: implement a better comparison technique
     bool operator==(Species const& other) const { return m_ID == other.m_ID; }
@@ -129,7 +135,7 @@ public:
     void IncreaseEvalsNoImprovement() { m_EvalsNoImprovement++; }
     void SetOffspringRqd(double a_ofs) { m_OffspringRqd = a_ofs; }
     double GetOffspringRqd() const { return m_OffspringRqd; }
-    unsigned int NumIndividuals() { return m_Individuals.size(); }
+    unsigned int NumIndividuals() const { return m_Individuals.size(); }
     void ClearIndividuals() { m_Individuals.clear(); }
     int ID() { return m_ID; }
     int GensNoImprovement() { return m_GensNoImprovement; }
@@ -145,12 +151,15 @@ public:
     Genome GetLeader() const;
 
     Genome GetRepresentative() const;
+    // same, without the copy
+    const Genome& Representative() const { return m_Representative; }
 
     // adds a new member to the species and updates variables
     void AddIndividual(Genome& a_New);
 
     // returns an individual randomly selected from the best N%
-    Genome GetIndividual(Parameters& a_Parameters, RNG& a_RNG) const;
+    // (a reference into m_Individuals, valid until the species changes)
+    const Genome& GetIndividual(Parameters& a_Parameters, RNG& a_RNG) const;
 
     // returns a completely random individual
     Genome GetRandomIndividual(RNG& a_RNG) const;
@@ -166,6 +175,10 @@ public:
     // Sorts the individuals
     void SortIndividuals();
 
+    // Sorts the individuals too, but only moves the ones that are out of place.
+    // Cheap when a few fitnesses changed since the last sort. Equal ones keep their order.
+    void ResortIndividuals();
+
 
 
 
@@ -179,6 +192,20 @@ public:
     void Reproduce(Population& a_Pop, Parameters& a_Parameters, RNG& a_RNG);
 
     void MutateGenome( bool t_baby_is_clone, Population &a_Pop, Genome &t_baby, Parameters& a_Parameters, RNG& a_RNG);
+    // same, but the new innovations go to a_Innovs instead of the population's database
+    void MutateGenome( bool t_baby_is_clone, const Population &a_Pop, InnovationDatabase &a_Innovs,
+                       Genome &t_baby, Parameters& a_Parameters, RNG& a_RNG) const;
+
+    // The steps of Reproduce(), also used by the parallel reproduction in Population.
+    // how many babies this species spawns and how many of them are copies of its elite
+    void GetOffspringCounts(const Parameters& a_Parameters, int& a_Total, int& a_Elite) const;
+    // selects the parent(s) and makes one new (mated and/or mutated) baby
+    Genome ProduceBaby(bool a_BabyIsClone, Population& a_Pop, InnovationDatabase& a_Innovs,
+                       Parameters& a_Parameters, RNG& a_RNG) const;
+    // true if the baby is a clone of a genome in the new population (or the archive)
+    bool BabyExists(Genome& a_Baby, Population& a_Pop, Parameters& a_Parameters) const;
+    // gives the baby an ID and places it into a compatible species of the new population
+    static void AddBaby(Genome& a_Baby, Population& a_Pop, Parameters& a_Parameters);
 
     // Removes all individuals
     void Clear()
@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////////////////
+//    MultiNEAT - Python/C++ NeuroEvolution of Augmenting Topologies Library
+//
+//    Copyright (C) 2012 Peter Chervenski
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with this program.  If not, see < http://www.gnu.org/licenses/ >.
+//
+//    Contact info:
+//
+//    Peter Chervenski < spookey@abv.bg >
+//    Shane Ryan < shane.mcdonald.ryan@gmail.com >
+///////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// File:        ThreadPool.cpp
+// Description: Implementation of the ThreadPool class.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ThreadPool.h"
+
+namespace NEAT
+{
+
+ThreadPool::ThreadPool(unsigned int a_num_threads)
+{
+    m_task = NULL;
+    m_count = 0;
+    m_next = 0;
+    m_generation = 0;
+    m_busy = 0;
+    m_quit = false;
+
+    if (a_num_threads == 0)
+    {
+        a_num_threads = std::thread::hardware_concurrency();
+    }
+
+    // the calling thread is one of them
+    for (unsigned int i = 1; i < a_num_threads; i++)
+    {
+        m_workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> t_lock(m_mutex);
+        m_quit = true;
+    }
+    m_start.notify_all();
+
+    for (unsigned int i = 0; i < m_workers.size(); i++)
+    {
+        m_workers[i].join();
+    }
+}
+
+void ThreadPool::RunTasks(std::unique_lock<std::mutex>& a_lock)
+{
+    while (m_next < m_count)
+    {
+        unsigned int t_idx = m_next++;
+        const std::function<void(unsigned int)>& t_task = *m_task;
+
+        a_lock.unlock();
+        try
+        {
+            t_task(t_idx);
+        }
+        catch (...)
+        {
+            a_lock.lock();
+            if (!m_error)
+            {
+                m_error = std::current_exception();
+            }
+            m_next = m_count; // no point in going on
+            continue;
+        }
+        a_lock.lock();
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    unsigned int t_seen = 0;
+    std::unique_lock<std::mutex> t_lock(m_mutex);
+
+    for (;;)
+    {
+        m_start.wait(t_lock, [&]() { return m_quit || (m_generation != t_seen); });
+        if (m_quit)
+            return;
+
+        t_seen = m_generation;
+        m_busy++;
+        RunTasks(t_lock);
+        m_busy--;
+
+        if (m_busy == 0)
+        {
+            m_done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::ParallelFor(unsigned int a_count, const std::function<void(unsigned int)>& a_task)
+{
+    if (a_count == 0)
+        return;
+
+    // nothing to share, or nobody to share it with
+    if ((a_count == 1) || m_workers.empty())
+    {
+        for (unsigned int i = 0; i < a_count; i++)
+        {
+            a_task(i);
+        }
+        return;
+    }
+
+    std::unique_lock<std::mutex> t_lock(m_mutex);
+    m_task = &a_task;
+    m_count = a_count;
+    m_next = 0;
+    m_error = std::exception_ptr();
+    m_generation++;
+    m_start.notify_all();
+
+    RunTasks(t_lock);
+
+    // wait for the workers that are still inside a task
+    m_done.wait(t_lock, [&]() { return m_busy == 0; });
+    m_task = NULL;
+    m_count = 0;
+
+    if (m_error)
+    {
+        std::exception_ptr t_error = m_error;
+        m_error = std::exception_ptr();
+        std::rethrow_exception(t_error);
+    }
+}
+
+} // namespace NEAT
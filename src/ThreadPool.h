@@ -0,0 +1,83 @@
+#ifndef _THREADPOOL_H
+#define _THREADPOOL_H
+
+///////////////////////////////////////////////////////////////////////////////////////////
+//    MultiNEAT - Python/C++ NeuroEvolution of Augmenting Topologies Library
+//
+//    Copyright (C) 2012 Peter Chervenski
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Lesser General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public License
+//    along with this program.  If not, see < http://www.gnu.org/licenses/ >.
+//
+//    Contact info:
+//
+//    Peter Chervenski < spookey@abv.bg >
+//    Shane Ryan < shane.mcdonald.ryan@gmail.com >
+///////////////////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+// File:        ThreadPool.h
+// Description: A small pool of worker threads for data-parallel loops.
+///////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+namespace NEAT
+{
+
+class ThreadPool
+{
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+
+    // the current job
+    const std::function<void(unsigned int)>* m_task;
+    unsigned int m_count;
+    unsigned int m_next;       // next index to hand out
+    unsigned int m_generation; // incremented for every job, wakes the workers
+    unsigned int m_busy;       // workers still inside the current job
+    bool m_quit;
+    std::exception_ptr m_error;
+
+    void WorkerLoop();
+    // takes indices of the current job until there are none left
+    void RunTasks(std::unique_lock<std::mutex>& a_lock);
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+public:
+
+    // a_num_threads includes the calling thread, 0 means one per hardware thread
+    ThreadPool(unsigned int a_num_threads = 0);
+    ~ThreadPool();
+
+    unsigned int NumThreads() const { return m_workers.size() + 1; }
+
+    // Calls a_task(i) for every i in [0, a_count) and blocks until all calls returned.
+    // The calling thread takes part in the work. Indices are handed out one at a time,
+    // so the tasks should be coarse. The first exception thrown by a task is rethrown here.
+    void ParallelFor(unsigned int a_count, const std::function<void(unsigned int)>& a_task);
+};
+
+} // namespace NEAT
+
+#endif
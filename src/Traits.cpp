@@ -4,3 +4,53 @@
 
 #include "Traits.h"
 
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace NEAT
+{
+    // the registry of interned trait names, it only grows
+    static std::mutex s_TraitNamesMutex;
+    static std::deque<std::string> s_TraitNames;
+    static std::unordered_map<std::string, int> s_TraitKeys;
+
+    int TraitKey(const std::string& a_Name)
+    {
+        std::lock_guard<std::mutex> t_lock(s_TraitNamesMutex);
+
+        std::unordered_map<std::string, int>::const_iterator t_it = s_TraitKeys.find(a_Name);
+        if (t_it != s_TraitKeys.end())
+        {
+            return t_it->second;
+        }
+
+        int t_key = static_cast<int>(s_TraitNames.size());
+        s_TraitNames.push_back(a_Name);
+        s_TraitKeys[a_Name] = t_key;
+        return t_key;
+    }
+
+    const std::string& TraitName(int a_Key)
+    {
+        // elements of a deque don't move when it grows
+        std::lock_guard<std::mutex> t_lock(s_TraitNamesMutex);
+        return s_TraitNames[a_Key];
+    }
+
+    void TraitParameters::Intern(const std::string& a_Name)
+    {
+        key = TraitKey(a_Name);
+        name = &TraitName(key);
+
+        dependency.reset();
+        if (dep_key != "")
+        {
+            TraitDependency *dep = new TraitDependency();
+            dep->dep_key = dep_key;
+            dep->dep_trait_key = TraitKey(dep_key);
+            dep->dep_values = dep_values;
+            dependency.reset(dep);
+        }
+    }
+}
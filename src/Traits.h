@@ -7,6 +7,8 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
 #include <boost/any.hpp>
 #include <boost/variant.hpp>
 #include <cmath>
@@ -95,6 +97,20 @@ namespace NEAT
     };
 
 
+    // The condition under which a trait counts, shared by all copies of the trait
+    class TraitDependency
+    {
+    public:
+        std::string dep_key; // counts only if this other trait exists..
+        int dep_trait_key; // (dep_key interned, -1 if not)
+        std::vector<TraitType> dep_values; // and has this value
+
+        TraitDependency()
+        {
+            dep_trait_key = -1;
+        }
+    };
+
     class TraitParameters
     {
     public:
@@ -114,6 +130,12 @@ namespace NEAT
 
         // keep dep_key empty and no conditional logic will apply
 
+        // Filled by Intern(), so genes don't look the trait up by name.
+        // key is -1 until then.
+        int key;
+        const std::string* name;
+        boost::shared_ptr<const TraitDependency> dependency; // NULL if dep_key is empty
+
         TraitParameters()
         {
             m_ImportanceCoeff = 0;
@@ -122,7 +144,13 @@ namespace NEAT
             m_Details = IntTraitParameters();
             dep_key = "";
             dep_values.push_back( std::string("") );
+            key = -1;
+            name = NULL;
         }
+
+        // Interns a_Name (the name of these parameters) and dep_key.
+        // Call again after changing dep_key or dep_values.
+        void Intern(const std::string& a_Name);
     };
 
     class Trait
@@ -130,15 +158,181 @@ namespace NEAT
     public:
         TraitType value;
 
+        // NULL if the trait always counts
+        boost::shared_ptr<const TraitDependency> dependency;
+
         Trait()
         {
             value = 0;
-            dep_values.push_back(0);
-            dep_key = "";
         }
+    };
 
-        std::string dep_key; // counts only if this other trait exists..
-        std::vector<TraitType> dep_values; // and has this value
+    // Trait names are interned - every name gets a small integer key, the same for all genes
+    int TraitKey(const std::string& a_Name);
+    // The name of an interned key. The reference stays valid.
+    const std::string& TraitName(int a_Key);
+
+    // The traits of a gene, ordered by name like a std::map, but kept in one flat array.
+    // Genes initialized from the same parameters hold the same traits in the same order,
+    // so looking up a trait of another gene by key usually hits at the first try.
+    class TraitMap
+    {
+    public:
+        class Entry
+        {
+        public:
+            int key;
+            const std::string* name;
+            Trait trait;
+        };
+
+        typedef std::vector<Entry>::iterator iterator;
+        typedef std::vector<Entry>::const_iterator const_iterator;
+
+        iterator begin() { return m_Entries.begin(); }
+        iterator end() { return m_Entries.end(); }
+        const_iterator begin() const { return m_Entries.begin(); }
+        const_iterator end() const { return m_Entries.end(); }
+        unsigned int size() const { return static_cast<unsigned int>(m_Entries.size()); }
+        bool empty() const { return m_Entries.empty(); }
+        void clear() { m_Entries.clear(); }
+        void swap(TraitMap& a_Other) { m_Entries.swap(a_Other.m_Entries); }
+
+        // Return NULL if there is no such trait.
+        // a_Hint is the position where the trait is expected.
+        Trait* Find(int a_Key, unsigned int a_Hint = 0)
+        {
+            return const_cast<Trait*>(static_cast<const TraitMap*>(this)->Find(a_Key, a_Hint));
+        }
+        const Trait* Find(int a_Key, unsigned int a_Hint = 0) const
+        {
+            if ((a_Hint < m_Entries.size()) && (m_Entries[a_Hint].key == a_Key))
+            {
+                return &m_Entries[a_Hint].trait;
+            }
+            for(unsigned int i=0; i<m_Entries.size(); i++)
+            {
+                if (m_Entries[i].key == a_Key)
+                {
+                    return &m_Entries[i].trait;
+                }
+            }
+            return NULL;
+        }
+        Trait* Find(const std::string& a_Name, unsigned int a_Hint = 0)
+        {
+            return const_cast<Trait*>(static_cast<const TraitMap*>(this)->Find(a_Name, a_Hint));
+        }
+        const Trait* Find(const std::string& a_Name, unsigned int a_Hint = 0) const
+        {
+            if ((a_Hint < m_Entries.size()) && (*m_Entries[a_Hint].name == a_Name))
+            {
+                return &m_Entries[a_Hint].trait;
+            }
+            for(unsigned int i=0; i<m_Entries.size(); i++)
+            {
+                if (*m_Entries[i].name == a_Name)
+                {
+                    return &m_Entries[i].trait;
+                }
+            }
+            return NULL;
+        }
+
+        unsigned int count(const std::string& a_Name) const
+        {
+            return (Find(a_Name) != NULL) ? 1 : 0;
+        }
+
+        const Trait& at(const std::string& a_Name) const
+        {
+            const Trait* t = Find(a_Name);
+            if (t == NULL)
+            {
+                throw std::out_of_range("No such trait: " + a_Name);
+            }
+            return *t;
+        }
+
+        // Like std::map, inserts a default trait if there is none.
+        // a_Hint is the position where the trait is expected.
+        Trait& Get(const std::string& a_Name, unsigned int a_Hint = 0)
+        {
+            Trait* t = Find(a_Name, a_Hint);
+            if (t != NULL)
+            {
+                return *t;
+            }
+
+            int t_key = TraitKey(a_Name);
+            return Get(t_key, &TraitName(t_key), a_Hint);
+        }
+        // The same with an interned key and its name (from TraitName()), this doesn't touch the registry.
+        Trait& Get(int a_Key, const std::string* a_Name, unsigned int a_Hint = 0)
+        {
+            Trait* t = Find(a_Key, a_Hint);
+            if (t != NULL)
+            {
+                return *t;
+            }
+
+            Entry e;
+            e.key = a_Key;
+            e.name = a_Name;
+
+            // usually the traits are added in order
+            std::vector<Entry>::iterator pos = m_Entries.end();
+            if ((!m_Entries.empty()) && (*a_Name < *m_Entries.back().name))
+            {
+                pos = std::lower_bound(m_Entries.begin(), m_Entries.end(), *a_Name, name_less);
+            }
+            return m_Entries.insert(pos, e)->trait;
+        }
+        Trait& operator[](const std::string& a_Name)
+        {
+            return Get(a_Name);
+        }
+
+        // The trait a_Dependency refers to, NULL if there is none
+        const Trait* FindDependency(const TraitDependency& a_Dependency) const
+        {
+            if (a_Dependency.dep_trait_key >= 0)
+            {
+                return Find(a_Dependency.dep_trait_key);
+            }
+            return Find(a_Dependency.dep_key);
+        }
+
+        // Returns true if a_Trait has no dependency or the trait it depends on has one of the required values
+        bool IsEnabled(const Trait& a_Trait) const
+        {
+            if (!a_Trait.dependency)
+            {
+                return true;
+            }
+
+            const TraitDependency& dependency = *a_Trait.dependency;
+            const Trait* t = FindDependency(dependency);
+            if (t != NULL)
+            {
+                for(unsigned int ix=0; ix<dependency.dep_values.size(); ix++)
+                {
+                    if (t->value == dependency.dep_values[ix])
+                    {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+    private:
+        std::vector<Entry> m_Entries;
+
+        static bool name_less(const Entry& a_Entry, const std::string& a_Name)
+        {
+            return *a_Entry.name < a_Name;
+        }
     };
 
 }